@@ -0,0 +1,134 @@
+#!/usr/bin/env python3
+#
+# Generates the XML atom table from a list of names, one per line:
+#   gen-xml-atoms.py xmlatoms.list xmlatoms.h xmlatoms.c
+#
+# xml_atom_lookup() hashes a name with a seeded FNV-1a hash, ignoring
+# case, into a table where no two atoms collide, so that finding the
+# atom of a name takes a single string comparison.
+
+import sys
+
+FNV_PRIME = 16777619
+
+
+def read_names(path):
+    names = []
+    with open(path, encoding='utf-8') as f:
+        for line in f:
+            line = line.strip()
+            if not line or line.startswith('#'):
+                continue
+            if line.lower() in (n.lower() for n in names):
+                sys.exit('%s: duplicate name "%s"' % (path, line))
+            names.append(line)
+    return names
+
+
+def atom_id(name):
+    prefix = 'PI_' if name.startswith('?') else ''
+    ident = ''.join(c if c.isalnum() else '_' for c in name.lstrip('?'))
+    return 'XML_ATOM_' + prefix + ident.upper()
+
+
+def fnv(name, seed):
+    h = seed
+    for c in name.encode('ascii'):
+        h = ((h ^ (c | 0x20)) * FNV_PRIME) & 0xffffffff
+    return h
+
+
+def find_seed(names, size):
+    for seed in range(0x811c9dc5, 0x811c9dc5 + 1000000):
+        slots = set()
+        for name in names:
+            slot = fnv(name, seed) & (size - 1)
+            if slot in slots:
+                break
+            slots.add(slot)
+        else:
+            return seed
+    return None
+
+
+def main(argv):
+    if len(argv) != 4:
+        sys.exit('usage: %s LIST HEADER SOURCE' % argv[0])
+    names = read_names(argv[1])
+    if len(names) > 254:
+        sys.exit('%s: too many names' % argv[1])
+
+    size = 1
+    while size < len(names) * 4:
+        size *= 2
+    seed = find_seed(names, size)
+    while seed is None:
+        size *= 2
+        seed = find_seed(names, size)
+
+    slots = [0] * size
+    for i, name in enumerate(names):
+        slots[fnv(name, seed) & (size - 1)] = i + 1
+
+    with open(argv[2], 'w', encoding='utf-8') as h:
+        h.write('/* Generated by gen-xml-atoms.py from xmlatoms.list, do not edit */\n\n')
+        h.write('#ifndef XML_ATOMS_H\n#define XML_ATOMS_H\n\n')
+        h.write('typedef enum {\n  XML_ATOM_NONE = 0,\n')
+        for name in names:
+            h.write('  %s, /* %s */\n' % (atom_id(name), name))
+        h.write('  XML_NUM_ATOMS\n} xml_atom_t;\n\n')
+        h.write('/* returns the atom for name, ignoring case, or XML_ATOM_NONE */\n')
+        h.write('int xml_atom_lookup (const char *name);\n')
+        h.write('const char *xml_atom_name (int atom);\n\n')
+        h.write('#endif\n')
+
+    with open(argv[3], 'w', encoding='utf-8') as c:
+        c.write('/* Generated by gen-xml-atoms.py from xmlatoms.list, do not edit */\n\n')
+        c.write('#include <stdint.h>\n#include <stddef.h>\n\n#include "xmlatoms.h"\n\n')
+        c.write('#define XML_ATOM_SEED 0x%08xU\n' % seed)
+        c.write('#define XML_ATOM_MASK 0x%xU\n\n' % (size - 1))
+        c.write('/* lower case */\nstatic const char *const xml_atom_names[XML_NUM_ATOMS] = {\n  NULL,\n')
+        for name in names:
+            c.write('  "%s",\n' % name.lower())
+        c.write('};\n\n')
+        c.write('static const unsigned char xml_atom_slots[XML_ATOM_MASK + 1] = {')
+        for i, atom in enumerate(slots):
+            c.write('%s%d,' % ('\n  ' if i % 16 == 0 else ' ', atom))
+        c.write('\n};\n\n')
+        c.write('''int xml_atom_lookup (const char *name)
+{
+  const unsigned char *p = (const unsigned char *) name;
+  const char *candidate;
+  uint32_t h = XML_ATOM_SEED;
+  int atom;
+
+  for (; *p; p++)
+    h = (h ^ (*p | 0x20)) * %dU;
+
+  atom = xml_atom_slots[h & XML_ATOM_MASK];
+  if (atom == XML_ATOM_NONE)
+    return XML_ATOM_NONE;
+
+  /* the names are all ASCII */
+  p = (const unsigned char *) name;
+  for (candidate = xml_atom_names[atom]; *candidate; candidate++, p++) {
+    unsigned char c = *p;
+    if (c >= 'A' && c <= 'Z')
+      c += 'a' - 'A';
+    if (c != (unsigned char) *candidate)
+      return XML_ATOM_NONE;
+  }
+  return *p ? XML_ATOM_NONE : atom;
+}
+
+const char *xml_atom_name (int atom)
+{
+  if (atom <= XML_ATOM_NONE || atom >= XML_NUM_ATOMS)
+    return NULL;
+  return xml_atom_names[atom];
+}
+''' % FNV_PRIME)
+
+
+if __name__ == '__main__':
+    main(sys.argv)
@@ -0,0 +1,172 @@
+#!/usr/bin/env python3
+#
+# Generates the table of HTML5 named character references, taken from
+# Python's html.entities module:
+#   gen-xml-entities.py xmlentities.h xmlentities.c
+#
+# Only the names terminated by a semicolon are included, and names are
+# case-sensitive. xml_entity_lookup() hashes a name into a bucket with a
+# seeded FNV-1a hash, then hashes it again with that bucket's seed into a
+# table where no two names collide, so that finding an entity takes a
+# single string comparison.
+
+import sys
+from html.entities import html5
+
+FNV_PRIME = 16777619
+FNV_SEED = 0x811c9dc5
+
+
+def read_entities():
+    entities = {}
+    for name, value in html5.items():
+        if not name.endswith(';'):
+            continue
+        name = name[:-1]
+        value = value.encode('utf-8')
+        # values are decoded in place, so must never be longer than the
+        # reference itself; this only leaves out &nGt; and &nLt;
+        if len(value) > len(name) + 2:
+            continue
+        entities[name] = value
+    return entities
+
+
+def fnv(name, seed):
+    h = seed
+    for c in name.encode('ascii'):
+        h = ((h ^ c) * FNV_PRIME) & 0xffffffff
+    return h
+
+
+def build_table(names, num_buckets, size):
+    buckets = [[] for _ in range(num_buckets)]
+    for name in names:
+        buckets[fnv(name, FNV_SEED) & (num_buckets - 1)].append(name)
+
+    slots = [None] * size
+    seeds = [0] * num_buckets
+    # the fullest buckets are placed first, while there's the most room
+    for b in sorted(range(num_buckets), key=lambda b: -len(buckets[b])):
+        if not buckets[b]:
+            continue
+        for seed in range(1, 0x10000):
+            wanted = set(fnv(name, seed) & (size - 1) for name in buckets[b])
+            if len(wanted) == len(buckets[b]) and all(slots[s] is None for s in wanted):
+                break
+        else:
+            return None
+        seeds[b] = seed
+        for name in buckets[b]:
+            slots[fnv(name, seed) & (size - 1)] = name
+    return seeds, slots
+
+
+def c_string(data):
+    return ''.join(chr(c) if 0x20 <= c < 0x7f and c not in b'"\\?' else '\\%03o' % c
+                   for c in data)
+
+
+def main(argv):
+    if len(argv) != 3:
+        sys.exit('usage: %s HEADER SOURCE' % argv[0])
+    entities = read_entities()
+    names = sorted(entities)
+
+    num_buckets = 1
+    while num_buckets * 4 < len(names):
+        num_buckets *= 2
+    size = 1
+    while size < len(names) * 2:
+        size *= 2
+    table = build_table(names, num_buckets, size)
+    while table is None:
+        size *= 2
+        table = build_table(names, num_buckets, size)
+    seeds, slots = table
+
+    max_name = max(len(name) for name in names)
+    max_value = max(len(value) for value in entities.values())
+
+    with open(argv[1], 'w', encoding='utf-8') as h:
+        h.write('/* Generated by gen-xml-entities.py, do not edit */\n\n')
+        h.write('#ifndef XML_ENTITIES_H\n#define XML_ENTITIES_H\n\n')
+        h.write('#include <stddef.h>\n\n')
+        h.write('/* longest entity name, without the & and ; */\n')
+        h.write('#define XML_ENTITY_MAX_NAME %d\n\n' % max_name)
+        h.write('/* returns the UTF-8 text of the named character reference\n')
+        h.write(' * "&name;", which is never longer than the reference, and stores\n')
+        h.write(' * its length in value_len; or NULL if there is no such entity */\n')
+        h.write('const char *xml_entity_lookup (const char *name, size_t len, size_t *value_len);\n\n')
+        h.write('#endif\n')
+
+    with open(argv[2], 'w', encoding='utf-8') as c:
+        c.write('/* Generated by gen-xml-entities.py, do not edit */\n\n')
+        c.write('#include <stdint.h>\n#include <string.h>\n\n#include "xmlentities.h"\n\n')
+        c.write('#define XML_ENTITY_SEED 0x%08xU\n' % FNV_SEED)
+        c.write('#define XML_ENTITY_BUCKET_MASK 0x%xU\n' % (num_buckets - 1))
+        c.write('#define XML_ENTITY_MASK 0x%xU\n\n' % (size - 1))
+
+        pool = bytearray()
+        offsets = {}
+        for name in names:
+            offsets[name] = len(pool)
+            pool += name.encode('ascii')
+        c.write('static const char xml_entity_names[] =')
+        for i in range(0, len(pool), 64):
+            c.write('\n  "%s"' % c_string(pool[i:i + 64]))
+        c.write(';\n\n')
+
+        c.write('static const struct {\n')
+        c.write('  uint16_t name;\n  uint8_t name_len;\n  uint8_t value_len;\n')
+        c.write('  char value[%d];\n} xml_entities[%d] = {\n' % (max_value + 1, len(names) + 1))
+        c.write('  { 0, 0, 0, "" },\n')
+        index = {}
+        for i, name in enumerate(names):
+            index[name] = i + 1
+            value = entities[name]
+            c.write('  { %d, %d, %d, "%s" }, /* %s */\n'
+                    % (offsets[name], len(name), len(value), c_string(value), name))
+        c.write('};\n\n')
+
+        c.write('static const uint16_t xml_entity_seeds[XML_ENTITY_BUCKET_MASK + 1] = {')
+        for i, seed in enumerate(seeds):
+            c.write('%s%d,' % ('\n  ' if i % 16 == 0 else ' ', seed))
+        c.write('\n};\n\n')
+
+        c.write('static const uint16_t xml_entity_slots[XML_ENTITY_MASK + 1] = {')
+        for i, name in enumerate(slots):
+            c.write('%s%d,' % ('\n  ' if i % 16 == 0 else ' ', index[name] if name else 0))
+        c.write('\n};\n\n')
+
+        c.write('''static uint32_t xml_entity_hash (const char *name, size_t len, uint32_t h)
+{
+  const unsigned char *p = (const unsigned char *) name;
+
+  while (len--)
+    h = (h ^ *p++) * %dU;
+  return h;
+}
+
+const char *xml_entity_lookup (const char *name, size_t len, size_t *value_len)
+{
+  uint32_t seed;
+  int entity;
+
+  if (len == 0 || len > XML_ENTITY_MAX_NAME)
+    return NULL;
+
+  seed = xml_entity_seeds[xml_entity_hash (name, len, XML_ENTITY_SEED) & XML_ENTITY_BUCKET_MASK];
+  entity = xml_entity_slots[xml_entity_hash (name, len, seed) & XML_ENTITY_MASK];
+  if (entity == 0 || xml_entities[entity].name_len != len
+      || memcmp (xml_entity_names + xml_entities[entity].name, name, len) != 0)
+    return NULL;
+
+  *value_len = xml_entities[entity].value_len;
+  return xml_entities[entity].value;
+}
+''' % FNV_PRIME)
+
+
+if __name__ == '__main__':
+    main(sys.argv)
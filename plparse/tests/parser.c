@@ -10,6 +10,7 @@
 
 #include <glib.h>
 #include <glib/gi18n.h>
+#include <glib/gstdio.h>
 #include <gio/gio.h>
 
 #include <string.h>
@@ -18,6 +19,8 @@
 #endif /* HAVE_UNISTD_H */
 #include <stdlib.h>
 #include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 
 #include "totem-pl-parser.h"
 #include "totem-pl-parser-mini.h"
@@ -429,6 +432,11 @@ test_parsing_xspf_metadata (void)
 	uri = get_relative_uri (TEST_SRCDIR "playlist.xspf");
 	g_assert_cmpstr (parser_test_get_playlist_field (uri, TOTEM_PL_PARSER_FIELD_TITLE), ==, "Test Playlist");
 	g_free (uri);
+
+	/* The title comes after the tracks */
+	uri = get_relative_uri (TEST_SRCDIR "new-lastfm-output.xspf");
+	g_assert_cmpstr (parser_test_get_playlist_field (uri, TOTEM_PL_PARSER_FIELD_TITLE), ==, "Free Download Tag Radio");
+	g_free (uri);
 }
 
 static void
@@ -455,6 +463,57 @@ test_smi_starttime (void)
 	g_free (uri);
 }
 
+static void
+test_smil_deep_nesting (void)
+{
+	char *uri;
+	/* Nesting used to be limited to 25 levels */
+	uri = get_relative_uri (TEST_SRCDIR "nested-seq.smil");
+	g_assert_cmpstr (parser_test_get_entry_field (uri, TOTEM_PL_PARSER_FIELD_URI), ==, "http://example.com/nested.ogv");
+	g_free (uri);
+}
+
+static void
+test_parsing_utf16_utf32 (void)
+{
+	char *uri;
+
+	/* Documents with a byte order mark are converted by the XML lexer,
+	 * in place as long as the UTF-8 text doesn't get ahead of the text
+	 * it's converted from, which is the case for all of these */
+	uri = get_relative_uri (TEST_SRCDIR "utf16le.wax");
+	g_assert_cmpstr (parser_test_get_entry_field (uri, TOTEM_PL_PARSER_FIELD_TITLE), ==, "Café déjà vu 𝄞");
+	g_assert_cmpstr (parser_test_get_entry_field (uri, TOTEM_PL_PARSER_FIELD_URI), ==, "http://www.example.com/music/utf16le.ogg");
+	g_free (uri);
+
+	uri = get_relative_uri (TEST_SRCDIR "utf16be.smil");
+	g_assert_cmpstr (parser_test_get_entry_field (uri, TOTEM_PL_PARSER_FIELD_TITLE), ==, "Été — 🎵");
+	g_assert_cmpstr (parser_test_get_entry_field (uri, TOTEM_PL_PARSER_FIELD_URI), ==, "http://www.example.com/music/utf16be.ogg");
+	g_free (uri);
+
+	uri = get_relative_uri (TEST_SRCDIR "utf32be.wax");
+	g_assert_cmpstr (parser_test_get_entry_field (uri, TOTEM_PL_PARSER_FIELD_TITLE), ==, "Straße 音楽 𝄞");
+	g_assert_cmpstr (parser_test_get_entry_field (uri, TOTEM_PL_PARSER_FIELD_URI), ==, "http://www.example.com/music/utf32be.ogg");
+	g_free (uri);
+
+	uri = get_relative_uri (TEST_SRCDIR "utf16le-ascii.smil");
+	g_assert_cmpstr (parser_test_get_entry_field (uri, TOTEM_PL_PARSER_FIELD_TITLE), ==, "Plain ASCII title ©");
+	g_free (uri);
+
+	/* The CJK title at the start takes more room in UTF-8 than in
+	 * UTF-16, so the text is converted to a new buffer instead */
+	uri = get_relative_uri (TEST_SRCDIR "utf16be-cjk.smil");
+	g_assert_cmpstr (parser_test_get_entry_field (uri, TOTEM_PL_PARSER_FIELD_TITLE), ==,
+			 "一严乊乯五亹仞伃伨位佲侗侼信倆倫偐偵傚傿僤儉儮兓典冝凂凧刌刱剖剻加勅勪匏匴卙卾厣");
+	g_assert_cmpstr (parser_test_get_entry_field (uri, TOTEM_PL_PARSER_FIELD_URI), ==, "http://www.example.com/music/cjk.ogg");
+	g_free (uri);
+
+	/* Unpaired surrogates are replaced */
+	uri = get_relative_uri (TEST_SRCDIR "utf16le-surrogate.wax");
+	g_assert_cmpstr (parser_test_get_entry_field (uri, TOTEM_PL_PARSER_FIELD_TITLE), ==, "Lone \xef\xbf\xbd surrogate");
+	g_free (uri);
+}
+
 static void
 test_m3u_leading_tabs (void)
 {
@@ -465,6 +524,57 @@ test_m3u_leading_tabs (void)
 	g_free (uri);
 }
 
+static void
+test_m3u_line_endings (void)
+{
+	char *uri;
+
+	/* Mixes "\r\n", lone "\r" and "\n" line endings */
+	uri = get_relative_uri (TEST_SRCDIR "line-endings.m3u");
+	g_assert_cmpuint (parser_test_get_num_entries (uri), ==, 3);
+	g_assert_cmpstr (parser_test_get_entry_field (uri, TOTEM_PL_PARSER_FIELD_TITLE), ==, "First");
+	g_assert_cmpstr (parser_test_get_entry_field (uri, TOTEM_PL_PARSER_FIELD_URI), ==, "http://www.example.com/1.ogg");
+	g_free (uri);
+}
+
+static void
+test_m3u_long_line (void)
+{
+	GString *contents, *long_uri;
+	GError *error = NULL;
+	char *filename, *uri, *first;
+	int fd;
+
+	/* The first entry doesn't fit in a single chunk of the file,
+	 * and its line ending comes in a different chunk */
+	long_uri = g_string_new ("http://www.example.com/");
+	while (long_uri->len < 20000)
+		g_string_append (long_uri, "long-path/");
+	g_string_append (long_uri, "track.ogg");
+
+	contents = g_string_new ("#EXTM3U\r\n#EXTINF:10,Long\r\n");
+	g_string_append (contents, long_uri->str);
+	g_string_append (contents, "\r\nhttp://www.example.com/short.ogg");
+
+	fd = g_file_open_tmp ("totem-pl-parser-long-line-XXXXXX.m3u", &filename, &error);
+	g_assert_no_error (error);
+	close (fd);
+	g_file_set_contents (filename, contents->str, contents->len, &error);
+	g_assert_no_error (error);
+	g_string_free (contents, TRUE);
+	uri = g_filename_to_uri (filename, NULL, NULL);
+
+	g_assert_cmpuint (parser_test_get_num_entries (uri), ==, 2);
+	first = parser_test_get_entry_field (uri, TOTEM_PL_PARSER_FIELD_URI);
+	g_assert_cmpstr (first, ==, long_uri->str);
+	g_free (first);
+
+	g_unlink (filename);
+	g_free (filename);
+	g_free (uri);
+	g_string_free (long_uri, TRUE);
+}
+
 static void
 test_directory_recurse (void)
 {
@@ -593,6 +703,851 @@ test_parsing_num_entries (void)
 	g_assert_cmpint (num, ==, 19);
 }
 
+static void
+test_parsing_pls_index_order (void)
+{
+	char *uri;
+
+	/* Entries come out in the order of their indexes, not
+	 * in the order of the lines in the file */
+	uri = get_relative_uri (TEST_SRCDIR "out-of-order.pls");
+	g_assert_cmpuint (parser_test_get_num_entries (uri), ==, 3);
+	g_assert_cmpstr (parser_test_get_entry_field (uri, TOTEM_PL_PARSER_FIELD_TITLE), ==, "First");
+	g_assert_cmpstr (parser_test_get_entry_field (uri, TOTEM_PL_PARSER_FIELD_URI), ==, "http://www.example.com/1.ogg");
+	g_free (uri);
+}
+
+static void
+test_parsing_desktop_localised (void)
+{
+	char *uri;
+
+	/* The plain "Name" key wins over the localised ones, wherever
+	 * it is, and "URL[$e]" is used as there's no plain "URL" */
+	uri = get_relative_uri (TEST_SRCDIR "localised.desktop");
+	g_assert_cmpuint (parser_test_get_num_entries (uri), ==, 1);
+	g_assert_cmpstr (parser_test_get_entry_field (uri, TOTEM_PL_PARSER_FIELD_TITLE), ==, "First");
+	g_assert_cmpstr (parser_test_get_entry_field (uri, TOTEM_PL_PARSER_FIELD_URI), ==, "http://www.example.com/1.ogg");
+	g_free (uri);
+}
+
+static void
+test_parsing_large_m3u (void)
+{
+	char *uri;
+	guint num;
+
+	/* Much bigger than what's read to detect the type,
+	 * so the rest needs to be read from the same stream */
+	uri = get_relative_uri (TEST_SRCDIR "large-playlist.m3u");
+	num = parser_test_get_num_entries (uri);
+	g_assert_cmpint (num, ==, 500);
+	g_assert_cmpstr (parser_test_get_entry_field (uri, TOTEM_PL_PARSER_FIELD_TITLE), ==, "Track 001");
+	g_free (uri);
+}
+
+static void
+entry_parsed_not_batched_cb (TotemPlParser *parser,
+			     const char *uri,
+			     GHashTable *metadata,
+			     gpointer data)
+{
+	g_assert_not_reached ();
+}
+
+static void
+entries_parsed_batch_cb (TotemPlParser *parser,
+			 GPtrArray *uris,
+			 GPtrArray *metadata,
+			 guint *counts)
+{
+	g_assert_cmpuint (uris->len, ==, metadata->len);
+	g_assert_cmpuint (uris->len, <=, 64);
+	counts[0] += uris->len;
+	counts[1]++;
+}
+
+static void
+test_parsing_batched_entries (void)
+{
+	TotemPlParser *pl;
+	TotemPlParserResult retval;
+	guint counts[2] = { 0, 0 };
+	char *uri;
+
+	pl = totem_pl_parser_new ();
+	g_object_set (pl, "recurse", FALSE,
+			  "debug", option_debug,
+			  "batch-size", 64,
+			  NULL);
+	g_signal_connect (G_OBJECT (pl), "entry-parsed",
+			  G_CALLBACK (entry_parsed_not_batched_cb), NULL);
+	g_signal_connect (G_OBJECT (pl), "entries-parsed",
+			  G_CALLBACK (entries_parsed_batch_cb), counts);
+
+	uri = get_relative_uri (TEST_SRCDIR "large-playlist.m3u");
+	retval = totem_pl_parser_parse_with_base (pl, uri, NULL, FALSE);
+	g_assert_cmpint (retval, ==, TOTEM_PL_PARSER_RESULT_SUCCESS);
+	g_free (uri);
+	g_object_unref (pl);
+
+	/* 500 entries in blocks of 64 */
+	g_assert_cmpuint (counts[0], ==, 500);
+	g_assert_cmpuint (counts[1], ==, 8);
+}
+
+typedef struct {
+	guint count;
+	gboolean reparsed;
+} ReentrantBatchData;
+
+static void
+entries_parsed_reentrant_cb (TotemPlParser *parser,
+			     GPtrArray *uris,
+			     GPtrArray *metadata,
+			     ReentrantBatchData *data)
+{
+	char *uri;
+
+	data->count += uris->len;
+	if (data->reparsed != FALSE)
+		return;
+	data->reparsed = TRUE;
+
+	/* Parsing from the handler used to deadlock, as the handler was
+	 * called with the batch lock held */
+	uri = get_relative_uri (TEST_SRCDIR "line-endings.m3u");
+	g_assert_cmpint (totem_pl_parser_parse (parser, uri, FALSE), ==, TOTEM_PL_PARSER_RESULT_SUCCESS);
+	g_free (uri);
+}
+
+static void
+test_parsing_batch_reentrant (void)
+{
+	TotemPlParser *pl;
+	ReentrantBatchData data = { 0, FALSE };
+	char *uri;
+
+	pl = totem_pl_parser_new ();
+	g_object_set (pl, "recurse", FALSE,
+			  "debug", option_debug,
+			  "batch-size", 64,
+			  NULL);
+	g_signal_connect (G_OBJECT (pl), "entries-parsed",
+			  G_CALLBACK (entries_parsed_reentrant_cb), &data);
+
+	uri = get_relative_uri (TEST_SRCDIR "large-playlist.m3u");
+	g_assert_cmpint (totem_pl_parser_parse (pl, uri, FALSE), ==, TOTEM_PL_PARSER_RESULT_SUCCESS);
+	g_free (uri);
+	g_object_unref (pl);
+
+	g_assert_true (data.reparsed);
+	g_assert_cmpuint (data.count, ==, 500 + 3);
+}
+
+typedef struct {
+	char *path;
+	GMutex mutex;
+	GCond cond;
+	GArray *batches;
+	gboolean timed_out;
+	gboolean done;
+} DelayedSourceData;
+
+/* Writes the start of a playlist to a pipe, and only writes
+ * the rest of it once the first batch of entries was received */
+static gpointer
+delayed_source_thread (DelayedSourceData *data)
+{
+	GString *start;
+	gint64 end_time;
+	FILE *pipe;
+	guint i;
+
+	/* Longer than what's read to detect the type */
+	start = g_string_new ("#EXTM3U\n");
+	for (i = 0; i < 32; i++)
+		g_string_append (start, "# Padding padding padding padding padding padding\n");
+	g_string_append (start, "http://www.example.com/1.ogg\n"
+			 "http://www.example.com/2.ogg\n"
+			 "http://www.example.com/3.ogg\n");
+
+	pipe = fopen (data->path, "w");
+	g_assert_nonnull (pipe);
+	fputs (start->str, pipe);
+	fflush (pipe);
+	g_string_free (start, TRUE);
+
+	end_time = g_get_monotonic_time () + 5 * G_TIME_SPAN_SECOND;
+	g_mutex_lock (&data->mutex);
+	while (data->batches->len == 0 && data->timed_out == FALSE) {
+		if (g_cond_wait_until (&data->cond, &data->mutex, end_time) == FALSE)
+			data->timed_out = TRUE;
+	}
+	g_mutex_unlock (&data->mutex);
+
+	fputs ("http://www.example.com/4.ogg\n"
+	       "http://www.example.com/5.ogg\n", pipe);
+	fclose (pipe);
+
+	return NULL;
+}
+
+static void
+entries_parsed_delayed_cb (TotemPlParser *parser,
+			   GPtrArray *uris,
+			   GPtrArray *metadata,
+			   DelayedSourceData *data)
+{
+	g_mutex_lock (&data->mutex);
+	g_array_append_val (data->batches, uris->len);
+	g_cond_signal (&data->cond);
+	g_mutex_unlock (&data->mutex);
+}
+
+static void
+delayed_source_parse_ready (GObject *pl, GAsyncResult *result, gpointer user_data)
+{
+	DelayedSourceData *data = user_data;
+
+	g_assert_cmpint (totem_pl_parser_parse_finish (TOTEM_PL_PARSER (pl), result, NULL), ==, TOTEM_PL_PARSER_RESULT_SUCCESS);
+	data->done = TRUE;
+}
+
+static void
+test_parsing_batch_timeout (void)
+{
+	DelayedSourceData data = { NULL, };
+	TotemPlParser *pl;
+	GThread *thread;
+	char *dir, *uri;
+
+	dir = g_dir_make_tmp ("totem-pl-parser-XXXXXX", NULL);
+	g_assert_nonnull (dir);
+	data.path = g_build_filename (dir, "delayed.m3u", NULL);
+	g_assert_cmpint (mkfifo (data.path, 0600), ==, 0);
+	g_mutex_init (&data.mutex);
+	g_cond_init (&data.cond);
+	data.batches = g_array_new (FALSE, FALSE, sizeof (guint));
+
+	pl = totem_pl_parser_new ();
+	g_object_set (pl, "recurse", FALSE,
+			  "debug", option_debug,
+			  "batch-size", 64,
+			  "batch-timeout", 50,
+			  NULL);
+	g_signal_connect (G_OBJECT (pl), "entries-parsed",
+			  G_CALLBACK (entries_parsed_delayed_cb), &data);
+
+	/* The first 3 entries are sent after the timeout, without
+	 * waiting for the source to send more */
+	thread = g_thread_new ("delayed-source", (GThreadFunc) delayed_source_thread, &data);
+	uri = g_filename_to_uri (data.path, NULL, NULL);
+	totem_pl_parser_parse_async (pl, uri, FALSE, NULL, delayed_source_parse_ready, &data);
+	while (data.done == FALSE)
+		g_main_context_iteration (NULL, TRUE);
+	g_thread_join (thread);
+
+	g_assert_false (data.timed_out);
+	g_assert_cmpuint (data.batches->len, ==, 2);
+	g_assert_cmpuint (g_array_index (data.batches, guint, 0), ==, 3);
+	g_assert_cmpuint (g_array_index (data.batches, guint, 1), ==, 2);
+
+	g_object_unref (pl);
+	g_unlink (data.path);
+	g_rmdir (dir);
+	g_free (uri);
+	g_free (data.path);
+	g_free (dir);
+	g_array_unref (data.batches);
+	g_cond_clear (&data.cond);
+	g_mutex_clear (&data.mutex);
+}
+
+static void
+test_parsing_to_playlist (void)
+{
+	TotemPlParser *pl;
+	TotemPlPlaylist *playlist;
+	TotemPlPlaylistIter iter;
+	TotemPlParserResult retval;
+	char *uri, *entry_uri, *title;
+
+	pl = totem_pl_parser_new ();
+	g_object_set (pl, "recurse", FALSE,
+			  "debug", option_debug,
+			  NULL);
+	g_signal_connect (G_OBJECT (pl), "entry-parsed",
+			  G_CALLBACK (entry_parsed_not_batched_cb), NULL);
+	playlist = totem_pl_playlist_new ();
+
+	uri = get_relative_uri (TEST_SRCDIR "large-playlist.m3u");
+	retval = totem_pl_parser_parse_to_playlist (pl, uri, NULL, FALSE, playlist);
+	g_assert_cmpint (retval, ==, TOTEM_PL_PARSER_RESULT_SUCCESS);
+	g_free (uri);
+
+	g_assert_cmpuint (totem_pl_playlist_size (playlist), ==, 500);
+	g_assert_true (totem_pl_playlist_iter_first (playlist, &iter));
+	totem_pl_playlist_get (playlist, &iter,
+			       TOTEM_PL_PARSER_FIELD_URI, &entry_uri,
+			       TOTEM_PL_PARSER_FIELD_TITLE, &title,
+			       NULL);
+	g_assert_cmpstr (entry_uri, ==, "http://www.example.com/music/track-001.ogg");
+	g_assert_cmpstr (title, ==, "Track 001");
+	g_free (entry_uri);
+	g_free (title);
+
+	g_object_unref (playlist);
+	g_object_unref (pl);
+}
+
+static void
+entry_parsed_count_cb (TotemPlParser *parser,
+		       const char *uri,
+		       GHashTable *metadata,
+		       guint *count)
+{
+	(*count)++;
+}
+
+static void
+concurrent_parse_ready (GObject *pl, GAsyncResult *result, gpointer user_data)
+{
+	guint *pending = user_data;
+
+	g_assert_cmpint (totem_pl_parser_parse_finish (TOTEM_PL_PARSER (pl), result, NULL), ==, TOTEM_PL_PARSER_RESULT_SUCCESS);
+	(*pending)--;
+}
+
+static void
+test_parsing_to_playlist_concurrent (void)
+{
+	TotemPlParser *pl;
+	TotemPlPlaylist *playlist;
+	guint count = 0, pending = 2;
+	char *uri;
+
+	pl = totem_pl_parser_new ();
+	g_object_set (pl, "recurse", FALSE,
+			  "debug", option_debug,
+			  NULL);
+	g_signal_connect (G_OBJECT (pl), "entry-parsed",
+			  G_CALLBACK (entry_parsed_count_cb), &count);
+	playlist = totem_pl_playlist_new ();
+
+	/* Each operation keeps its own entries */
+	uri = get_relative_uri (TEST_SRCDIR "large-playlist.m3u");
+	totem_pl_parser_parse_to_playlist_async (pl, uri, NULL, FALSE, playlist, NULL, concurrent_parse_ready, &pending);
+	totem_pl_parser_parse_async (pl, uri, FALSE, NULL, concurrent_parse_ready, &pending);
+	while (pending > 0)
+		g_main_context_iteration (NULL, TRUE);
+	g_free (uri);
+
+	g_assert_cmpuint (totem_pl_playlist_size (playlist), ==, 500);
+	g_assert_cmpuint (count, ==, 500);
+
+	g_object_unref (playlist);
+	g_object_unref (pl);
+}
+
+static void
+entry_parsed_last_uri_cb (TotemPlParser *parser,
+			  const char *uri,
+			  GHashTable *metadata,
+			  char **last_uri)
+{
+	g_free (*last_uri);
+	*last_uri = g_strdup (uri);
+}
+
+static void
+playlist_ended_count_cb (TotemPlParser *parser,
+			 const char *uri,
+			 guint *count)
+{
+	(*count)++;
+}
+
+static char *
+parse_last_uri (TotemPlParser *pl, const char *uri)
+{
+	char *last_uri = NULL;
+	gulong id;
+
+	id = g_signal_connect (G_OBJECT (pl), "entry-parsed",
+			       G_CALLBACK (entry_parsed_last_uri_cb), &last_uri);
+	g_assert_cmpint (totem_pl_parser_parse (pl, uri, FALSE), ==, TOTEM_PL_PARSER_RESULT_SUCCESS);
+	g_signal_handler_disconnect (pl, id);
+
+	return last_uri;
+}
+
+static void
+set_mtime (GFile *file, guint64 mtime, guint32 usec)
+{
+	GFileInfo *info;
+	GError *error = NULL;
+
+	info = g_file_info_new ();
+	g_file_info_set_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED, mtime);
+	g_file_info_set_attribute_uint32 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC, usec);
+	g_file_set_attributes_from_info (file, info, G_FILE_QUERY_INFO_NONE, NULL, &error);
+	g_assert_no_error (error);
+	g_object_unref (info);
+}
+
+static void
+test_parsing_cache (void)
+{
+	TotemPlParser *pl;
+	GFileInfo *info;
+	GFile *file;
+	GError *error = NULL;
+	char *filename, *uri, *last;
+	guint64 mtime;
+	guint32 usec;
+	guint count, ended, i;
+	int fd;
+
+	fd = g_file_open_tmp ("totem-pl-parser-cache-XXXXXX.m3u", &filename, &error);
+	g_assert_no_error (error);
+	close (fd);
+	g_file_set_contents (filename, "http://www.example.com/a.ogg\nhttp://www.example.com/b.ogg\n", -1, &error);
+	g_assert_no_error (error);
+	uri = g_filename_to_uri (filename, NULL, NULL);
+	file = g_file_new_for_path (filename);
+
+	info = g_file_query_info (file,
+				  G_FILE_ATTRIBUTE_TIME_MODIFIED ","
+				  G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC,
+				  G_FILE_QUERY_INFO_NONE, NULL, &error);
+	g_assert_no_error (error);
+	mtime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+	usec = g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+	g_object_unref (info);
+
+	pl = totem_pl_parser_new ();
+	g_object_set (pl, "recurse", FALSE,
+			  "debug", option_debug,
+			  "cache", TRUE,
+			  NULL);
+
+	last = parse_last_uri (pl, uri);
+	g_assert_cmpstr (last, ==, "http://www.example.com/b.ogg");
+	g_free (last);
+
+	/* With the same size and modification time, the cached
+	 * entries are sent, without reading the file */
+	g_file_set_contents (filename, "http://www.example.com/a.ogg\nhttp://www.example.com/c.ogg\n", -1, &error);
+	g_assert_no_error (error);
+	set_mtime (file, mtime, usec);
+	last = parse_last_uri (pl, uri);
+	g_assert_cmpstr (last, ==, "http://www.example.com/b.ogg");
+	g_free (last);
+
+	/* Once modified, the file is parsed again */
+	set_mtime (file, mtime + 10, usec);
+	last = parse_last_uri (pl, uri);
+	g_assert_cmpstr (last, ==, "http://www.example.com/c.ogg");
+	g_free (last);
+
+	/* Touched without changing, the cached entries are kept,
+	 * under the new modification time */
+	set_mtime (file, mtime + 20, usec);
+	last = parse_last_uri (pl, uri);
+	g_assert_cmpstr (last, ==, "http://www.example.com/c.ogg");
+	g_free (last);
+
+	g_file_set_contents (filename, "http://www.example.com/a.ogg\nhttp://www.example.com/e.ogg\n", -1, &error);
+	g_assert_no_error (error);
+	set_mtime (file, mtime + 20, usec);
+	last = parse_last_uri (pl, uri);
+	g_assert_cmpstr (last, ==, "http://www.example.com/c.ogg");
+	g_free (last);
+
+	/* Not with the cache disabled */
+	g_file_set_contents (filename, "http://www.example.com/a.ogg\nhttp://www.example.com/d.ogg\n", -1, &error);
+	g_assert_no_error (error);
+	set_mtime (file, mtime + 20, usec);
+	g_object_set (pl, "cache", FALSE, NULL);
+	last = parse_last_uri (pl, uri);
+	g_assert_cmpstr (last, ==, "http://www.example.com/d.ogg");
+	g_free (last);
+
+	g_unlink (filename);
+	g_free (filename);
+	g_free (uri);
+	g_object_unref (file);
+
+	/* The start and end of feeds are sent again too */
+	g_object_set (pl, "cache", TRUE, NULL);
+	g_signal_connect (G_OBJECT (pl), "entry-parsed",
+			  G_CALLBACK (entry_parsed_count_cb), &count);
+	g_signal_connect (G_OBJECT (pl), "playlist-ended",
+			  G_CALLBACK (playlist_ended_count_cb), &ended);
+	uri = get_relative_uri (TEST_SRCDIR "585407.rss");
+	for (i = 0; i < 2; i++) {
+		count = ended = 0;
+		g_assert_cmpint (totem_pl_parser_parse (pl, uri, FALSE), ==, TOTEM_PL_PARSER_RESULT_SUCCESS);
+		g_assert_cmpuint (count, ==, 29);
+		g_assert_cmpuint (ended, ==, 1);
+	}
+	g_free (uri);
+
+	g_object_unref (pl);
+}
+
+#define PERF_NUM_ENTRIES 20000
+#define PERF_NUM_RUNS 5
+
+/* Writes @contents to a temporary file named after @name, and parses it
+ * PERF_NUM_RUNS times, checking that @num_entries entries are found, or
+ * setting it to the number found if it's 0. Returns the best time. */
+static double
+perf_parse_best (const char *name,
+		 GString    *contents,
+		 guint      *num_entries)
+{
+	TotemPlParser *pl;
+	GError *error = NULL;
+	char *filename, *uri, *template;
+	double elapsed, best;
+	guint count, i;
+	int fd;
+
+	template = g_strdup_printf ("totem-pl-parser-perf-XXXXXX-%s", name);
+	fd = g_file_open_tmp (template, &filename, &error);
+	g_assert_no_error (error);
+	g_free (template);
+	close (fd);
+	g_file_set_contents (filename, contents->str, contents->len, &error);
+	g_assert_no_error (error);
+	uri = g_filename_to_uri (filename, NULL, NULL);
+
+	pl = totem_pl_parser_new ();
+	g_object_set (pl, "recurse", FALSE, NULL);
+	g_signal_connect (G_OBJECT (pl), "entry-parsed",
+			  G_CALLBACK (entry_parsed_count_cb), &count);
+
+	best = G_MAXDOUBLE;
+	for (i = 0; i < PERF_NUM_RUNS; i++) {
+		count = 0;
+		g_test_timer_start ();
+		g_assert_cmpint (totem_pl_parser_parse (pl, uri, FALSE), ==, TOTEM_PL_PARSER_RESULT_SUCCESS);
+		elapsed = g_test_timer_elapsed ();
+		if (*num_entries == 0)
+			*num_entries = count;
+		g_assert_cmpuint (count, >, 0);
+		g_assert_cmpuint (count, ==, *num_entries);
+		best = MIN (best, elapsed);
+	}
+
+	g_object_unref (pl);
+	g_unlink (filename);
+	g_free (filename);
+	g_free (uri);
+
+	return best;
+}
+
+/* Reports the time per entry, or with @throughput, the amount of text
+ * parsed per second, for benchmarks that scale the document rather
+ * than the number of entries */
+static void
+perf_parse_generated (const char *name,
+		      GString    *contents,
+		      guint       num_entries,
+		      gboolean    throughput)
+{
+	double best;
+
+	best = perf_parse_best (name, contents, &num_entries);
+
+	if (throughput) {
+		g_test_maximized_result (contents->len / best / (1024 * 1024),
+					 "%.1f MB/s parsing %s scaled to %.1f MB (%u entries, %.3f usec per entry)",
+					 contents->len / best / (1024 * 1024), name,
+					 contents->len / (1024.0 * 1024), num_entries,
+					 best * G_USEC_PER_SEC / num_entries);
+		return;
+	}
+
+	g_test_minimized_result (best * G_USEC_PER_SEC / num_entries,
+				 "%.3f usec per entry parsing %s (%.1f MB, %u entries)",
+				 best * G_USEC_PER_SEC / num_entries, name,
+				 contents->len / (1024.0 * 1024), num_entries);
+}
+
+static double
+perf_add_entries (TotemPlParser *pl,
+		  char         **uris,
+		  char         **titles,
+		  char         **durations,
+		  gboolean       varargs)
+{
+	double elapsed, best;
+	guint count, i, j;
+	gulong handler;
+
+	handler = g_signal_connect (G_OBJECT (pl), "entry-parsed",
+				    G_CALLBACK (entry_parsed_count_cb), &count);
+
+	best = G_MAXDOUBLE;
+	for (i = 0; i < PERF_NUM_RUNS; i++) {
+		count = 0;
+		g_test_timer_start ();
+		for (j = 0; j < PERF_NUM_ENTRIES; j++) {
+			if (varargs) {
+				totem_pl_parser_add_uri (pl,
+							 TOTEM_PL_PARSER_FIELD_URI, uris[j],
+							 TOTEM_PL_PARSER_FIELD_TITLE, titles[j],
+							 TOTEM_PL_PARSER_FIELD_DURATION, durations[j],
+							 NULL);
+			} else {
+				TotemPlParserField fields[] = {
+					{ TOTEM_PL_FIELD_ID_URI, uris[j] },
+					{ TOTEM_PL_FIELD_ID_TITLE, titles[j] },
+					{ TOTEM_PL_FIELD_ID_DURATION, durations[j] },
+				};
+
+				totem_pl_parser_add_fields (pl, NULL, NULL, FALSE, fields, G_N_ELEMENTS (fields));
+			}
+		}
+		elapsed = g_test_timer_elapsed ();
+		g_assert_cmpuint (count, ==, PERF_NUM_ENTRIES);
+		best = MIN (best, elapsed);
+	}
+
+	g_signal_handler_disconnect (pl, handler);
+
+	return best;
+}
+
+static void
+test_perf_add_entries (void)
+{
+	TotemPlParser *pl;
+	char **uris, **titles, **durations;
+	double best_varargs, best_fields;
+	guint i;
+
+	/* Time adding the same entries through the varargs
+	 * totem_pl_parser_add_uri(), which all the format handlers used to
+	 * go through, and through totem_pl_parser_add_fields(), with the
+	 * values prepared beforehand */
+	uris = g_new (char *, PERF_NUM_ENTRIES);
+	titles = g_new (char *, PERF_NUM_ENTRIES);
+	durations = g_new (char *, PERF_NUM_ENTRIES);
+	for (i = 0; i < PERF_NUM_ENTRIES; i++) {
+		uris[i] = g_strdup_printf ("http://www.example.com/music/track-%05u.ogg", i);
+		titles[i] = g_strdup_printf ("Artist %u - Title %u", i % 97, i);
+		durations[i] = g_strdup_printf ("%u", 180 + i % 120);
+	}
+
+	pl = totem_pl_parser_new ();
+	best_varargs = perf_add_entries (pl, uris, titles, durations, TRUE);
+	best_fields = perf_add_entries (pl, uris, titles, durations, FALSE);
+	g_object_unref (pl);
+
+	g_test_minimized_result (best_varargs * G_USEC_PER_SEC / PERF_NUM_ENTRIES,
+				 "totem_pl_parser_add_uri(): %.3f usec per entry (%d entries)",
+				 best_varargs * G_USEC_PER_SEC / PERF_NUM_ENTRIES,
+				 PERF_NUM_ENTRIES);
+	g_test_minimized_result (best_fields * G_USEC_PER_SEC / PERF_NUM_ENTRIES,
+				 "totem_pl_parser_add_fields(): %.3f usec per entry (%d entries)",
+				 best_fields * G_USEC_PER_SEC / PERF_NUM_ENTRIES,
+				 PERF_NUM_ENTRIES);
+
+	for (i = 0; i < PERF_NUM_ENTRIES; i++) {
+		g_free (uris[i]);
+		g_free (titles[i]);
+		g_free (durations[i]);
+	}
+	g_free (uris);
+	g_free (titles);
+	g_free (durations);
+}
+
+#define PERF_NUM_KEYS 20000
+
+static void
+test_perf_ini_keys (void)
+{
+	GString *contents;
+	double best;
+	guint count, i;
+
+	/* Generate a key-heavy desktop file, with the keys we look up
+	 * at the end, so that the cost of finding them dominates */
+	contents = g_string_new ("[Desktop Entry]\n");
+	for (i = 0; i < PERF_NUM_KEYS; i++)
+		g_string_append_printf (contents, "X-Key-%05u=Value %u\n", i, i);
+	g_string_append (contents,
+			 "Type=Link\n"
+			 "Name=Track\n"
+			 "URL=http://www.example.com/music/track.ogg\n");
+
+	count = 1;
+	best = perf_parse_best ("keys.desktop", contents, &count);
+	g_string_free (contents, TRUE);
+
+	g_test_minimized_result (best * G_USEC_PER_SEC / PERF_NUM_KEYS,
+				 "%.3f usec per key (%d keys)",
+				 best * G_USEC_PER_SEC / PERF_NUM_KEYS,
+				 PERF_NUM_KEYS);
+}
+
+#define PERF_FEED_SIZE (8 * 1024 * 1024)
+
+static void
+perf_parse_scaled_feed (const char *name,
+			const char *item_start,
+			const char *item_end)
+{
+	GString *contents;
+	GError *error = NULL;
+	char *orig, *items, *items_end, *filename;
+	gsize len;
+
+	/* Repeat the items of the feed until the text runs in them
+	 * dominate the time spent parsing it */
+	filename = g_build_filename (TEST_SRCDIR, name, NULL);
+	g_file_get_contents (filename, &orig, &len, &error);
+	g_assert_no_error (error);
+	g_free (filename);
+
+	items = strstr (orig, item_start);
+	items_end = g_strrstr (orig, item_end);
+	g_assert_nonnull (items);
+	g_assert_nonnull (items_end);
+	items_end += strlen (item_end);
+
+	contents = g_string_new_len (orig, items - orig);
+	while (contents->len < PERF_FEED_SIZE)
+		g_string_append_len (contents, items, items_end - items);
+	g_string_append (contents, items_end);
+	g_free (orig);
+
+	perf_parse_generated (name, contents, 0, TRUE);
+	g_string_free (contents, TRUE);
+}
+
+static void
+test_perf_xml_feeds (void)
+{
+	perf_parse_scaled_feed ("585407.rss", "<item>", "</item>");
+	perf_parse_scaled_feed ("gitlab-issues.atom", "<entry>", "</entry>");
+}
+
+static void
+test_perf_xml_comments (void)
+{
+	GString *contents;
+	guint i;
+
+	/* Comment openers in CDATA, with the only comment closer at the
+	 * very end, used to be rescanned to the end for each of them */
+	contents = g_string_new ("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+				 "<rss version=\"2.0\"><channel><title>Comments</title>\n");
+	for (i = 0; i < PERF_NUM_ENTRIES; i++) {
+		g_string_append_printf (contents,
+					"<item><title>Item %u</title>"
+					"<description><![CDATA[<!-- not a comment ]]></description>"
+					"<enclosure url=\"http://www.example.com/podcast/%05u.mp3\" type=\"audio/mpeg\"/>"
+					"</item>\n", i, i);
+	}
+	g_string_append (contents, "</channel></rss>\n<!-- end -->\n");
+	perf_parse_generated ("comments.rss", contents, PERF_NUM_ENTRIES, FALSE);
+	g_string_free (contents, TRUE);
+
+	/* One comment per track, each used to be looked for from the
+	 * start of the file */
+	contents = g_string_new ("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+				 "<playlist version=\"1\" xmlns=\"http://xspf.org/ns/0/\"><trackList>\n");
+	for (i = 0; i < PERF_NUM_ENTRIES; i++) {
+		g_string_append_printf (contents,
+					"<!-- track %u -->"
+					"<track><location>http://www.example.com/music/track-%05u.ogg</location></track>\n",
+					i, i);
+	}
+	g_string_append (contents, "</trackList></playlist>\n");
+	perf_parse_generated ("comments.xspf", contents, PERF_NUM_ENTRIES, FALSE);
+	g_string_free (contents, TRUE);
+}
+
+static void
+test_perf_smil_attributes (void)
+{
+	GString *contents;
+	guint i;
+
+	/* Each clip has all the properties the SMIL parser looks up */
+	contents = g_string_new ("<smil><head><meta name=\"title\" content=\"Clips\"/></head><body><seq>\n");
+	for (i = 0; i < PERF_NUM_ENTRIES; i++) {
+		g_string_append_printf (contents,
+					"<video id=\"clip%u\" region=\"main\" src=\"http://www.example.com/clips/%05u.ogv\" "
+					"title=\"Clip %u\" author=\"Author\" copyright=\"Copyright\" abstract=\"Abstract\" "
+					"clip-begin=\"00:00:10\" dur=\"00:01:00\"/>\n", i, i, i);
+	}
+	g_string_append (contents, "</seq></body></smil>\n");
+	perf_parse_generated ("clips.smil", contents, PERF_NUM_ENTRIES, FALSE);
+	g_string_free (contents, TRUE);
+}
+
+static void
+test_playlist_iters (void)
+{
+	TotemPlPlaylist *playlist, *other;
+	TotemPlPlaylistIter iter, first, other_iter;
+	const char *expected[] = { "1", "2", "3", "4" };
+	char *value;
+	guint i;
+
+	playlist = totem_pl_playlist_new ();
+	g_assert_false (totem_pl_playlist_iter_first (playlist, &iter));
+
+	totem_pl_playlist_append (playlist, &iter);
+	totem_pl_playlist_set (playlist, &iter, TOTEM_PL_PARSER_FIELD_TITLE, "3", NULL);
+	totem_pl_playlist_prepend (playlist, &first);
+	totem_pl_playlist_set (playlist, &first, TOTEM_PL_PARSER_FIELD_TITLE, "1", NULL);
+	totem_pl_playlist_insert (playlist, 1, &iter);
+	totem_pl_playlist_set (playlist, &iter, TOTEM_PL_PARSER_FIELD_TITLE, "2", NULL);
+	totem_pl_playlist_insert (playlist, -1, &iter);
+	totem_pl_playlist_set (playlist, &iter, TOTEM_PL_PARSER_FIELD_TITLE, "4", NULL);
+	g_assert_cmpuint (totem_pl_playlist_size (playlist), ==, 4);
+
+	/* Iters stay valid when other items are added */
+	totem_pl_playlist_get (playlist, &first, TOTEM_PL_PARSER_FIELD_TITLE, &value, NULL);
+	g_assert_cmpstr (value, ==, "1");
+	g_free (value);
+
+	/* Fields that the parser doesn't know about are kept too */
+	totem_pl_playlist_set (playlist, &first, "x-custom-field", "custom", NULL);
+	totem_pl_playlist_get (playlist, &first, "x-custom-field", &value, NULL);
+	g_assert_cmpstr (value, ==, "custom");
+	g_free (value);
+
+	g_assert_true (totem_pl_playlist_iter_first (playlist, &iter));
+	for (i = 0; i < G_N_ELEMENTS (expected); i++) {
+		totem_pl_playlist_get (playlist, &iter, TOTEM_PL_PARSER_FIELD_TITLE, &value, NULL);
+		g_assert_cmpstr (value, ==, expected[i]);
+		g_free (value);
+		g_assert_true (totem_pl_playlist_iter_next (playlist, &iter) == (i < G_N_ELEMENTS (expected) - 1));
+	}
+	g_assert_false (totem_pl_playlist_iter_prev (playlist, &first));
+
+	/* An iter from another playlist isn't valid */
+	other = totem_pl_playlist_new ();
+	totem_pl_playlist_append (other, &other_iter);
+	other_iter.data1 = playlist;
+	g_test_expect_message (G_LOG_DOMAIN, G_LOG_LEVEL_CRITICAL, "*check_iter*");
+	g_assert_false (totem_pl_playlist_iter_next (playlist, &other_iter));
+	g_test_assert_expected_messages ();
+
+	g_object_unref (other);
+	g_object_unref (playlist);
+}
+
 /*
 static void
 test_parsing_404_error (void)
@@ -1137,6 +2092,23 @@ main (int argc, char *argv[])
 		g_test_add_func ("/parser/parsing/not_really_php", test_parsing_not_really_php);
 		g_test_add_func ("/parser/parsing/not_really_php_but_html_instead", test_parsing_not_really_php_but_html_instead);
 		g_test_add_func ("/parser/parsing/num_items_in_pls", test_parsing_num_entries);
+		g_test_add_func ("/parser/parsing/pls_index_order", test_parsing_pls_index_order);
+		g_test_add_func ("/parser/parsing/desktop_localised", test_parsing_desktop_localised);
+		g_test_add_func ("/parser/parsing/large_m3u", test_parsing_large_m3u);
+		g_test_add_func ("/parser/parsing/batched_entries", test_parsing_batched_entries);
+		g_test_add_func ("/parser/parsing/batch_timeout", test_parsing_batch_timeout);
+		g_test_add_func ("/parser/parsing/batch_reentrant", test_parsing_batch_reentrant);
+		g_test_add_func ("/parser/parsing/to_playlist", test_parsing_to_playlist);
+		g_test_add_func ("/parser/parsing/to_playlist_concurrent", test_parsing_to_playlist_concurrent);
+		g_test_add_func ("/parser/parsing/cache", test_parsing_cache);
+		g_test_add_func ("/parser/playlist/iters", test_playlist_iters);
+		if (g_test_perf ()) {
+			g_test_add_func ("/parser/perf/add_entries", test_perf_add_entries);
+			g_test_add_func ("/parser/perf/ini_keys", test_perf_ini_keys);
+			g_test_add_func ("/parser/perf/xml_feeds", test_perf_xml_feeds);
+			g_test_add_func ("/parser/perf/xml_comments", test_perf_xml_comments);
+			g_test_add_func ("/parser/perf/smil_attributes", test_perf_smil_attributes);
+		}
 		g_test_add_func ("/parser/parsing/xspf_genre", test_parsing_xspf_genre);
 		g_test_add_func ("/parser/parsing/xspf_escaping", test_parsing_xspf_escaping);
 		g_test_add_func ("/parser/parsing/xspf_metadata", test_parsing_xspf_metadata);
@@ -1145,7 +2117,11 @@ main (int argc, char *argv[])
 		g_test_add_func ("/parser/parsing/lastfm-attributes", test_lastfm_parsing);
 		g_test_add_func ("/parser/parsing/m3u_separator", test_m3u_separator);
 		g_test_add_func ("/parser/parsing/smi_starttime", test_smi_starttime);
+		g_test_add_func ("/parser/parsing/smil_deep_nesting", test_smil_deep_nesting);
+		g_test_add_func ("/parser/parsing/utf16_utf32", test_parsing_utf16_utf32);
 		g_test_add_func ("/parser/parsing/m3u_leading_tabs", test_m3u_leading_tabs);
+		g_test_add_func ("/parser/parsing/m3u_line_endings", test_m3u_line_endings);
+		g_test_add_func ("/parser/parsing/m3u_long_line", test_m3u_long_line);
 		g_test_add_func ("/parser/parsing/empty-asx.asx", test_empty_asx);
 		g_test_add_func ("/parser/parsing/emptyplaylist.pls", test_empty_pls);
 		g_test_add_func ("/parser/parsing/dir_recurse", test_directory_recurse);
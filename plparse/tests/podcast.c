@@ -512,6 +512,153 @@ test_parsing_xml_comment_whitespace (void)
 	g_free (uri);
 }
 
+static void
+test_parsing_xml_ascii_legacy_encoding (void)
+{
+	g_autofree char *uri = NULL;
+
+	/* Declared as ISO-8859-1, but only contains ASCII, so it is parsed
+	 * without converting it first */
+	uri = get_relative_uri (TEST_SRCDIR "podcast-ascii-latin1.rss");
+	g_assert_cmpint (simple_parser_test (uri), ==, TOTEM_PL_PARSER_RESULT_SUCCESS);
+	g_assert_cmpuint (parser_test_get_num_entries (uri), ==, 2);
+	g_assert_cmpstr (parser_test_get_playlist_field (uri, TOTEM_PL_PARSER_FIELD_TITLE), ==, "Caf\xc3\xa9 Radio");
+}
+
+static void
+test_parsing_xml_html_entities (void)
+{
+	g_autofree char *uri = NULL;
+
+	/* HTML named references are decoded, invalid ones are kept as is */
+	uri = get_relative_uri (TEST_SRCDIR "html-entities.rss");
+	g_assert_cmpstr (parser_test_get_playlist_field (uri, TOTEM_PL_PARSER_FIELD_TITLE), ==, "Caf\xc3\xa9\xc2\xa0Radio & Friends");
+	g_assert_cmpstr (parser_test_get_entry_field (uri, TOTEM_PL_PARSER_FIELD_TITLE), ==,
+			 "\xe2\x80\x9c" "Episode\xc2\xa0" "1\xe2\x80\x9d\xe2\x80\xa6 \xe2\x99\xab &bogus; &#xD800;");
+	g_assert_cmpstr (parser_test_get_entry_field (uri, TOTEM_PL_PARSER_FIELD_URI), ==, "http://www.example.com/podcast/episode-1.mp3?a=1&b=2");
+}
+
+static void
+feed_limits_entry_parsed_cb (TotemPlParser *parser,
+			     const char    *uri,
+			     GHashTable    *metadata,
+			     guint         *count)
+{
+	(*count)++;
+}
+
+static void
+feed_limits_playlist_ended_cb (TotemPlParser *parser,
+			       const char    *uri,
+			       guint         *count)
+{
+	(*count)++;
+}
+
+static guint
+parse_feed_with_limits (const char *uri,
+			guint       max_entries,
+			guint64     since)
+{
+	TotemPlParser *pl;
+	guint count = 0, ended = 0;
+
+	pl = totem_pl_parser_new ();
+	g_object_set (pl, "recurse", FALSE,
+			  "debug", option_debug,
+			  "max-entries", max_entries,
+			  "since", since,
+			  NULL);
+	g_signal_connect (G_OBJECT (pl), "entry-parsed",
+			  G_CALLBACK (feed_limits_entry_parsed_cb), &count);
+	g_signal_connect (G_OBJECT (pl), "playlist-ended",
+			  G_CALLBACK (feed_limits_playlist_ended_cb), &ended);
+	g_assert_cmpint (totem_pl_parser_parse (pl, uri, FALSE), ==, TOTEM_PL_PARSER_RESULT_SUCCESS);
+	g_object_unref (pl);
+
+	/* The feed still gets ended when parsing stops early */
+	g_assert_cmpuint (ended, ==, 1);
+
+	return count;
+}
+
+static void
+test_parsing_feed_limits (void)
+{
+	g_autofree char *uri = NULL;
+
+	uri = get_relative_uri (TEST_SRCDIR "585407.rss");
+	g_assert_cmpuint (parse_feed_with_limits (uri, 0, 0), ==, 29);
+	g_assert_cmpuint (parse_feed_with_limits (uri, 5, 0), ==, 5);
+	/* Fri, 30 Oct 2009 16:46:07 PDT, the date of the third item */
+	g_assert_cmpuint (parse_feed_with_limits (uri, 0, 1256946367), ==, 3);
+	g_assert_cmpuint (parse_feed_with_limits (uri, 2, 1256946367), ==, 2);
+}
+
+static void
+feed_metadata_playlist_started_cb (TotemPlParser  *parser,
+				   const char     *uri,
+				   GHashTable     *metadata,
+				   char          **title)
+{
+	*title = g_strdup (g_hash_table_lookup (metadata, TOTEM_PL_PARSER_FIELD_TITLE));
+}
+
+static char *
+parse_feed_metadata_only (const char *uri,
+			  guint      *count,
+			  guint      *ended)
+{
+	TotemPlParser *pl;
+	char *title = NULL;
+
+	*count = *ended = 0;
+	pl = totem_pl_parser_new ();
+	g_object_set (pl, "recurse", FALSE,
+			  "debug", option_debug,
+			  "metadata-only", TRUE,
+			  NULL);
+	g_signal_connect (G_OBJECT (pl), "playlist-started",
+			  G_CALLBACK (feed_metadata_playlist_started_cb), &title);
+	g_signal_connect (G_OBJECT (pl), "entry-parsed",
+			  G_CALLBACK (feed_limits_entry_parsed_cb), count);
+	g_signal_connect (G_OBJECT (pl), "playlist-ended",
+			  G_CALLBACK (feed_limits_playlist_ended_cb), ended);
+	g_assert_cmpint (totem_pl_parser_parse (pl, uri, FALSE), ==, TOTEM_PL_PARSER_RESULT_SUCCESS);
+	g_object_unref (pl);
+
+	return title;
+}
+
+static void
+test_parsing_feed_metadata_only (void)
+{
+	char *uri, *title;
+	guint count, ended;
+
+	uri = get_relative_uri (TEST_SRCDIR "585407.rss");
+	title = parse_feed_metadata_only (uri, &count, &ended);
+	g_assert_cmpstr (title, ==, "David Allen Company Podcast");
+	g_assert_cmpuint (count, ==, 0);
+	g_assert_cmpuint (ended, ==, 1);
+	g_free (title);
+	g_free (uri);
+
+	uri = get_relative_uri (TEST_SRCDIR "gitlab-issues.atom");
+	title = parse_feed_metadata_only (uri, &count, &ended);
+	g_assert_cmpstr (title, ==, "totem-pl-parser issues");
+	g_assert_cmpuint (count, ==, 0);
+	g_assert_cmpuint (ended, ==, 1);
+	g_free (title);
+	g_free (uri);
+
+	/* OPML feeds have no metadata but their URI */
+	uri = get_relative_uri (TEST_SRCDIR "feeds.opml");
+	g_free (parse_feed_metadata_only (uri, &count, &ended));
+	g_assert_cmpuint (count, ==, 0);
+	g_free (uri);
+}
+
 static void
 test_parsing_xml_mixed_cdata (void)
 {
@@ -590,6 +737,36 @@ test_parsing_rss_link (void)
 	g_free (uri);
 }
 
+static void
+test_parsing_broken_feed (void)
+{
+	g_autofree char *uri = NULL;
+
+	/* Items are sent as they are parsed, so the ones before
+	 * the broken one still make it */
+	uri = get_relative_uri (TEST_SRCDIR "broken-feed.rss");
+	g_assert_cmpint (simple_parser_test (uri), ==, TOTEM_PL_PARSER_RESULT_SUCCESS);
+	g_assert_cmpuint (parser_test_get_num_entries (uri), ==, 2);
+	g_assert_cmpstr (parser_test_get_playlist_field (uri, TOTEM_PL_PARSER_FIELD_TITLE), ==, "Broken feed");
+}
+
+static void
+test_parsing_xml_empty_close_tag (void)
+{
+	g_autofree char *rss_uri = NULL;
+	g_autofree char *asx_uri = NULL;
+
+	/* A close tag with an empty name, cut short by a NUL, used to
+	 * close the document level as well, and underflow the stack of
+	 * open elements, both when streaming and building a tree */
+	rss_uri = get_relative_uri (TEST_SRCDIR "empty-close-tag.rss");
+	g_assert_cmpuint (parser_test_get_num_entries (rss_uri), ==, 1);
+	g_assert_cmpstr (parser_test_get_entry_field (rss_uri, TOTEM_PL_PARSER_FIELD_URI), ==, "http://www.example.com/podcast/empty-close-tag.mp3");
+
+	asx_uri = get_relative_uri (TEST_SRCDIR "empty-close-tag.wax");
+	g_assert_cmpstr (parser_test_get_entry_field (asx_uri, TOTEM_PL_PARSER_FIELD_TITLE), ==, "Empty close tag");
+}
+
 static void
 test_xml_trailing_space (void)
 {
@@ -617,6 +794,10 @@ main (int argc, char *argv[])
 	g_test_add_func ("/parser/compressed_content_encoding", test_compressed_content_encoding);
 	g_test_add_func ("/parser/parsing/xml_head_comments", test_parsing_xml_head_comments);
 	g_test_add_func ("/parser/parsing/xml_comment_whitespace", test_parsing_xml_comment_whitespace);
+	g_test_add_func ("/parser/parsing/xml_ascii_legacy_encoding", test_parsing_xml_ascii_legacy_encoding);
+	g_test_add_func ("/parser/parsing/xml_html_entities", test_parsing_xml_html_entities);
+	g_test_add_func ("/parser/parsing/podcast_feed_limits", test_parsing_feed_limits);
+	g_test_add_func ("/parser/parsing/podcast_feed_metadata_only", test_parsing_feed_metadata_only);
 	g_test_add_func ("/parser/parsing/podcast_needle_carriage_return", test_parsing_needle_carriage_return);
 	g_test_add_func ("/parser/parsing/podcast_feed_content_type", test_parsing_feed_content_type);
 	g_test_add_func ("/parser/parsing/podcast_item_content_type", test_parsing_item_content_type);
@@ -637,7 +818,9 @@ main (int argc, char *argv[])
 	g_test_add_func ("/parser/parsing/rss_id", test_parsing_rss_id);
 	g_test_add_func ("/parser/parsing/rss_link", test_parsing_rss_link);
 	g_test_add_func ("/parser/parsing/itms_link", test_itms_parsing);
+	g_test_add_func ("/parser/parsing/broken_feed", test_parsing_broken_feed);
 	g_test_add_func ("/parser/parsing/xml_trailing_space", test_xml_trailing_space);
+	g_test_add_func ("/parser/parsing/xml_empty_close_tag", test_parsing_xml_empty_close_tag);
 
 	/* set an envvar, keep at the end */
 	g_test_add_func ("/parser/parsing/video_links_slow_parsing", test_video_links_slow_parsing);
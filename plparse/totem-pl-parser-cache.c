@@ -0,0 +1,269 @@
+/*
+   Copyright (C) 2026 Bastien Nocera
+
+   The Gnome Library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   The Gnome Library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with the Gnome Library; see the file COPYING.LIB.  If not,
+   write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301  USA.
+
+   Author: Bastien Nocera <hadess@hadess.net>
+ */
+
+#include "config.h"
+
+#include <string.h>
+#include <glib.h>
+
+#include "totem-pl-parser.h"
+#include "totem-pl-parser-private.h"
+#include "totem-pl-parser-cache.h"
+
+/* The cache keeps, for each playlist URI, the entries that were sent
+ * when it was last parsed, serialized one after the other, so that they
+ * can be sent again without reading the playlist when it didn't change.
+ *
+ * Each event is a byte telling its type, followed by the entry as written
+ * by totem_pl_parser_entry_serialize(), or for the end of a playlist,
+ * by its nul-terminated URI, empty if it had none. */
+#define EVENT_ENTRY_PARSED	'e'
+#define EVENT_PLAYLIST_STARTED	'p'
+#define EVENT_PLAYLIST_ENDED	'x'
+
+typedef struct {
+	char *options;
+	guint64 mtime;
+	goffset size;
+	char *checksum;
+	GBytes *events;
+} TotemPlParserCacheItem;
+
+struct _TotemPlParserCache {
+	GMutex mutex;
+	GHashTable *items; /* key = URI, value = TotemPlParserCacheItem */
+};
+
+/* The entries are recorded from totem_pl_parser_add_entry(), which
+ * doesn't know about the parse operation it's called for, but each
+ * operation runs in a single thread. */
+struct _TotemPlParserCacheRecorder {
+	TotemPlParser *parser;
+	GByteArray *events;
+	gboolean nested; /* whether other playlists were parsed as well */
+	TotemPlParserCacheRecorder *parent;
+};
+
+static GPrivate current_recorder = G_PRIVATE_INIT (NULL);
+
+static void
+totem_pl_parser_cache_item_free (TotemPlParserCacheItem *item)
+{
+	g_free (item->options);
+	g_free (item->checksum);
+	g_bytes_unref (item->events);
+	g_free (item);
+}
+
+TotemPlParserCache *
+totem_pl_parser_cache_new (void)
+{
+	TotemPlParserCache *cache;
+
+	cache = g_new0 (TotemPlParserCache, 1);
+	g_mutex_init (&cache->mutex);
+	cache->items = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+					      (GDestroyNotify) totem_pl_parser_cache_item_free);
+
+	return cache;
+}
+
+void
+totem_pl_parser_cache_free (TotemPlParserCache *cache)
+{
+	g_hash_table_destroy (cache->items);
+	g_mutex_clear (&cache->mutex);
+	g_free (cache);
+}
+
+void
+totem_pl_parser_cache_clear (TotemPlParserCache *cache)
+{
+	g_mutex_lock (&cache->mutex);
+	g_hash_table_remove_all (cache->items);
+	g_mutex_unlock (&cache->mutex);
+}
+
+/* Looks for the entries of the playlist in @key, matching its options,
+ * modification time and size. The entries found are sent again, as they
+ * were first sent, and %TRUE is returned. */
+gboolean
+totem_pl_parser_cache_replay (TotemPlParserCache *cache,
+			      TotemPlParser *parser,
+			      const TotemPlParserCacheKey *key)
+{
+	TotemPlParserCacheItem *item;
+	GBytes *events = NULL;
+	const char *p, *end;
+	gsize len;
+
+	g_mutex_lock (&cache->mutex);
+	item = g_hash_table_lookup (cache->items, key->uri);
+	if (item != NULL &&
+	    g_str_equal (item->options, key->options) &&
+	    key->mtime != 0 &&
+	    item->mtime == key->mtime &&
+	    item->size == key->size)
+		events = g_bytes_ref (item->events);
+	g_mutex_unlock (&cache->mutex);
+
+	if (events == NULL)
+		return FALSE;
+
+	p = g_bytes_get_data (events, &len);
+	end = p + len;
+	while (p < end) {
+		TotemPlParserEntry *entry;
+		char event = *p++;
+
+		if (event == EVENT_PLAYLIST_ENDED) {
+			totem_pl_parser_playlist_end (parser, *p != '\0' ? p : NULL);
+			p += strlen (p) + 1;
+			continue;
+		}
+
+		entry = totem_pl_parser_entry_deserialize (&p);
+		totem_pl_parser_add_entry (parser, entry, event == EVENT_PLAYLIST_STARTED);
+		totem_pl_parser_entry_unref (entry);
+	}
+
+	g_bytes_unref (events);
+
+	return TRUE;
+}
+
+/* Starts recording the entries sent by @parser in this thread */
+TotemPlParserCacheRecorder *
+totem_pl_parser_cache_record_start (TotemPlParser *parser)
+{
+	TotemPlParserCacheRecorder *recorder;
+
+	recorder = g_new0 (TotemPlParserCacheRecorder, 1);
+	recorder->parser = parser;
+	recorder->events = g_byte_array_new ();
+	recorder->parent = g_private_get (&current_recorder);
+	g_private_set (&current_recorder, recorder);
+
+	return recorder;
+}
+
+/* Stops recording, and caches the entries under @key, unless @key
+ * is %NULL, or other playlists were parsed for them. If the contents
+ * didn't change, only the modification time and size are updated. */
+void
+totem_pl_parser_cache_record_end (TotemPlParserCache *cache,
+				  TotemPlParserCacheRecorder *recorder,
+				  const TotemPlParserCacheKey *key)
+{
+	TotemPlParserCacheItem *item;
+
+	g_private_set (&current_recorder, recorder->parent);
+
+	if (key == NULL || recorder->nested != FALSE) {
+		g_byte_array_unref (recorder->events);
+		g_free (recorder);
+		return;
+	}
+
+	g_mutex_lock (&cache->mutex);
+	item = g_hash_table_lookup (cache->items, key->uri);
+	if (item != NULL &&
+	    g_str_equal (item->options, key->options) &&
+	    g_str_equal (item->checksum, key->checksum)) {
+		/* Touched but not changed, the times will match next time */
+		item->mtime = key->mtime;
+		item->size = key->size;
+		g_mutex_unlock (&cache->mutex);
+		g_byte_array_unref (recorder->events);
+		g_free (recorder);
+		return;
+	}
+	g_mutex_unlock (&cache->mutex);
+
+	item = g_new0 (TotemPlParserCacheItem, 1);
+	item->options = g_strdup (key->options);
+	item->mtime = key->mtime;
+	item->size = key->size;
+	item->checksum = g_strdup (key->checksum);
+	item->events = g_byte_array_free_to_bytes (recorder->events);
+	g_free (recorder);
+
+	g_mutex_lock (&cache->mutex);
+	g_hash_table_replace (cache->items, g_strdup (key->uri), item);
+	g_mutex_unlock (&cache->mutex);
+}
+
+static TotemPlParserCacheRecorder *
+totem_pl_parser_cache_get_recorder (TotemPlParser *parser)
+{
+	TotemPlParserCacheRecorder *recorder;
+
+	recorder = g_private_get (&current_recorder);
+	if (recorder == NULL || recorder->parser != parser)
+		return NULL;
+	return recorder;
+}
+
+void
+totem_pl_parser_cache_record_entry (TotemPlParser *parser,
+				    TotemPlParserEntry *entry,
+				    gboolean is_playlist)
+{
+	TotemPlParserCacheRecorder *recorder;
+	guint8 event;
+
+	recorder = totem_pl_parser_cache_get_recorder (parser);
+	if (recorder == NULL)
+		return;
+
+	event = is_playlist ? EVENT_PLAYLIST_STARTED : EVENT_ENTRY_PARSED;
+	g_byte_array_append (recorder->events, &event, 1);
+	totem_pl_parser_entry_serialize (entry, recorder->events);
+}
+
+void
+totem_pl_parser_cache_record_playlist_end (TotemPlParser *parser,
+					   const char *playlist_uri)
+{
+	TotemPlParserCacheRecorder *recorder;
+	guint8 event = EVENT_PLAYLIST_ENDED;
+
+	recorder = totem_pl_parser_cache_get_recorder (parser);
+	if (recorder == NULL)
+		return;
+
+	if (playlist_uri == NULL)
+		playlist_uri = "";
+	g_byte_array_append (recorder->events, &event, 1);
+	g_byte_array_append (recorder->events, (guint8 *) playlist_uri, strlen (playlist_uri) + 1);
+}
+
+/* The entries being recorded also depend on another playlist, which
+ * could change without the recorded one changing, so can't be cached */
+void
+totem_pl_parser_cache_record_nested (TotemPlParser *parser)
+{
+	TotemPlParserCacheRecorder *recorder;
+
+	recorder = totem_pl_parser_cache_get_recorder (parser);
+	if (recorder != NULL)
+		recorder->nested = TRUE;
+}
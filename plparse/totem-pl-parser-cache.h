@@ -0,0 +1,65 @@
+/*
+   Copyright (C) 2026 Bastien Nocera
+
+   The Gnome Library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   The Gnome Library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with the Gnome Library; see the file COPYING.LIB.  If not,
+   write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301  USA.
+
+   Author: Bastien Nocera <hadess@hadess.net>
+ */
+
+#ifndef TOTEM_PL_PARSER_CACHE_H
+#define TOTEM_PL_PARSER_CACHE_H
+
+#include <glib.h>
+
+#include "totem-pl-parser.h"
+#include "totem-pl-parser-entry.h"
+
+G_BEGIN_DECLS
+
+typedef struct _TotemPlParserCache TotemPlParserCache;
+typedef struct _TotemPlParserCacheRecorder TotemPlParserCacheRecorder;
+
+/* What the entries of a playlist are cached under */
+typedef struct {
+	const char *uri;
+	const char *options;	/* the options the playlist was parsed with */
+	guint64 mtime;		/* in microseconds, 0 if unknown */
+	goffset size;		/* -1 if unknown */
+	const char *checksum;	/* of the contents, only needed to record them */
+} TotemPlParserCacheKey;
+
+TotemPlParserCache * totem_pl_parser_cache_new		(void);
+void totem_pl_parser_cache_free				(TotemPlParserCache *cache);
+void totem_pl_parser_cache_clear			(TotemPlParserCache *cache);
+
+gboolean totem_pl_parser_cache_replay			(TotemPlParserCache *cache,
+							 TotemPlParser *parser,
+							 const TotemPlParserCacheKey *key);
+
+TotemPlParserCacheRecorder * totem_pl_parser_cache_record_start (TotemPlParser *parser);
+void totem_pl_parser_cache_record_end			(TotemPlParserCache *cache,
+							 TotemPlParserCacheRecorder *recorder,
+							 const TotemPlParserCacheKey *key);
+void totem_pl_parser_cache_record_entry			(TotemPlParser *parser,
+							 TotemPlParserEntry *entry,
+							 gboolean is_playlist);
+void totem_pl_parser_cache_record_playlist_end		(TotemPlParser *parser,
+							 const char *playlist_uri);
+void totem_pl_parser_cache_record_nested		(TotemPlParser *parser);
+
+G_END_DECLS
+
+#endif /* TOTEM_PL_PARSER_CACHE_H */
@@ -0,0 +1,329 @@
+/*
+   Copyright (C) 2026 Bastien Nocera
+
+   The Gnome Library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   The Gnome Library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with the Gnome Library; see the file COPYING.LIB.  If not,
+   write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301  USA.
+
+   Author: Bastien Nocera <hadess@hadess.net>
+ */
+
+#include "config.h"
+
+#include <string.h>
+#include <glib.h>
+
+#include "totem-pl-parser.h"
+#include "totem-pl-parser-entry.h"
+
+/* An entry keeps the values of the known fields in fixed slots, indexed
+ * by their TotemPlFieldId, so that adding an entry doesn't need to
+ * allocate a hash table and a copy of each key. Fields with names we
+ * don't know about go to the "extra" hash table.
+ *
+ * The metadata hash table passed to the signal handlers is only built
+ * when it's asked for, and is then kept along with the entry. */
+struct _TotemPlParserEntry {
+	gint ref_count;
+	char *fields[TOTEM_PL_NUM_FIELD_IDS];
+	GHashTable *extra;
+	GHashTable *metadata;
+};
+
+static const char *field_names[TOTEM_PL_NUM_FIELD_IDS] = {
+	TOTEM_PL_PARSER_FIELD_URI,
+	TOTEM_PL_PARSER_FIELD_GENRE,
+	TOTEM_PL_PARSER_FIELD_GENRES,
+	TOTEM_PL_PARSER_FIELD_TITLE,
+	TOTEM_PL_PARSER_FIELD_AUTHOR,
+	TOTEM_PL_PARSER_FIELD_ALBUM,
+	TOTEM_PL_PARSER_FIELD_BASE,
+	TOTEM_PL_PARSER_FIELD_SUBTITLE_URI,
+	TOTEM_PL_PARSER_FIELD_VOLUME,
+	TOTEM_PL_PARSER_FIELD_AUTOPLAY,
+	TOTEM_PL_PARSER_FIELD_DURATION,
+	TOTEM_PL_PARSER_FIELD_DURATION_MS,
+	TOTEM_PL_PARSER_FIELD_STARTTIME,
+	TOTEM_PL_PARSER_FIELD_ENDTIME,
+	TOTEM_PL_PARSER_FIELD_COPYRIGHT,
+	TOTEM_PL_PARSER_FIELD_ABSTRACT,
+	TOTEM_PL_PARSER_FIELD_DESCRIPTION,
+	TOTEM_PL_PARSER_FIELD_MOREINFO,
+	TOTEM_PL_PARSER_FIELD_SCREENSIZE,
+	TOTEM_PL_PARSER_FIELD_UI_MODE,
+	TOTEM_PL_PARSER_FIELD_PUB_DATE,
+	TOTEM_PL_PARSER_FIELD_FILESIZE,
+	TOTEM_PL_PARSER_FIELD_LANGUAGE,
+	TOTEM_PL_PARSER_FIELD_CONTACT,
+	TOTEM_PL_PARSER_FIELD_IMAGE_URI,
+	TOTEM_PL_PARSER_FIELD_DOWNLOAD_URI,
+	TOTEM_PL_PARSER_FIELD_ID,
+	TOTEM_PL_PARSER_FIELD_CONTENT_TYPE,
+	TOTEM_PL_PARSER_FIELD_PLAYING,
+	TOTEM_PL_PARSER_FIELD_AUDIO_TRACK,
+	TOTEM_PL_PARSER_FIELD_CONTENT_RATING
+};
+
+static gpointer
+create_field_ids (gpointer data)
+{
+	GHashTable *ids;
+	guint i;
+
+	ids = g_hash_table_new (g_str_hash, g_str_equal);
+	for (i = 0; i < G_N_ELEMENTS (field_names); i++)
+		g_hash_table_insert (ids, (gpointer) field_names[i], GINT_TO_POINTER (i + 1));
+
+	return ids;
+}
+
+TotemPlFieldId
+totem_pl_parser_field_id_from_name (const char *name)
+{
+	static GOnce ids_once = G_ONCE_INIT;
+	GHashTable *ids;
+
+	ids = g_once (&ids_once, create_field_ids, NULL);
+
+	return GPOINTER_TO_INT (g_hash_table_lookup (ids, name)) - 1;
+}
+
+const char *
+totem_pl_parser_field_id_to_name (TotemPlFieldId id)
+{
+	g_return_val_if_fail (id >= 0 && id < TOTEM_PL_NUM_FIELD_IDS, NULL);
+
+	return field_names[id];
+}
+
+TotemPlParserEntry *
+totem_pl_parser_entry_new (void)
+{
+	TotemPlParserEntry *entry;
+
+	entry = g_slice_new0 (TotemPlParserEntry);
+	entry->ref_count = 1;
+
+	return entry;
+}
+
+TotemPlParserEntry *
+totem_pl_parser_entry_new_from_hash_table (GHashTable *metadata,
+					   const char *uri)
+{
+	TotemPlParserEntry *entry;
+	GHashTableIter iter;
+	gpointer key, value;
+
+	entry = totem_pl_parser_entry_new ();
+
+	g_hash_table_iter_init (&iter, metadata);
+	while (g_hash_table_iter_next (&iter, &key, &value))
+		totem_pl_parser_entry_take (entry, key, g_strdup (value));
+
+	if (uri != NULL)
+		totem_pl_parser_entry_take_field (entry, TOTEM_PL_FIELD_ID_URI, g_strdup (uri));
+
+	return entry;
+}
+
+TotemPlParserEntry *
+totem_pl_parser_entry_ref (TotemPlParserEntry *entry)
+{
+	g_atomic_int_inc (&entry->ref_count);
+	return entry;
+}
+
+void
+totem_pl_parser_entry_unref (TotemPlParserEntry *entry)
+{
+	guint i;
+
+	if (g_atomic_int_dec_and_test (&entry->ref_count) == FALSE)
+		return;
+
+	for (i = 0; i < TOTEM_PL_NUM_FIELD_IDS; i++)
+		g_free (entry->fields[i]);
+	g_clear_pointer (&entry->extra, g_hash_table_destroy);
+	g_clear_pointer (&entry->metadata, g_hash_table_unref);
+	g_slice_free (TotemPlParserEntry, entry);
+}
+
+void
+totem_pl_parser_entry_take_field (TotemPlParserEntry *entry,
+				  TotemPlFieldId id,
+				  char *value)
+{
+	g_return_if_fail (id >= 0 && id < TOTEM_PL_NUM_FIELD_IDS);
+
+	g_free (entry->fields[id]);
+	entry->fields[id] = value;
+
+	/* The metadata view is out of date now */
+	g_clear_pointer (&entry->metadata, g_hash_table_unref);
+}
+
+void
+totem_pl_parser_entry_take (TotemPlParserEntry *entry,
+			    const char *name,
+			    char *value)
+{
+	TotemPlFieldId id;
+
+	id = totem_pl_parser_field_id_from_name (name);
+	if (id != TOTEM_PL_FIELD_ID_UNKNOWN) {
+		totem_pl_parser_entry_take_field (entry, id, value);
+		return;
+	}
+
+	if (entry->extra == NULL)
+		entry->extra = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+	g_hash_table_replace (entry->extra, g_strdup (name), value);
+	g_clear_pointer (&entry->metadata, g_hash_table_unref);
+}
+
+const char *
+totem_pl_parser_entry_get_field (TotemPlParserEntry *entry,
+				 TotemPlFieldId id)
+{
+	g_return_val_if_fail (id >= 0 && id < TOTEM_PL_NUM_FIELD_IDS, NULL);
+
+	return entry->fields[id];
+}
+
+const char *
+totem_pl_parser_entry_get (TotemPlParserEntry *entry,
+			   const char *name)
+{
+	TotemPlFieldId id;
+
+	id = totem_pl_parser_field_id_from_name (name);
+	if (id != TOTEM_PL_FIELD_ID_UNKNOWN)
+		return entry->fields[id];
+
+	if (entry->extra == NULL)
+		return NULL;
+	return g_hash_table_lookup (entry->extra, name);
+}
+
+/* Whether the entry has any field set, apart from its URI */
+gboolean
+totem_pl_parser_entry_has_metadata (TotemPlParserEntry *entry)
+{
+	guint i;
+
+	if (entry->extra != NULL && g_hash_table_size (entry->extra) > 0)
+		return TRUE;
+
+	for (i = TOTEM_PL_FIELD_ID_URI + 1; i < TOTEM_PL_NUM_FIELD_IDS; i++) {
+		if (entry->fields[i] != NULL)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+/* Returns the metadata of the entry, apart from its URI, as a hash table,
+ * building it on first use. Both the keys and the values are copies,
+ * freed with g_free() by the hash table. */
+GHashTable *
+totem_pl_parser_entry_get_metadata (TotemPlParserEntry *entry)
+{
+	guint i;
+
+	if (entry->metadata != NULL)
+		return entry->metadata;
+
+	entry->metadata = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
+	for (i = TOTEM_PL_FIELD_ID_URI + 1; i < TOTEM_PL_NUM_FIELD_IDS; i++) {
+		if (entry->fields[i] != NULL)
+			g_hash_table_insert (entry->metadata, g_strdup (field_names[i]), g_strdup (entry->fields[i]));
+	}
+
+	if (entry->extra != NULL) {
+		GHashTableIter iter;
+		gpointer key, value;
+
+		g_hash_table_iter_init (&iter, entry->extra);
+		while (g_hash_table_iter_next (&iter, &key, &value))
+			g_hash_table_insert (entry->metadata, g_strdup (key), g_strdup (value));
+	}
+
+	return entry->metadata;
+}
+
+/* Appends @entry to @buffer in a compact form: each field that is set as
+ * its TotemPlFieldId plus one, in a byte, followed by its nul-terminated
+ * value, then a nul byte, then the names and values of the extra fields,
+ * nul-terminated, and an empty name. */
+void
+totem_pl_parser_entry_serialize (TotemPlParserEntry *entry,
+				 GByteArray *buffer)
+{
+	guint8 id;
+
+	for (id = 0; id < TOTEM_PL_NUM_FIELD_IDS; id++) {
+		guint8 tag = id + 1;
+
+		if (entry->fields[id] == NULL)
+			continue;
+		g_byte_array_append (buffer, &tag, 1);
+		g_byte_array_append (buffer, (guint8 *) entry->fields[id], strlen (entry->fields[id]) + 1);
+	}
+	g_byte_array_append (buffer, (guint8 *) "", 1);
+
+	if (entry->extra != NULL) {
+		GHashTableIter iter;
+		gpointer key, value;
+
+		g_hash_table_iter_init (&iter, entry->extra);
+		while (g_hash_table_iter_next (&iter, &key, &value)) {
+			g_byte_array_append (buffer, key, strlen (key) + 1);
+			g_byte_array_append (buffer, value, strlen (value) + 1);
+		}
+	}
+	g_byte_array_append (buffer, (guint8 *) "", 1);
+}
+
+/* Reads back an entry written by totem_pl_parser_entry_serialize(),
+ * and moves @data past it */
+TotemPlParserEntry *
+totem_pl_parser_entry_deserialize (const char **data)
+{
+	TotemPlParserEntry *entry;
+	const char *p = *data;
+
+	entry = totem_pl_parser_entry_new ();
+
+	while (*p != '\0') {
+		guint8 id = (guint8) *p++ - 1;
+
+		entry->fields[id] = g_strdup (p);
+		p += strlen (p) + 1;
+	}
+	p++;
+
+	while (*p != '\0') {
+		const char *name = p;
+
+		p += strlen (p) + 1;
+		totem_pl_parser_entry_take (entry, name, g_strdup (p));
+		p += strlen (p) + 1;
+	}
+	p++;
+
+	*data = p;
+	return entry;
+}
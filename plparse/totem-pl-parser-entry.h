@@ -0,0 +1,104 @@
+/*
+   Copyright (C) 2026 Bastien Nocera
+
+   The Gnome Library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   The Gnome Library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with the Gnome Library; see the file COPYING.LIB.  If not,
+   write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301  USA.
+
+   Author: Bastien Nocera <hadess@hadess.net>
+ */
+
+#ifndef TOTEM_PL_PARSER_ENTRY_H
+#define TOTEM_PL_PARSER_ENTRY_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Interned identifiers for the known TOTEM_PL_PARSER_FIELD_* metadata
+ * fields, used as slot indexes in TotemPlParserEntry */
+typedef enum {
+	TOTEM_PL_FIELD_ID_UNKNOWN = -1,
+	TOTEM_PL_FIELD_ID_URI = 0,
+	TOTEM_PL_FIELD_ID_GENRE,
+	TOTEM_PL_FIELD_ID_GENRES,
+	TOTEM_PL_FIELD_ID_TITLE,
+	TOTEM_PL_FIELD_ID_AUTHOR,
+	TOTEM_PL_FIELD_ID_ALBUM,
+	TOTEM_PL_FIELD_ID_BASE,
+	TOTEM_PL_FIELD_ID_SUBTITLE_URI,
+	TOTEM_PL_FIELD_ID_VOLUME,
+	TOTEM_PL_FIELD_ID_AUTOPLAY,
+	TOTEM_PL_FIELD_ID_DURATION,
+	TOTEM_PL_FIELD_ID_DURATION_MS,
+	TOTEM_PL_FIELD_ID_STARTTIME,
+	TOTEM_PL_FIELD_ID_ENDTIME,
+	TOTEM_PL_FIELD_ID_COPYRIGHT,
+	TOTEM_PL_FIELD_ID_ABSTRACT,
+	TOTEM_PL_FIELD_ID_DESCRIPTION,
+	TOTEM_PL_FIELD_ID_MOREINFO,
+	TOTEM_PL_FIELD_ID_SCREENSIZE,
+	TOTEM_PL_FIELD_ID_UI_MODE,
+	TOTEM_PL_FIELD_ID_PUB_DATE,
+	TOTEM_PL_FIELD_ID_FILESIZE,
+	TOTEM_PL_FIELD_ID_LANGUAGE,
+	TOTEM_PL_FIELD_ID_CONTACT,
+	TOTEM_PL_FIELD_ID_IMAGE_URI,
+	TOTEM_PL_FIELD_ID_DOWNLOAD_URI,
+	TOTEM_PL_FIELD_ID_ID,
+	TOTEM_PL_FIELD_ID_CONTENT_TYPE,
+	TOTEM_PL_FIELD_ID_PLAYING,
+	TOTEM_PL_FIELD_ID_AUDIO_TRACK,
+	TOTEM_PL_FIELD_ID_CONTENT_RATING,
+	TOTEM_PL_NUM_FIELD_IDS
+} TotemPlFieldId;
+
+typedef struct _TotemPlParserEntry TotemPlParserEntry;
+
+/* A field of an entry being added, as passed to totem_pl_parser_add_fields().
+ * The value is owned by the caller, and may be %NULL. */
+typedef struct {
+	TotemPlFieldId id;
+	const char *value;
+} TotemPlParserField;
+
+TotemPlFieldId totem_pl_parser_field_id_from_name	(const char *name);
+const char * totem_pl_parser_field_id_to_name		(TotemPlFieldId id);
+
+TotemPlParserEntry * totem_pl_parser_entry_new		(void);
+TotemPlParserEntry * totem_pl_parser_entry_new_from_hash_table (GHashTable *metadata,
+							 const char *uri);
+TotemPlParserEntry * totem_pl_parser_entry_ref		(TotemPlParserEntry *entry);
+void totem_pl_parser_entry_unref			(TotemPlParserEntry *entry);
+
+void totem_pl_parser_entry_take_field			(TotemPlParserEntry *entry,
+							 TotemPlFieldId id,
+							 char *value);
+void totem_pl_parser_entry_take				(TotemPlParserEntry *entry,
+							 const char *name,
+							 char *value);
+const char * totem_pl_parser_entry_get_field		(TotemPlParserEntry *entry,
+							 TotemPlFieldId id);
+const char * totem_pl_parser_entry_get			(TotemPlParserEntry *entry,
+							 const char *name);
+gboolean totem_pl_parser_entry_has_metadata		(TotemPlParserEntry *entry);
+GHashTable * totem_pl_parser_entry_get_metadata		(TotemPlParserEntry *entry);
+
+void totem_pl_parser_entry_serialize			(TotemPlParserEntry *entry,
+							 GByteArray *buffer);
+TotemPlParserEntry * totem_pl_parser_entry_deserialize	(const char **data);
+
+G_END_DECLS
+
+#endif /* TOTEM_PL_PARSER_ENTRY_H */
@@ -237,17 +237,21 @@ totem_pl_parser_parse_ram_uri (TotemPlParser *parser, const char *uri)
 		}
 	}
 
-	totem_pl_parser_add_uri (parser,
-				 TOTEM_PL_PARSER_FIELD_URI, str->str,
-				 TOTEM_PL_PARSER_FIELD_TITLE, title,
-				 TOTEM_PL_PARSER_FIELD_AUTHOR, author,
-				 TOTEM_PL_PARSER_FIELD_COPYRIGHT, copyright,
-				 TOTEM_PL_PARSER_FIELD_ABSTRACT, abstract,
-				 TOTEM_PL_PARSER_FIELD_SCREENSIZE, screensize,
-				 TOTEM_PL_PARSER_FIELD_UI_MODE, mode,
-				 TOTEM_PL_PARSER_FIELD_STARTTIME, start,
-				 TOTEM_PL_PARSER_FIELD_ENDTIME, end,
-				 NULL);
+	{
+		TotemPlParserField fields[] = {
+			{ TOTEM_PL_FIELD_ID_URI, str->str },
+			{ TOTEM_PL_FIELD_ID_TITLE, title },
+			{ TOTEM_PL_FIELD_ID_AUTHOR, author },
+			{ TOTEM_PL_FIELD_ID_COPYRIGHT, copyright },
+			{ TOTEM_PL_FIELD_ID_ABSTRACT, abstract },
+			{ TOTEM_PL_FIELD_ID_SCREENSIZE, screensize },
+			{ TOTEM_PL_FIELD_ID_UI_MODE, mode },
+			{ TOTEM_PL_FIELD_ID_STARTTIME, start },
+			{ TOTEM_PL_FIELD_ID_ENDTIME, end }
+		};
+
+		totem_pl_parser_add_fields (parser, NULL, NULL, FALSE, fields, G_N_ELEMENTS (fields));
+	}
 
 	g_string_free (str, TRUE);
 	g_strfreev (params);
@@ -261,7 +265,7 @@ totem_pl_parser_add_ram (TotemPlParser *parser, GFile *file, TotemPlParseData *p
 	gsize size;
 	guint i;
 
-	if (g_file_load_contents (file, NULL, &contents, &size, NULL, NULL) == FALSE)
+	if (totem_pl_parser_load_contents (parse_data, file, &contents, &size) == FALSE)
 		return TOTEM_PL_PARSER_RESULT_ERROR;
 
 	lines = g_strsplit_set (contents, "\r\n", 0);
@@ -378,6 +382,37 @@ totem_pl_parser_get_extvlcopt_audio_track (const char *line)
 	return g_strdup_printf ("%d", id);
 }
 
+/* Same as totem_pl_parser_fix_string() for lines we're about to use
+ * as URIs: try ISO-8859-1 if we don't have valid UTF-8 */
+static const char *
+totem_pl_parser_fix_line (const char *line, char **fixed)
+{
+	*fixed = NULL;
+	if (g_utf8_validate (line, -1, NULL) != FALSE)
+		return line;
+	*fixed = g_convert (line, -1, "UTF-8", "ISO8859-1", NULL, NULL, NULL);
+	return *fixed ? *fixed : line;
+}
+
+/* Sends out the playlist start, and returns the playlist's URI */
+static char *
+totem_pl_parser_start_m3u (TotemPlParser *parser, GFile *file)
+{
+	char *pl_uri;
+
+	pl_uri = g_file_get_uri (file);
+	{
+		TotemPlParserField fields[] = {
+			{ TOTEM_PL_FIELD_ID_URI, pl_uri },
+			{ TOTEM_PL_FIELD_ID_CONTENT_TYPE, "audio/x-mpegurl" }
+		};
+
+		totem_pl_parser_add_fields (parser, NULL, NULL, TRUE, fields, G_N_ELEMENTS (fields));
+	}
+
+	return pl_uri;
+}
+
 TotemPlParserResult
 totem_pl_parser_add_m3u (TotemPlParser *parser,
 			 GFile *file,
@@ -386,76 +421,71 @@ totem_pl_parser_add_m3u (TotemPlParser *parser,
 			 gpointer data)
 {
 	TotemPlParserResult retval = TOTEM_PL_PARSER_RESULT_UNHANDLED;
-	char *contents, **lines;
-	gsize size;
-	guint i, num_lines;
+	TotemPlParserLineReader *reader;
+	GError *error = NULL;
+	const char *start;
+	char *raw_line;
 	gboolean dos_mode = FALSE;
+	GString *extinfo_line, *extvlcopt_line;
 	const char *extinfo, *extvlcopt_audiotrack;
 	char *pl_uri;
 
-	if (g_file_load_contents (file, NULL, &contents, &size, NULL, NULL) == FALSE) {
-		DEBUG (file, g_print ("Failed to load '%s'\n", uri));
+	/* The file is read and handled chunk by chunk, so that the
+	 * entries are sent out as soon as their line has been received */
+	reader = totem_pl_parser_line_reader_new (parse_data, file, &error);
+	if (reader == NULL) {
+		DEBUG (file, g_print ("Failed to load '%s': %s\n", uri, error->message));
+		g_error_free (error);
+		return TOTEM_PL_PARSER_RESULT_ERROR;
+	}
+
+	start = totem_pl_parser_line_reader_peek (reader, strlen ("[playlist]"), &error);
+	if (start == NULL) {
+		DEBUG (file, g_print ("Failed to load '%s': %s\n", uri, error->message));
+		g_error_free (error);
+		totem_pl_parser_line_reader_free (reader);
 		return TOTEM_PL_PARSER_RESULT_ERROR;
 	}
 
 	/* .pls files with a .m3u extension, the nasties */
-	if (g_str_has_prefix (contents, "[playlist]") != FALSE
-			|| g_str_has_prefix (contents, "[Playlist]") != FALSE
-			|| g_str_has_prefix (contents, "[PLAYLIST]") != FALSE) {
+	if (g_str_has_prefix (start, "[playlist]") != FALSE
+			|| g_str_has_prefix (start, "[Playlist]") != FALSE
+			|| g_str_has_prefix (start, "[PLAYLIST]") != FALSE) {
+		char *contents;
+
 		DEBUG (file, g_print ("Parsing '%s' playlist as PLS\n", uri));
+		start = totem_pl_parser_line_reader_peek (reader, G_MAXSIZE, NULL);
+		contents = g_strdup (start);
+		totem_pl_parser_line_reader_free (reader);
+		if (contents == NULL)
+			return TOTEM_PL_PARSER_RESULT_ERROR;
 		retval = totem_pl_parser_add_pls_with_contents (parser, file, base_file, contents, parse_data);
 		g_free (contents);
 		return retval;
 	}
 
-	if (strstr (contents, EXTINF_HLS) ||
-	    strstr (contents, EXTINF_HLS2)) {
-		DEBUG (file, g_print ("Unhandled HLS playlist '%s', should be passed to player\n", uri));
-		g_free (contents);
-		return retval;
-	}
-
-	/* Try to use ISO-8859-1 if we don't have valid UTF-8,
-	 * try to parse anyway if it's not ISO-8859-1 */
-	if (g_utf8_validate (contents, -1, NULL) == FALSE) {
-		char *fixed;
-		fixed = g_convert (contents, -1, "UTF-8", "ISO8859-1", NULL, NULL, NULL);
-		if (fixed != NULL) {
-			g_free (contents);
-			contents = fixed;
-		}
-	}
-
-	/* is non-NULL if there's an EXTINF on a preceding line */
+	/* is non-NULL if there's an EXTINF on a preceding line. The
+	 * lines are kept aside, as the reader reuses its buffer */
 	extinfo = NULL;
 	extvlcopt_audiotrack = NULL;
+	extinfo_line = g_string_new (NULL);
+	extvlcopt_line = g_string_new (NULL);
 
-	/* figure out whether we're a unix m3u or dos m3u */
-	if (strstr(contents, "\x0d")) {
-		dos_mode = TRUE;
-	}
-
-	lines = g_strsplit_set (contents, "\r\n", 0);
-	g_free (contents);
-	num_lines = g_strv_length (lines);
-	/* We don't count the terminating NULL */
-	num_lines--;
+	/* The playlist start is only sent out with the first entry, or
+	 * at the end, as HLS tags are only found in the lines before it */
+	pl_uri = NULL;
 
-	/* Send out the playlist start and get crackin' */
-	pl_uri = g_file_get_uri (file);
-	totem_pl_parser_add_uri (parser,
-				 TOTEM_PL_PARSER_FIELD_IS_PLAYLIST, TRUE,
-				 TOTEM_PL_PARSER_FIELD_URI, pl_uri,
-				 TOTEM_PL_PARSER_FIELD_CONTENT_TYPE, "audio/x-mpegurl",
-				 NULL);
-
-	for (i = 0; lines[i] != NULL; i++) {
+	/* The lines are tokenised in place, in a single pass, and only
+	 * copied when they are used as URIs. Whether we're a unix or
+	 * a dos m3u is figured out on the way */
+	while ((raw_line = totem_pl_parser_line_reader_next (reader, &dos_mode, &error)) != NULL) {
 		const char *line;
-		char *length;
+		char *length, *fixed;
 		gint64 length_num = 0;
 		char *audio_track;
+		TotemPlParserField fields[3];
 
-		line = lines[i];
+		line = raw_line;
 
 		if (line[0] == '\0')
 			continue;
@@ -468,13 +498,28 @@ totem_pl_parser_add_m3u (TotemPlParser *parser,
 
 		/* Ignore comments, but mark it if we have extra info */
 		if (line[0] == '#') {
-			if (extinfo == NULL && g_str_has_prefix (line, EXTINF) != FALSE)
-				extinfo = line;
-			if (extvlcopt_audiotrack == NULL && g_str_has_prefix (line, EXTVLCOPT_AUDIOTRACK) != FALSE)
-				extvlcopt_audiotrack = line;
+			if (pl_uri == NULL &&
+			    (g_str_has_prefix (line, EXTINF_HLS) != FALSE ||
+			     g_str_has_prefix (line, EXTINF_HLS2) != FALSE)) {
+				DEBUG (file, g_print ("Unhandled HLS playlist '%s', should be passed to player\n", uri));
+				retval = TOTEM_PL_PARSER_RESULT_UNHANDLED;
+				goto bail;
+			}
+			if (extinfo == NULL && g_str_has_prefix (line, EXTINF) != FALSE) {
+				g_string_assign (extinfo_line, line);
+				extinfo = extinfo_line->str;
+			}
+			if (extvlcopt_audiotrack == NULL && g_str_has_prefix (line, EXTVLCOPT_AUDIOTRACK) != FALSE) {
+				g_string_assign (extvlcopt_line, line);
+				extvlcopt_audiotrack = extvlcopt_line->str;
+			}
 			continue;
 		}
 
+		/* Send out the playlist start and get crackin' */
+		if (pl_uri == NULL)
+			pl_uri = totem_pl_parser_start_m3u (parser, file);
+
 		length = totem_pl_parser_get_extinfo_length (extinfo);
 		if (length != NULL)
 			length_num = totem_pl_parser_parse_duration (length, totem_pl_parser_is_debugging_enabled (parser));
@@ -482,36 +527,42 @@ totem_pl_parser_add_m3u (TotemPlParser *parser,
 
 		audio_track = totem_pl_parser_get_extvlcopt_audio_track (extvlcopt_audiotrack);
 
+		/* The URI goes first, so that the entries added from a
+		 * GFile can skip it */
+		fields[0].id = TOTEM_PL_FIELD_ID_URI;
+		fields[0].value = NULL;
+		fields[1].id = TOTEM_PL_FIELD_ID_TITLE;
+		fields[1].value = totem_pl_parser_get_extinfo_title (extinfo);
+		fields[2].id = TOTEM_PL_FIELD_ID_AUDIO_TRACK;
+		fields[2].value = audio_track;
+
 		/* Either it's a URI, or it has a proper path ... */
 		if (strstr(line, "://") != NULL
 				|| line[0] == G_DIR_SEPARATOR) {
 			GFile *uri;
 
+			line = totem_pl_parser_fix_line (line, &fixed);
 			uri = g_file_new_for_commandline_arg (line);
 			if (length_num < 0 ||
 			    totem_pl_parser_parse_internal (parser, uri, NULL, parse_data) != TOTEM_PL_PARSER_RESULT_SUCCESS) {
-				totem_pl_parser_add_uri (parser,
-							 TOTEM_PL_PARSER_FIELD_URI, line,
-							 TOTEM_PL_PARSER_FIELD_TITLE, totem_pl_parser_get_extinfo_title (extinfo),
-							 TOTEM_PL_PARSER_FIELD_AUDIO_TRACK, audio_track,
-							 NULL);
+				fields[0].value = line;
+				totem_pl_parser_add_fields (parser, NULL, NULL, FALSE, fields, G_N_ELEMENTS (fields));
 			}
 			g_object_unref (uri);
+			g_free (fixed);
 		} else if (g_ascii_isalpha (line[0]) != FALSE
 			   && g_str_has_prefix (line + 1, ":\\")) {
 			/* Path relative to a drive on Windows, we need to use
 			 * the base that was passed to us */
 			GFile *uri;
 
-			lines[i] = g_strdelimit (lines[i], "\\", '/');
+			g_strdelimit (raw_line, "\\", '/');
+			line = totem_pl_parser_fix_line (line, &fixed);
 			/* + 2, skip drive letter */
 			uri = g_file_get_child (base_file, line + 2);
-			totem_pl_parser_add_uri (parser,
-						 TOTEM_PL_PARSER_FIELD_FILE, uri,
-						 TOTEM_PL_PARSER_FIELD_TITLE, totem_pl_parser_get_extinfo_title (extinfo),
-						 TOTEM_PL_PARSER_FIELD_AUDIO_TRACK, audio_track,
-						 NULL);
+			totem_pl_parser_add_fields (parser, uri, NULL, FALSE, fields + 1, G_N_ELEMENTS (fields) - 1);
 			g_object_unref (uri);
+			g_free (fixed);
 		} else if (line[0] == '\\' && line[1] == '\\') {
 			/* ... Or it's in the windows smb form
 			 * (\\machine\share\filename), Note drive names
@@ -519,16 +570,15 @@ totem_pl_parser_add_m3u (TotemPlParser *parser,
 			 * drive letters) */
 		        char *tmpuri;
 
-			lines[i] = g_strdelimit (lines[i], "\\", '/');
+			g_strdelimit (raw_line, "\\", '/');
+			line = totem_pl_parser_fix_line (line, &fixed);
 			tmpuri = g_strjoin (NULL, "smb:", line, NULL);
 
-			totem_pl_parser_add_uri (parser,
-						 TOTEM_PL_PARSER_FIELD_URI, tmpuri,
-						 TOTEM_PL_PARSER_FIELD_TITLE, totem_pl_parser_get_extinfo_title (extinfo),
-						 TOTEM_PL_PARSER_FIELD_AUDIO_TRACK, audio_track,
-						 NULL);
+			fields[0].value = tmpuri;
+			totem_pl_parser_add_fields (parser, NULL, NULL, FALSE, fields, G_N_ELEMENTS (fields));
 
 			g_free (tmpuri);
+			g_free (fixed);
 		} else {
 			/* Try with a base */
 			GFile *uri, *_base_file;
@@ -537,15 +587,13 @@ totem_pl_parser_add_m3u (TotemPlParser *parser,
 			_base_file = g_file_get_parent (file);
 			sep = (dos_mode ? '\\' : '/');
 			if (sep == '\\')
-				lines[i] = g_strdelimit (lines[i], "\\", '/');
+				g_strdelimit (raw_line, "\\", '/');
+			line = totem_pl_parser_fix_line (line, &fixed);
 			uri = g_file_get_child (_base_file, line);
 			g_object_unref (_base_file);
-			totem_pl_parser_add_uri (parser,
-						 TOTEM_PL_PARSER_FIELD_FILE, uri,
-						 TOTEM_PL_PARSER_FIELD_TITLE, totem_pl_parser_get_extinfo_title (extinfo),
-						 TOTEM_PL_PARSER_FIELD_AUDIO_TRACK, audio_track,
-						 NULL);
+			totem_pl_parser_add_fields (parser, uri, NULL, FALSE, fields + 1, G_N_ELEMENTS (fields) - 1);
 			g_object_unref (uri);
+			g_free (fixed);
 		}
 		extinfo = NULL;
 		extvlcopt_audiotrack = NULL;
@@ -553,11 +601,26 @@ totem_pl_parser_add_m3u (TotemPlParser *parser,
 		g_free (audio_track);
 	}
 
-	g_strfreev (lines);
+	/* The entries read so far were already sent out, but the
+	 * playlist is incomplete, so don't claim success */
+	if (error != NULL) {
+		DEBUG (file, g_print ("Failed to read the rest of '%s': %s\n", uri, error->message));
+		g_error_free (error);
+		retval = TOTEM_PL_PARSER_RESULT_ERROR;
+	}
+
+	/* Playlists without entries still get started and ended */
+	if (pl_uri == NULL)
+		pl_uri = totem_pl_parser_start_m3u (parser, file);
 
 	totem_pl_parser_playlist_end (parser, pl_uri);
 	g_free (pl_uri);
 
+bail:
+	g_string_free (extinfo_line, TRUE);
+	g_string_free (extvlcopt_line, TRUE);
+	totem_pl_parser_line_reader_free (reader);
+
 	return retval;
 }
 
@@ -44,10 +44,12 @@ totem_pl_parser_add_gvp (TotemPlParser *parser,
 			 gpointer data)
 {
 	TotemPlParserResult retval = TOTEM_PL_PARSER_RESULT_UNHANDLED;
-	char *contents, **lines, *title, *url_link, *version;
+	TotemPlParserIni *ini;
+	char *contents;
+	const char *title, *url_link, *version;
 	gsize size;
 
-	if (g_file_load_contents (file, NULL, &contents, &size, NULL, NULL) == FALSE)
+	if (totem_pl_parser_load_contents (parse_data, file, &contents, &size) == FALSE)
 		return TOTEM_PL_PARSER_RESULT_ERROR;
 
 	if (g_str_has_prefix (contents, "#.download.the.free.Google.Video.Player") == FALSE && g_str_has_prefix (contents, "# download the free Google Video Player") == FALSE) {
@@ -55,33 +57,28 @@ totem_pl_parser_add_gvp (TotemPlParser *parser,
 		return retval;
 	}
 
-	lines = g_strsplit (contents, "\n", 0);
-	g_free (contents);
+	ini = totem_pl_parser_ini_new (contents, ':');
 
 	/* We only handle GVP version 1.1 for now */
-	version = totem_pl_parser_read_ini_line_string_with_sep (lines, "gvp_version", ":");
+	version = totem_pl_parser_ini_get_string (ini, "gvp_version");
 	if (version == NULL || strcmp (version, "1.1") != 0) {
-		g_free (version);
-		g_strfreev (lines);
+		totem_pl_parser_ini_free (ini);
 		return retval;
 	}
-	g_free (version);
 
-	url_link = totem_pl_parser_read_ini_line_string_with_sep (lines, "url", ":");
+	url_link = totem_pl_parser_ini_get_string (ini, "url");
 	if (url_link == NULL) {
-		g_strfreev (lines);
+		totem_pl_parser_ini_free (ini);
 		return retval;
 	}
 
 	retval = TOTEM_PL_PARSER_RESULT_SUCCESS;
 
-	title = totem_pl_parser_read_ini_line_string_with_sep (lines, "title", ":");
+	title = totem_pl_parser_ini_get_string (ini, "title");
 
 	totem_pl_parser_add_one_uri (parser, url_link, title);
 
-	g_free (url_link);
-	g_free (title);
-	g_strfreev (lines);
+	totem_pl_parser_ini_free (ini);
 
 	return retval;
 }
@@ -93,19 +90,19 @@ totem_pl_parser_add_desktop (TotemPlParser *parser,
 			     TotemPlParseData *parse_data,
 			     gpointer data)
 {
-	char *contents, **lines;
+	TotemPlParserIni *ini;
+	char *contents;
 	const char *path, *display_name, *type;
 	GFile *target;
 	gsize size;
 	TotemPlParserResult res = TOTEM_PL_PARSER_RESULT_ERROR;
 
-	if (g_file_load_contents (file, NULL, &contents, &size, NULL, NULL) == FALSE)
+	if (totem_pl_parser_load_contents (parse_data, file, &contents, &size) == FALSE)
 		return res;
 
-	lines = g_strsplit (contents, "\n", 0);
-	g_free (contents);
+	ini = totem_pl_parser_ini_new (contents, '=');
 
-	type = totem_pl_parser_read_ini_line_string (lines, "Type");
+	type = totem_pl_parser_ini_get_string (ini, "Type");
 	if (type == NULL)
 		goto bail;
 	
@@ -114,12 +111,12 @@ totem_pl_parser_add_desktop (TotemPlParser *parser,
 		goto bail;
 	}
 
-	path = totem_pl_parser_read_ini_line_string (lines, "URL");
+	path = totem_pl_parser_ini_get_string (ini, "URL");
 	if (path == NULL)
 		goto bail;
 	target = g_file_new_for_uri (path);
 
-	display_name = totem_pl_parser_read_ini_line_string (lines, "Name");
+	display_name = totem_pl_parser_ini_get_string (ini, "Name");
 
 	if (totem_pl_parser_ignore (parser, path) == FALSE
 	    && g_ascii_strcasecmp (type, "FSDevice") != 0) {
@@ -128,11 +125,12 @@ totem_pl_parser_add_desktop (TotemPlParser *parser,
 		if (totem_pl_parser_parse_internal (parser, target, NULL, parse_data) != TOTEM_PL_PARSER_RESULT_SUCCESS)
 			totem_pl_parser_add_one_file (parser, target, display_name);
 	}
+	g_object_unref (target);
 
 	res = TOTEM_PL_PARSER_RESULT_SUCCESS;
 
 bail:
-	g_strfreev (lines);
+	totem_pl_parser_ini_free (ini);
 
 	return res;
 }
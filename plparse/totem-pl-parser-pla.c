@@ -176,7 +176,7 @@ totem_pl_parser_add_pla (TotemPlParser *parser,
 	guint offset, max_entries, entry;
 	gsize size;
 
-	if (g_file_load_contents (file, NULL, &contents, &size, NULL, NULL) == FALSE)
+	if (totem_pl_parser_load_contents (parse_data, file, &contents, &size) == FALSE)
 		return TOTEM_PL_PARSER_RESULT_ERROR;
 
 	if (size < RECORD_SIZE)
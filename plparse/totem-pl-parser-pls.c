@@ -158,79 +158,242 @@ ensure_utf8_valid (char *input)
 	return utf8_valid;
 }
 
+/* The keys of an entry, as found in FileN, TitleN, LengthN and GenreN */
+typedef struct {
+	const char *file;
+	const char *title;
+	const char *length;
+	const char *genre;
+} PlsEntry;
+
+/* Entries with indexes up to this go in an array, others in a hash table */
+#define PLS_MAX_DENSE_INDEX 65535
+
+/* Checks whether the @key_len long @key is @prefix followed by an index,
+ * as printed by "%d", as those were the only keys looked up so far */
+static gboolean
+pls_parse_indexed_key (const char  *key,
+		       gsize        key_len,
+		       const char  *prefix,
+		       gsize        prefix_len,
+		       guint       *index)
+{
+	guint64 value;
+	gsize i;
+
+	if (key_len <= prefix_len ||
+	    g_ascii_strncasecmp (key, prefix, prefix_len) != 0)
+		return FALSE;
+
+	if (key[prefix_len] < '1' || key[prefix_len] > '9')
+		return FALSE;
+
+	value = 0;
+	for (i = prefix_len; i < key_len; i++) {
+		if (g_ascii_isdigit (key[i]) == FALSE)
+			return FALSE;
+		value = value * 10 + (key[i] - '0');
+		if (value > G_MAXINT)
+			return FALSE;
+	}
+
+	*index = value;
+	return TRUE;
+}
+
+static PlsEntry *
+pls_get_entry (GArray      *entries,
+	       GHashTable **sparse_entries,
+	       guint        index)
+{
+	PlsEntry *entry;
+
+	if (index <= PLS_MAX_DENSE_INDEX) {
+		if (index >= entries->len)
+			g_array_set_size (entries, index + 1);
+		return &g_array_index (entries, PlsEntry, index);
+	}
+
+	if (*sparse_entries == NULL)
+		*sparse_entries = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, g_free);
+	entry = g_hash_table_lookup (*sparse_entries, GUINT_TO_POINTER (index));
+	if (entry == NULL) {
+		entry = g_new0 (PlsEntry, 1);
+		g_hash_table_insert (*sparse_entries, GUINT_TO_POINTER (index), entry);
+	}
+	return entry;
+}
+
+static void
+pls_add_entry (TotemPlParser    *parser,
+	       GFile            *base_file,
+	       const PlsEntry   *entry,
+	       TotemPlParseData *parse_data)
+{
+	TotemPlParserField fields[4];
+	gint64 length_num;
+	gboolean fallback;
+
+	length_num = 0;
+
+	fallback = parse_data->fallback;
+	if (parse_data->recurse)
+		parse_data->fallback = FALSE;
+
+	/* Get the length, if it's negative, that means that we have a stream
+	 * and should push the entry straight away */
+	if (entry->length != NULL)
+		length_num = totem_pl_parser_parse_duration (entry->length, totem_pl_parser_is_debugging_enabled (parser));
+
+	fields[0].id = TOTEM_PL_FIELD_ID_URI;
+	fields[0].value = entry->file;
+	fields[1].id = TOTEM_PL_FIELD_ID_TITLE;
+	fields[1].value = entry->title;
+	fields[2].id = TOTEM_PL_FIELD_ID_GENRE;
+	fields[2].value = entry->genre;
+	fields[3].id = TOTEM_PL_FIELD_ID_DURATION;
+	fields[3].value = entry->length;
+
+	if (strstr (entry->file, "://") != NULL || entry->file[0] == G_DIR_SEPARATOR) {
+		GFile *target;
+
+		target = g_file_new_for_commandline_arg (entry->file);
+		if (length_num < 0 || totem_pl_parser_parse_internal (parser, target, NULL, parse_data) != TOTEM_PL_PARSER_RESULT_SUCCESS) {
+			totem_pl_parser_add_fields (parser, NULL, base_file, FALSE,
+						    fields, G_N_ELEMENTS (fields));
+		}
+		g_object_unref (target);
+	} else {
+		GFile *target;
+		char *utf8_filename;
+
+		utf8_filename = ensure_utf8_valid ((char *) entry->file);
+		target = g_file_get_child_for_display_name (base_file, utf8_filename, NULL);
+		g_free (utf8_filename);
+
+		if (length_num < 0 || totem_pl_parser_parse_internal (parser, target, base_file, parse_data) != TOTEM_PL_PARSER_RESULT_SUCCESS) {
+			/* Skip the URI field, the target file gives it */
+			totem_pl_parser_add_fields (parser, target, base_file, FALSE,
+						    fields + 1, G_N_ELEMENTS (fields) - 1);
+		}
+
+		g_object_unref (target);
+	}
+
+	parse_data->fallback = fallback;
+}
+
+static gint
+pls_compare_indexes (gconstpointer a,
+		     gconstpointer b)
+{
+	guint index_a = GPOINTER_TO_UINT (a);
+	guint index_b = GPOINTER_TO_UINT (b);
+
+	return (index_a > index_b) - (index_a < index_b);
+}
+
+/* @contents is modified in place */
 TotemPlParserResult
 totem_pl_parser_add_pls_with_contents (TotemPlParser *parser,
 				       GFile *file,
 				       GFile *_base_file,
-				       const char *contents,
+				       char *contents,
 				       TotemPlParseData *parse_data)
 {
-	TotemPlParserResult retval = TOTEM_PL_PARSER_RESULT_UNHANDLED;
 	GFile *base_file;
-	char **lines;
-	guint i, num_entries;
-	char *playlist_title;
-	gboolean fallback;
-	GHashTable *entries;
-	guint found_entries;
+	GArray *entries;
+	GHashTable *sparse_entries;
+	const char *playlist_title;
+	gboolean header_found, title_found;
+	char *line, *next;
+	guint i;
 	char *uri;
 
-	lines = g_strsplit_set (contents, "\r\n", 0);
+	entries = g_array_new (FALSE, TRUE, sizeof (PlsEntry));
+	sparse_entries = NULL;
+	playlist_title = NULL;
+	header_found = title_found = FALSE;
+
+	/* Go through the lines once, terminating them in place, and
+	 * put the values of the indexed keys straight in their entry */
+	for (line = contents; line[0] != '\0'; line = next) {
+		char *eol, *key, *value;
+		gsize key_len;
+		guint index;
+		PlsEntry *entry;
+
+		eol = line + strcspn (line, "\r\n");
+		next = eol[0] != '\0' ? eol + 1 : eol;
+		eol[0] = '\0';
+
+		/* Ignore empty lines */
+		if (totem_pl_parser_line_is_empty (line))
+			continue;
 
-	/* [playlist] */
-	i = 0;
-	num_entries = 0;
+		/* [playlist] */
+		if (header_found == FALSE) {
+			if (g_ascii_strncasecmp (line, "[playlist]",
+						 (gsize)strlen ("[playlist]")) != 0)
+				break;
+			header_found = TRUE;
+			continue;
+		}
 
-	/* Ignore empty lines */
-	while (lines[i] != NULL && totem_pl_parser_line_is_empty (lines[i]) != FALSE)
-		i++;
+		if (line[0] == '#' || line[0] == '[')
+			continue;
 
-	if (lines[i] == NULL
-	    || g_ascii_strncasecmp (lines[i], "[playlist]",
-				    (gsize)strlen ("[playlist]")) != 0) {
-		g_strfreev (lines);
-		return retval;
-	}
+		value = strchr (line, '=');
 
-	playlist_title = totem_pl_parser_read_ini_line_string (lines,
-							       "X-GNOME-Title");
-	totem_pl_parser_add_uri (parser,
-				 TOTEM_PL_PARSER_FIELD_IS_PLAYLIST, TRUE,
-				 TOTEM_PL_PARSER_FIELD_FILE, file,
-				 TOTEM_PL_PARSER_FIELD_TITLE, playlist_title,
-				 TOTEM_PL_PARSER_FIELD_CONTENT_TYPE, "audio/x-scpls",
-				 NULL);
-	g_free (playlist_title);
-
-	/* Load the file in hash table to speed up the later processing */
-	entries = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
-	for (i = 0; lines[i] != NULL; i++) {
-		char **bits;
-		char *value;
-
-		if (totem_pl_parser_line_is_empty (lines[i]))
-			continue;
+		/* The first X-GNOME-Title line gives the playlist title */
+		if (title_found == FALSE) {
+			key = line;
+			while (*key == '\t' || *key == ' ')
+				key++;
+			if (g_ascii_strncasecmp (key, "X-GNOME-Title", strlen ("X-GNOME-Title")) == 0) {
+				title_found = TRUE;
+				playlist_title = value ? value + 1 : NULL;
+			}
+		}
 
-		if (lines[i][0] == '#' || lines[i][0] == '[')
+		if (value == NULL)
 			continue;
 
-		bits = g_strsplit (lines[i], "=", 2);
-		if (bits[0] == NULL || bits [1] == NULL) {
-			g_strfreev (bits);
-			continue;
+		key = line;
+		while (g_ascii_isspace (*key))
+			key++;
+		key_len = value - key;
+		value++;
+
+		if (pls_parse_indexed_key (key, key_len, "file", strlen ("file"), &index)) {
+			entry = pls_get_entry (entries, &sparse_entries, index);
+			entry->file = value;
+		} else if (pls_parse_indexed_key (key, key_len, "title", strlen ("title"), &index)) {
+			entry = pls_get_entry (entries, &sparse_entries, index);
+			entry->title = value;
+		} else if (pls_parse_indexed_key (key, key_len, "length", strlen ("length"), &index)) {
+			entry = pls_get_entry (entries, &sparse_entries, index);
+			entry->length = value;
+		} else if (pls_parse_indexed_key (key, key_len, "genre", strlen ("genre"), &index)) {
+			/* Genre is our own little extension */
+			entry = pls_get_entry (entries, &sparse_entries, index);
+			entry->genre = value;
 		}
+	}
 
-		if (g_ascii_strncasecmp (g_strchug (bits[0]), "file", strlen ("file")) == 0)
-			num_entries++;
+	if (header_found == FALSE) {
+		g_array_free (entries, TRUE);
+		return TOTEM_PL_PARSER_RESULT_UNHANDLED;
+	}
 
-		value = g_strdup (bits[1]);
+	{
+		TotemPlParserField fields[] = {
+			{ TOTEM_PL_FIELD_ID_TITLE, playlist_title },
+			{ TOTEM_PL_FIELD_ID_CONTENT_TYPE, "audio/x-scpls" }
+		};
 
-		g_hash_table_insert (entries,
-				     g_ascii_strdown (bits[0], strlen (bits[0])),
-				     value);
-		g_strfreev (bits);
+		totem_pl_parser_add_fields (parser, file, NULL, TRUE, fields, G_N_ELEMENTS (fields));
 	}
-	g_strfreev (lines);
 
 	/* Base? */
 	if (_base_file == NULL)
@@ -238,78 +401,26 @@ totem_pl_parser_add_pls_with_contents (TotemPlParser *parser,
 	else
 		base_file = g_object_ref (_base_file);
 
-	retval = TOTEM_PL_PARSER_RESULT_SUCCESS;
-
-	found_entries = 0;
-	for (i = 1; found_entries < num_entries; i++) {
-		char *file_str, *title, *genre, *length;
-		char *file_key, *title_key, *genre_key, *length_key;
-		gint64 length_num;
-
-		file_key = g_strdup_printf ("file%d", i);
-		title_key = g_strdup_printf ("title%d", i);
-		length_key = g_strdup_printf ("length%d", i);
-		length_num = 0;
-		/* Genre is our own little extension */
-		genre_key = g_strdup_printf ("genre%d", i);
+	/* Send the entries in the order of their indexes */
+	for (i = 1; i < entries->len; i++) {
+		const PlsEntry *entry = &g_array_index (entries, PlsEntry, i);
 
-		file_str = g_hash_table_lookup (entries, file_key);
-		title = g_hash_table_lookup (entries, title_key);
-		genre = g_hash_table_lookup (entries, genre_key);
-		length = g_hash_table_lookup (entries, length_key);
+		if (entry->file != NULL)
+			pls_add_entry (parser, base_file, entry, parse_data);
+	}
 
-		g_free (file_key);
-		g_free (title_key);
-		g_free (genre_key);
-		g_free (length_key);
+	if (sparse_entries != NULL) {
+		GList *indexes, *l;
 
-		if (file_str == NULL)
-			continue;
-		found_entries++;
-
-		fallback = parse_data->fallback;
-		if (parse_data->recurse)
-			parse_data->fallback = FALSE;
-
-		/* Get the length, if it's negative, that means that we have a stream
-		 * and should push the entry straight away */
-		if (length != NULL)
-			length_num = totem_pl_parser_parse_duration (length, totem_pl_parser_is_debugging_enabled (parser));
-
-		if (strstr (file_str, "://") != NULL || file_str[0] == G_DIR_SEPARATOR) {
-			GFile *target;
-
-			target = g_file_new_for_commandline_arg (file_str);
-			if (length_num < 0 || totem_pl_parser_parse_internal (parser, target, NULL, parse_data) != TOTEM_PL_PARSER_RESULT_SUCCESS) {
-				totem_pl_parser_add_uri (parser,
-							 TOTEM_PL_PARSER_FIELD_URI, file_str,
-							 TOTEM_PL_PARSER_FIELD_TITLE, title,
-							 TOTEM_PL_PARSER_FIELD_GENRE, genre,
-							 TOTEM_PL_PARSER_FIELD_DURATION, length,
-							 TOTEM_PL_PARSER_FIELD_BASE_FILE, base_file, NULL);
-			}
-			g_object_unref (target);
-		} else {
-			GFile *target;
-			char *utf8_filename;
-
-			utf8_filename = ensure_utf8_valid (file_str);
-			target = g_file_get_child_for_display_name (base_file, utf8_filename, NULL);
-			g_free (utf8_filename);
-
-			if (length_num < 0 || totem_pl_parser_parse_internal (parser, target, base_file, parse_data) != TOTEM_PL_PARSER_RESULT_SUCCESS) {
-				totem_pl_parser_add_uri (parser,
-							 TOTEM_PL_PARSER_FIELD_FILE, target,
-							 TOTEM_PL_PARSER_FIELD_TITLE, title,
-							 TOTEM_PL_PARSER_FIELD_GENRE, genre,
-							 TOTEM_PL_PARSER_FIELD_DURATION, length,
-							 TOTEM_PL_PARSER_FIELD_BASE_FILE, base_file, NULL);
-			}
+		indexes = g_list_sort (g_hash_table_get_keys (sparse_entries), pls_compare_indexes);
+		for (l = indexes; l != NULL; l = l->next) {
+			const PlsEntry *entry = g_hash_table_lookup (sparse_entries, l->data);
 
-			g_object_unref (target);
+			if (entry->file != NULL)
+				pls_add_entry (parser, base_file, entry, parse_data);
 		}
-
-		parse_data->fallback = fallback;
+		g_list_free (indexes);
+		g_hash_table_destroy (sparse_entries);
 	}
 
 	uri = g_file_get_uri (file);
@@ -317,9 +428,9 @@ totem_pl_parser_add_pls_with_contents (TotemPlParser *parser,
 	g_free (uri);
 
 	g_object_unref (base_file);
-        g_hash_table_destroy (entries);
+	g_array_free (entries, TRUE);
 
-	return retval;
+	return TOTEM_PL_PARSER_RESULT_SUCCESS;
 }
 
 TotemPlParserResult
@@ -333,7 +444,7 @@ totem_pl_parser_add_pls (TotemPlParser *parser,
 	char *contents;
 	gsize size;
 
-	if (g_file_load_contents (file, NULL, &contents, &size, NULL, NULL) == FALSE)
+	if (totem_pl_parser_load_contents (parse_data, file, &contents, &size) == FALSE)
 		return TOTEM_PL_PARSER_RESULT_ERROR;
 
 	if (size == 0) {
@@ -41,7 +41,7 @@ gboolean totem_pl_parser_save_pls				(TotemPlParser *parser,
 TotemPlParserResult totem_pl_parser_add_pls_with_contents	(TotemPlParser *parser,
 								 GFile *file,
 								 GFile *base_file,
-								 const char *contents,
+								 char *contents,
 								 TotemPlParseData *parse_data);
 TotemPlParserResult totem_pl_parser_add_pls			(TotemPlParser *parser,
 								 GFile *file,
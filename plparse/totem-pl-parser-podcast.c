@@ -100,14 +100,12 @@ totem_pl_parser_is_xml_feed (const char *data, gsize len)
 #ifndef TOTEM_PL_PARSER_MINI
 
 static const char *
-xml_parser_get_node_value (xml_node_t *parent, const char *node_name)
+xml_parser_get_node_value (xml_node_t *parent, xml_atom_t atom)
 {
 	xml_node_t *child;
 
 	for (child = parent->child; child != NULL; child = child->next) {
-		if (child->name == NULL)
-			continue;
-		if (g_ascii_strcasecmp (child->name, node_name) == 0)
+		if (child->atom == atom)
 			return child->data;
 	}
 
@@ -131,10 +129,7 @@ get_itunes_subgenre (xml_node_t *parent)
 	const char *sub_genre = NULL;
 
 	for (child = parent->child; child != NULL; child = child->next) {
-		if (child->name == NULL)
-			continue;
-
-		if (g_ascii_strcasecmp (child->name, "itunes:category") == 0) {
+		if (child->atom == XML_ATOM_ITUNES_CATEGORY) {
 			sub_genre = xml_parser_get_property (child, "text");
 
 			/* we expect atmost one itunes subgenre */
@@ -252,110 +247,146 @@ get_content_rating (const char *value)
 	return content_rating;
 }
 
+/* Properties of media:content and enclosure nodes, looked up together */
+enum {
+	CONTENT_URL,
+	CONTENT_TYPE,
+	CONTENT_MEDIUM,
+	CONTENT_LENGTH,
+	CONTENT_FILESIZE,
+	CONTENT_DURATION,
+	NUM_CONTENT_PROPS
+};
+
+static const xml_atom_t content_props[NUM_CONTENT_PROPS] = {
+	[CONTENT_URL] = XML_ATOM_URL,
+	[CONTENT_TYPE] = XML_ATOM_TYPE,
+	[CONTENT_MEDIUM] = XML_ATOM_MEDIUM,
+	[CONTENT_LENGTH] = XML_ATOM_LENGTH,
+	[CONTENT_FILESIZE] = XML_ATOM_FILESIZE,
+	[CONTENT_DURATION] = XML_ATOM_DURATION
+};
+
+/* Whether an entry published on @pub_date is older than @since; entries
+ * without a date, or with one that can't be parsed, never are */
+static gboolean
+is_older_than (TotemPlParser *parser, const char *pub_date, guint64 since)
+{
+	if (since == 0 || pub_date == NULL)
+		return FALSE;
+	return totem_pl_parser_parse_date (pub_date, totem_pl_parser_is_debugging_enabled (parser)) < since;
+}
+
+/* Returns %TOTEM_PL_PARSER_RESULT_SUCCESS if an entry was added,
+ * %TOTEM_PL_PARSER_RESULT_IGNORED if the item is older than @since, and
+ * %TOTEM_PL_PARSER_RESULT_UNHANDLED if it has nothing to play */
 static TotemPlParserResult
-parse_rss_item (TotemPlParser *parser, xml_node_t *parent)
+parse_rss_item (TotemPlParser *parser, xml_node_t *parent, guint64 since)
 {
 	const char *title, *uri, *description, *author, *img, *explicit;
 	const char *pub_date, *duration, *filesize, *content_type, *id;
+	const char *values[NUM_CONTENT_PROPS];
 	xml_node_t *node;
 
 	title = uri = description = author = content_type = NULL;
 	img = pub_date = duration = filesize = id = explicit = NULL;
 
 	for (node = parent->child; node != NULL; node = node->next) {
-		if (node->name == NULL)
-			continue;
+		const char *tmp;
 
-		if (g_ascii_strcasecmp (node->name, "title") == 0) {
+		switch (node->atom) {
+		case XML_ATOM_TITLE:
 			title = node->data;
-		} else if (g_ascii_strcasecmp (node->name, "url") == 0) {
+			break;
+		case XML_ATOM_URL:
 			uri = node->data;
-		} else if (g_ascii_strcasecmp (node->name, "pubDate") == 0) {
+			break;
+		case XML_ATOM_PUBDATE:
 			pub_date = node->data;
-		} else if (g_ascii_strcasecmp (node->name, "guid") == 0) {
+			break;
+		case XML_ATOM_GUID:
 			id = node->data;
-		} else if (g_ascii_strcasecmp (node->name, "description") == 0
-			   || g_ascii_strcasecmp (node->name, "itunes:summary") == 0) {
+			break;
+		case XML_ATOM_DESCRIPTION:
+		case XML_ATOM_ITUNES_SUMMARY:
 			/* prefer longer item descriptions */
 			set_longer_description (node, &description);
-		} else if (g_ascii_strcasecmp (node->name, "author") == 0
-			   || g_ascii_strcasecmp (node->name, "itunes:author") == 0) {
+			break;
+		case XML_ATOM_AUTHOR:
+		case XML_ATOM_ITUNES_AUTHOR:
 			author = node->data;
-		} else if (g_ascii_strcasecmp (node->name, "itunes:duration") == 0) {
+			break;
+		case XML_ATOM_ITUNES_DURATION:
 			duration = node->data;
-		} else if (g_ascii_strcasecmp (node->name, "length") == 0) {
+			break;
+		case XML_ATOM_LENGTH:
 			filesize = node->data;
-		} else if (g_ascii_strcasecmp (node->name, "media:content") == 0) {
-			const char *tmp;
-
-			tmp = xml_parser_get_property (node, "medium");
+			break;
+		case XML_ATOM_MEDIA_CONTENT:
+			xml_parser_get_properties (node, content_props, values, NUM_CONTENT_PROPS);
+			tmp = values[CONTENT_MEDIUM];
 			if (tmp != NULL && g_str_equal (tmp, "image")) {
-				tmp = xml_parser_get_property (node, "url");
-				if (tmp != NULL)
-					img = tmp;
-				continue;
+				if (values[CONTENT_URL] != NULL)
+					img = values[CONTENT_URL];
+				break;
 			}
 
-			tmp = xml_parser_get_property (node, "type");
+			tmp = values[CONTENT_TYPE];
 			if (tmp != NULL &&
 			    g_str_has_prefix (tmp, "audio/") == FALSE) {
 				if (g_str_has_prefix (tmp, "image/")) {
-					tmp = xml_parser_get_property (node, "url");
-					if (tmp != NULL)
-						img = tmp;
+					if (values[CONTENT_URL] != NULL)
+						img = values[CONTENT_URL];
 				}
-				continue;
+				break;
 			}
 
 			if (tmp != NULL)
 				content_type = tmp;
 
-			tmp = xml_parser_get_property (node, "url");
-			if (tmp != NULL)
-				uri = tmp;
-			else
-				continue;
-
-			tmp = xml_parser_get_property (node, "fileSize");
-			if (tmp != NULL)
-				filesize = tmp;
+			if (values[CONTENT_URL] == NULL)
+				break;
+			uri = values[CONTENT_URL];
 
-			tmp = xml_parser_get_property (node, "duration");
-			if (tmp != NULL)
-				duration = tmp;
-		} else if (g_ascii_strcasecmp (node->name, "enclosure") == 0) {
-			const char *tmp;
-
-			tmp = xml_parser_get_property (node, "url");
-			if (tmp != NULL && is_image (tmp) == FALSE)
-				uri = tmp;
-			else
-				continue;
-			tmp = xml_parser_get_property (node, "length");
-			if (tmp != NULL)
-				filesize = tmp;
+			if (values[CONTENT_FILESIZE] != NULL)
+				filesize = values[CONTENT_FILESIZE];
 
-			tmp = xml_parser_get_property (node, "type");
-			if (tmp != NULL)
-				content_type = tmp;
-		} else if (g_ascii_strcasecmp (node->name, "link") == 0 &&
-			   totem_pl_parser_get_recurse (parser) &&
-			   totem_pl_parser_is_videosite (node->data, totem_pl_parser_is_debugging_enabled (parser)) != FALSE) {
-			uri = node->data;
-		} else if (g_ascii_strcasecmp (node->name, "image") == 0) {
-			const char *tmp;
-
-			tmp = xml_parser_get_node_value (node, "url");
+			if (values[CONTENT_DURATION] != NULL)
+				duration = values[CONTENT_DURATION];
+			break;
+		case XML_ATOM_ENCLOSURE:
+			xml_parser_get_properties (node, content_props, values, NUM_CONTENT_PROPS);
+			tmp = values[CONTENT_URL];
+			if (tmp == NULL || is_image (tmp) != FALSE)
+				break;
+			uri = tmp;
+
+			if (values[CONTENT_LENGTH] != NULL)
+				filesize = values[CONTENT_LENGTH];
+
+			if (values[CONTENT_TYPE] != NULL)
+				content_type = values[CONTENT_TYPE];
+			break;
+		case XML_ATOM_LINK:
+			if (totem_pl_parser_get_recurse (parser) &&
+			    totem_pl_parser_is_videosite (node->data, totem_pl_parser_is_debugging_enabled (parser)) != FALSE)
+				uri = node->data;
+			break;
+		case XML_ATOM_IMAGE:
+			tmp = xml_parser_get_node_value (node, XML_ATOM_URL);
 			if (tmp != NULL)
 				img = tmp;
-		} else if (g_ascii_strcasecmp (node->name, "itunes:image") == 0) {
-			const char *tmp;
-
+			break;
+		case XML_ATOM_ITUNES_IMAGE:
 			tmp = xml_parser_get_property (node, "href");
 			if (tmp != NULL)
 				img = tmp;
-		} else if (g_ascii_strcasecmp (node->name, "itunes:explicit") == 0) {
+			break;
+		case XML_ATOM_ITUNES_EXPLICIT:
 			explicit = node->data;
+			break;
+		default:
+			break;
 		}
 	}
 
@@ -365,27 +396,35 @@ parse_rss_item (TotemPlParser *parser, xml_node_t *parent)
 	    totem_pl_parser_is_videosite (id, totem_pl_parser_is_debugging_enabled (parser)) != FALSE)
 		uri = id;
 
+	if (is_older_than (parser, pub_date, since))
+		return TOTEM_PL_PARSER_RESULT_IGNORED;
+
 	if (uri != NULL) {
-		totem_pl_parser_add_uri (parser,
-					 TOTEM_PL_PARSER_FIELD_URI, uri,
-					 TOTEM_PL_PARSER_FIELD_ID, id,
-					 TOTEM_PL_PARSER_FIELD_TITLE, title,
-					 TOTEM_PL_PARSER_FIELD_PUB_DATE, pub_date,
-					 TOTEM_PL_PARSER_FIELD_DESCRIPTION, description,
-					 TOTEM_PL_PARSER_FIELD_AUTHOR, author,
-					 TOTEM_PL_PARSER_FIELD_DURATION, duration,
-					 TOTEM_PL_PARSER_FIELD_FILESIZE, filesize,
-					 TOTEM_PL_PARSER_FIELD_CONTENT_TYPE, content_type,
-					 TOTEM_PL_PARSER_FIELD_IMAGE_URI, img,
-					 TOTEM_PL_PARSER_FIELD_CONTENT_RATING, get_content_rating (explicit),
-					 NULL);
+		TotemPlParserField fields[] = {
+			{ TOTEM_PL_FIELD_ID_URI, uri },
+			{ TOTEM_PL_FIELD_ID_ID, id },
+			{ TOTEM_PL_FIELD_ID_TITLE, title },
+			{ TOTEM_PL_FIELD_ID_PUB_DATE, pub_date },
+			{ TOTEM_PL_FIELD_ID_DESCRIPTION, description },
+			{ TOTEM_PL_FIELD_ID_AUTHOR, author },
+			{ TOTEM_PL_FIELD_ID_DURATION, duration },
+			{ TOTEM_PL_FIELD_ID_FILESIZE, filesize },
+			{ TOTEM_PL_FIELD_ID_CONTENT_TYPE, content_type },
+			{ TOTEM_PL_FIELD_ID_IMAGE_URI, img },
+			{ TOTEM_PL_FIELD_ID_CONTENT_RATING, get_content_rating (explicit) }
+		};
+
+		totem_pl_parser_add_fields (parser, NULL, NULL, FALSE, fields, G_N_ELEMENTS (fields));
+		return TOTEM_PL_PARSER_RESULT_SUCCESS;
 	}
 
-	return TOTEM_PL_PARSER_RESULT_SUCCESS;
+	return TOTEM_PL_PARSER_RESULT_UNHANDLED;
 }
 
-static TotemPlParserResult
-parse_rss_items (TotemPlParser *parser, const char *uri, xml_node_t *parent)
+/* Sends the feed metadata from the children of @parent, the channel
+ * elements that came before the first item */
+static void
+parse_rss_channel (TotemPlParser *parser, const char *uri, xml_node_t *parent)
 {
 	const char *title, *language, *description, *author;
 	const char *contact, *img, *pub_date, *copyright, *generator, *explicit;
@@ -398,68 +437,76 @@ parse_rss_items (TotemPlParser *parser, const char *uri, xml_node_t *parent)
 	title = language = description = author = NULL;
 	contact = img = pub_date = copyright = generator = explicit = NULL;
 
-	/* We need to parse for the feed metadata first, then for the items */
 	for (node = parent->child; node != NULL; node = node->next) {
-		if (node->name == NULL)
-			continue;
+		const char *tmp;
 
-		if (g_ascii_strcasecmp (node->name, "title") == 0) {
+		switch (node->atom) {
+		case XML_ATOM_TITLE:
 			title = node->data;
-		} else if (g_ascii_strcasecmp (node->name, "language") == 0) {
+			break;
+		case XML_ATOM_LANGUAGE:
 			language = node->data;
-		} else if (g_ascii_strcasecmp (node->name, "description") == 0
-			 || g_ascii_strcasecmp (node->name, "itunes:subtitle") == 0
-			 || g_ascii_strcasecmp (node->name, "itunes:summary") == 0) {
+			break;
+		case XML_ATOM_DESCRIPTION:
+		case XML_ATOM_ITUNES_SUBTITLE:
+		case XML_ATOM_ITUNES_SUMMARY:
 			/* prefer longer feed descriptions */
 			set_longer_description (node, &description);
-		} else if (g_ascii_strcasecmp (node->name, "author") == 0
-			   || g_ascii_strcasecmp (node->name, "itunes:author") == 0) {
+			break;
+		case XML_ATOM_AUTHOR:
+		case XML_ATOM_ITUNES_AUTHOR:
 			if (node->data)
 				author = node->data;
-		} else if (g_ascii_strcasecmp (node->name, "generator") == 0) {
+			break;
+		case XML_ATOM_GENERATOR:
 			generator = node->data;
-		} else if (g_ascii_strcasecmp (node->name, "itunes:owner") == 0) {
-			const char *tmp;
-
+			break;
+		case XML_ATOM_ITUNES_OWNER:
 			/* Owner name is much broader than author. So, we set it
 			 * only if there is no author in feed yet. */
-			tmp = xml_parser_get_node_value (node, "itunes:name");
+			tmp = xml_parser_get_node_value (node, XML_ATOM_ITUNES_NAME);
 			if (tmp != NULL && author == NULL)
 				author = tmp;
-		} else if (g_ascii_strcasecmp (node->name, "webMaster") == 0) {
+			break;
+		case XML_ATOM_WEBMASTER:
 			contact = node->data;
-		} else if (g_ascii_strcasecmp (node->name, "image") == 0) {
-			const char *tmp;
-
-			tmp = xml_parser_get_node_value (node, "url");
+			break;
+		case XML_ATOM_IMAGE:
+			tmp = xml_parser_get_node_value (node, XML_ATOM_URL);
+			if (tmp != NULL)
+				img = tmp;
+			break;
+		case XML_ATOM_ITUNES_IMAGE:
+			tmp = xml_parser_get_property (node, "href");
 			if (tmp != NULL)
 				img = tmp;
-		} else if (g_ascii_strcasecmp (node->name, "itunes:image") == 0) {
-			const char *href;
-
-			href = xml_parser_get_property (node, "href");
-			if (href != NULL)
-				img = href;
-		} else if (g_ascii_strcasecmp (node->name, "lastBuildDate") == 0
-			   || (g_ascii_strcasecmp (node->name, "pubDate") == 0)) {
+			break;
+		case XML_ATOM_LASTBUILDDATE:
+		case XML_ATOM_PUBDATE:
 			/* prefer recent of <lastBuildDate> and <pubDate> date */
 			set_recent_date (node, &pub_date);
-		} else if (g_ascii_strcasecmp (node->name, "copyright") == 0) {
+			break;
+		case XML_ATOM_COPYRIGHT:
 			copyright = node->data;
-		} else if (g_ascii_strcasecmp (node->name, "itunes:explicit") == 0) {
+			break;
+		case XML_ATOM_ITUNES_EXPLICIT:
 			explicit = node->data;
-		} else if (g_ascii_strcasecmp (node->name, "itunes:category") == 0) {
+			break;
+		case XML_ATOM_ITUNES_CATEGORY:
 			/* only one primary genre */
 			if (genre == NULL) {
 				genre = get_itunes_genre (node);
 				genres_str = g_string_new (genre);
 			} else {
-				char *tmp;
+				char *other;
 
-				tmp = get_itunes_genre (node);
-				g_string_append_printf (genres_str, "%c%s", GENRE_SEPARATOR, tmp);
-				g_free (tmp);
+				other = get_itunes_genre (node);
+				g_string_append_printf (genres_str, "%c%s", GENRE_SEPARATOR, other);
+				g_free (other);
 			}
+			break;
+		default:
+			break;
 		}
 	}
 
@@ -471,36 +518,200 @@ parse_rss_items (TotemPlParser *parser, const char *uri, xml_node_t *parent)
 		author = generator;
 
 	/* Send the info we already have about the feed */
-	totem_pl_parser_add_uri (parser,
-				 TOTEM_PL_PARSER_FIELD_IS_PLAYLIST, TRUE,
-				 TOTEM_PL_PARSER_FIELD_URI, uri,
-				 TOTEM_PL_PARSER_FIELD_TITLE, title,
-				 TOTEM_PL_PARSER_FIELD_GENRE, genre,
-				 TOTEM_PL_PARSER_FIELD_GENRES, genres,
-				 TOTEM_PL_PARSER_FIELD_LANGUAGE, language,
-				 TOTEM_PL_PARSER_FIELD_DESCRIPTION, description,
-				 TOTEM_PL_PARSER_FIELD_AUTHOR, author,
-				 TOTEM_PL_PARSER_FIELD_PUB_DATE, pub_date,
-				 TOTEM_PL_PARSER_FIELD_COPYRIGHT, copyright,
-				 TOTEM_PL_PARSER_FIELD_IMAGE_URI, img,
-				 TOTEM_PL_PARSER_FIELD_CONTACT, contact,
-				 TOTEM_PL_PARSER_FIELD_CONTENT_RATING, get_content_rating (explicit),
-				 TOTEM_PL_PARSER_FIELD_CONTENT_TYPE, "application/rss+xml",
-				 NULL);
+	{
+		TotemPlParserField fields[] = {
+			{ TOTEM_PL_FIELD_ID_URI, uri },
+			{ TOTEM_PL_FIELD_ID_TITLE, title },
+			{ TOTEM_PL_FIELD_ID_GENRE, genre },
+			{ TOTEM_PL_FIELD_ID_GENRES, genres },
+			{ TOTEM_PL_FIELD_ID_LANGUAGE, language },
+			{ TOTEM_PL_FIELD_ID_DESCRIPTION, description },
+			{ TOTEM_PL_FIELD_ID_AUTHOR, author },
+			{ TOTEM_PL_FIELD_ID_PUB_DATE, pub_date },
+			{ TOTEM_PL_FIELD_ID_COPYRIGHT, copyright },
+			{ TOTEM_PL_FIELD_ID_IMAGE_URI, img },
+			{ TOTEM_PL_FIELD_ID_CONTACT, contact },
+			{ TOTEM_PL_FIELD_ID_CONTENT_RATING, get_content_rating (explicit) },
+			{ TOTEM_PL_FIELD_ID_CONTENT_TYPE, "application/rss+xml" }
+		};
+
+		totem_pl_parser_add_fields (parser, NULL, NULL, TRUE, fields, G_N_ELEMENTS (fields));
+	}
+}
 
-	for (node = parent->child; node != NULL; node = node->next) {
-		if (node->name == NULL)
-			continue;
+/* State for streaming the items of a feed: the elements that come before
+ * the first item are kept, chained as the children of a fake parent node,
+ * until the feed metadata can be sent */
+typedef struct {
+	TotemPlParser *parser;
+	const char *uri;
+	xml_atom_t root_atom;
+	xml_atom_t item_atom;
+	gboolean is_feed;	/* root element is root_atom */
+	gboolean in_items;	/* within the element with the items */
+	gboolean seen_items;
+	gboolean started;	/* feed metadata sent */
+	gboolean ended;
+	xml_node_t header;
+	xml_node_t *last_header;
+	guint max_entries;	/* see TotemPlParser:max-entries */
+	guint num_entries;
+	guint64 since;		/* see TotemPlParser:since */
+	gboolean metadata_only;	/* see TotemPlParser:metadata-only */
+} FeedStream;
+
+static void
+feed_stream_init (FeedStream *feed, TotemPlParser *parser, const char *uri, xml_atom_t root_atom, xml_atom_t item_atom)
+{
+	memset (feed, 0, sizeof (*feed));
+	feed->parser = parser;
+	feed->uri = uri;
+	feed->root_atom = root_atom;
+	feed->item_atom = item_atom;
+	totem_pl_parser_get_feed_limits (parser, &feed->max_entries, &feed->since, &feed->metadata_only);
+}
 
-		if (g_ascii_strcasecmp (node->name, "item") == 0)
-			parse_rss_item (parser, node);
+static void
+feed_stream_free_header (FeedStream *feed)
+{
+	xml_node_t *node, *next;
+
+	for (node = feed->header.child; node != NULL; node = next) {
+		next = node->next;
+		xml_parser_free_tree (node);
 	}
+	feed->header.child = feed->last_header = NULL;
+}
 
-	totem_pl_parser_playlist_end (parser, uri);
+static int
+feed_stream_open (FeedStream *feed, const xml_node_t *node, int depth)
+{
+	if (depth == 0) {
+		/* stop at any element after the root element */
+		if (feed->is_feed || node->atom != feed->root_atom)
+			return 1;
+		feed->is_feed = TRUE;
+	}
+	return 0;
+}
 
-	return TOTEM_PL_PARSER_RESULT_SUCCESS;
+/* Keeps @node if it comes before the first item, returns whether it's an item */
+static gboolean
+feed_stream_subtree (FeedStream *feed, xml_node_t *node)
+{
+	if (feed->in_items && node->atom == feed->item_atom)
+		return TRUE;
+
+	if (feed->in_items && !feed->started) {
+		if (feed->last_header != NULL)
+			feed->last_header->next = node;
+		else
+			feed->header.child = node;
+		feed->last_header = node;
+	} else {
+		xml_parser_free_tree (node);
+	}
+	return FALSE;
 }
 
+/* Whether to stop before @node, the first item, with
+ * TotemPlParser:metadata-only; the feed metadata still needs sending */
+static gboolean
+feed_stream_stops_at (FeedStream *feed, const xml_node_t *node)
+{
+	return feed->metadata_only && feed->in_items && node->atom == feed->item_atom;
+}
+
+/* Returns non-zero to stop parsing the feed, after an item older than
+ * TotemPlParser:since, or once TotemPlParser:max-entries were added */
+static int
+feed_stream_item_done (FeedStream *feed, TotemPlParserResult result)
+{
+	if (result == TOTEM_PL_PARSER_RESULT_IGNORED)
+		return 1;
+	if (result == TOTEM_PL_PARSER_RESULT_SUCCESS &&
+	    ++feed->num_entries == feed->max_entries)
+		return 1;
+	return 0;
+}
+
+static int
+rss_stream_open (void *user_data, const xml_node_t *node, int depth)
+{
+	FeedStream *feed = user_data;
+
+	if (depth == 1) {
+		/* One channel per file */
+		feed->in_items = !feed->seen_items && node->atom == XML_ATOM_CHANNEL;
+		feed->seen_items |= feed->in_items;
+		return 0;
+	}
+	return feed_stream_open (feed, node, depth);
+}
+
+/* Sends the feed metadata when the first item is found */
+static void
+rss_stream_start_items (FeedStream *feed)
+{
+	if (feed->started)
+		return;
+	parse_rss_channel (feed->parser, feed->uri, &feed->header);
+	feed_stream_free_header (feed);
+	feed->started = TRUE;
+}
+
+static int
+rss_stream_start (void *user_data, const xml_node_t *node)
+{
+	FeedStream *feed = user_data;
+
+	if (!feed_stream_stops_at (feed, node))
+		return 0;
+	rss_stream_start_items (feed);
+	return 1;
+}
+
+static int
+rss_stream_subtree (void *user_data, xml_node_t *node)
+{
+	FeedStream *feed = user_data;
+	TotemPlParserResult result;
+
+	if (!feed_stream_subtree (feed, node))
+		return 0;
+
+	rss_stream_start_items (feed);
+	result = parse_rss_item (feed->parser, node, feed->since);
+	xml_parser_free_tree (node);
+
+	return feed_stream_item_done (feed, result);
+}
+
+static int
+rss_stream_close (void *user_data, const char *name, int depth)
+{
+	FeedStream *feed = user_data;
+
+	if (depth != 1 || !feed->in_items)
+		return 0;
+
+	if (!feed->started)
+		parse_rss_channel (feed->parser, feed->uri, &feed->header);
+	feed_stream_free_header (feed);
+	totem_pl_parser_playlist_end (feed->parser, feed->uri);
+	feed->in_items = FALSE;
+	feed->started = feed->ended = TRUE;
+
+	return 0;
+}
+
+static const xml_parser_stream_t rss_stream = {
+	rss_stream_open,
+	rss_stream_subtree,
+	rss_stream_close,
+	rss_stream_start
+};
+
 TotemPlParserResult
 totem_pl_parser_add_rss (TotemPlParser *parser,
 			 GFile *file,
@@ -508,42 +719,29 @@ totem_pl_parser_add_rss (TotemPlParser *parser,
 			 TotemPlParseData *parse_data,
 			 gpointer data)
 {
-	xml_node_t* doc, *channel;
-	char *contents;
+	FeedStream feed;
+	char *contents, *uri;
 	gsize size;
+	gboolean parsed;
 
-	if (g_file_load_contents (file, NULL, &contents, &size, NULL, NULL) == FALSE)
+	if (totem_pl_parser_load_contents (parse_data, file, &contents, &size) == FALSE)
 		return TOTEM_PL_PARSER_RESULT_ERROR;
 
-	doc = totem_pl_parser_parse_xml_relaxed (contents, size);
-	if (doc == NULL) {
-		g_free (contents);
-		return TOTEM_PL_PARSER_RESULT_ERROR;
-	}
-
-	/* If the document has no name */
-	if (doc->name == NULL
-	    || (g_ascii_strcasecmp (doc->name , "rss") != 0)) {
-		g_free (contents);
-		xml_parser_free_tree (doc);
-		return TOTEM_PL_PARSER_RESULT_ERROR;
-	}
-
-	for (channel = doc->child; channel != NULL; channel = channel->next) {
-		if (g_ascii_strcasecmp (channel->name, "channel") == 0) {
-			char *uri;
-
-			uri = g_file_get_uri (file);
-			parse_rss_items (parser, uri, channel);
-			g_free (uri);
-
-			/* One channel per file */
-			break;
-		}
-	}
+	/* The items are sent as soon as they're parsed, so that we don't
+	 * need to keep the whole document around as a tree */
+	uri = g_file_get_uri (file);
+	feed_stream_init (&feed, parser, uri, XML_ATOM_RSS, XML_ATOM_ITEM);
+	parsed = totem_pl_parser_stream_xml_relaxed (contents, size, 2, &rss_stream, &feed);
 
+	/* Broken documents only get the items before the error */
+	if (feed.started && !feed.ended)
+		totem_pl_parser_playlist_end (parser, uri);
+	feed_stream_free_header (&feed);
+	g_free (uri);
 	g_free (contents);
-	xml_parser_free_tree (doc);
+
+	if (!feed.is_feed || (!parsed && !feed.started))
+		return TOTEM_PL_PARSER_RESULT_ERROR;
 
 	return TOTEM_PL_PARSER_RESULT_SUCCESS;
 }
@@ -616,7 +814,7 @@ totem_pl_parser_add_zune (TotemPlParser *parser,
  * http://tools.ietf.org/html/rfc4287
  * http://tools.ietf.org/html/rfc4946 */
 static TotemPlParserResult
-parse_atom_entry (TotemPlParser *parser, xml_node_t *parent)
+parse_atom_entry (TotemPlParser *parser, xml_node_t *parent, guint64 since)
 {
 	const char *title, *author, *uri, *filesize;
 	const char *copyright, *pub_date, *description, *img;
@@ -626,169 +824,248 @@ parse_atom_entry (TotemPlParser *parser, xml_node_t *parent)
 	copyright = pub_date = description = img = NULL;
 
 	for (node = parent->child; node != NULL; node = node->next) {
-		if (node->name == NULL)
-			continue;
+		const char *tmp, *rel;
+		xml_node_t *child;
 
-		if (g_ascii_strcasecmp (node->name, "title") == 0) {
+		switch (node->atom) {
+		case XML_ATOM_TITLE:
 			title = node->data;
-		} else if (g_ascii_strcasecmp (node->name, "author") == 0) {
-			const char *tmp;
-
-			tmp = xml_parser_get_node_value (node, "name");
+			break;
+		case XML_ATOM_AUTHOR:
+			tmp = xml_parser_get_node_value (node, XML_ATOM_NAME);
 			if (tmp != NULL)
 				author = tmp;
-		} else if (g_ascii_strcasecmp (node->name, "link") == 0) {
-			const char *rel;
-
+			break;
+		case XML_ATOM_LINK:
 			//FIXME how do we choose the default enclosure type?
 			rel = xml_parser_get_property (node, "rel");
 
 			if (rel == NULL)
-				continue;
+				break;
 
-			if (g_ascii_strcasecmp (rel, "enclosure") == 0) {
-				const char *href;
+			//FIXME what's the difference between url and href there?
+			tmp = xml_parser_get_property (node, "href");
+			if (tmp == NULL)
+				break;
 
-				//FIXME what's the difference between url and href there?
-				href = xml_parser_get_property (node, "href");
-				if (href == NULL)
-					continue;
-				uri = href;
+			if (g_ascii_strcasecmp (rel, "enclosure") == 0) {
+				uri = tmp;
 				filesize = xml_parser_get_property (node, "length");
 			} else if (g_ascii_strcasecmp (rel, "license") == 0) {
-				const char *href;
-
-				href = xml_parser_get_property (node, "href");
-				if (href == NULL)
-					continue;
 				/* This isn't really a copyright, but what the hey */
-				copyright = href;
+				copyright = tmp;
 			} else if (g_ascii_strcasecmp (rel, "alternate") == 0) {
-				const char *href;
-
-				href = xml_parser_get_property (node, "href");
-				if (href == NULL)
-					continue;
 				if (totem_pl_parser_get_recurse (parser) &&
-				    !totem_pl_parser_is_videosite (href, totem_pl_parser_is_debugging_enabled (parser))) {
-					continue;
+				    !totem_pl_parser_is_videosite (tmp, totem_pl_parser_is_debugging_enabled (parser))) {
+					break;
 				}
-				uri = href;
+				uri = tmp;
 			}
-		} else if (g_ascii_strcasecmp (node->name, "updated") == 0
-			   || (g_ascii_strcasecmp (node->name, "modified") == 0 && pub_date == NULL)) {
+			break;
+		case XML_ATOM_UPDATED:
 			pub_date = node->data;
-		} else if (g_ascii_strcasecmp (node->name, "summary") == 0
-			   || (g_ascii_strcasecmp (node->name, "content") == 0 && description == NULL)) {
-			const char *type;
-
-			type = xml_parser_get_property (node, "content");
-			if (type != NULL && g_ascii_strcasecmp (type, "text/plain") == 0)
+			break;
+		case XML_ATOM_MODIFIED:
+			if (pub_date == NULL)
+				pub_date = node->data;
+			break;
+		case XML_ATOM_CONTENT:
+		case XML_ATOM_SUMMARY:
+			if (node->atom == XML_ATOM_CONTENT && description != NULL)
+				break;
+			tmp = xml_parser_get_property (node, "content");
+			if (tmp != NULL && g_ascii_strcasecmp (tmp, "text/plain") == 0)
 				description = node->data;
-		} else if (g_ascii_strcasecmp (node->name, "media:group") == 0) {
-			xml_node_t *child;
-
+			break;
+		case XML_ATOM_MEDIA_GROUP:
 			for (child = node->child; child != NULL; child = child->next) {
-				if (child->name == NULL)
-					continue;
-
-				if (g_ascii_strcasecmp (child->name, "media:title") == 0 &&
-				    title == NULL) {
-					title = child->data;
-				} else if (g_ascii_strcasecmp (child->name, "media:description") == 0 &&
-					   description == NULL) {
-					description = child->data;
-				} else if (g_ascii_strcasecmp (child->name, "media:content") == 0 &&
-					   uri == NULL) {
-					const char *prop;
-
-					prop = xml_parser_get_property (child, "url");
-					if (prop == NULL)
-						continue;
+				switch (child->atom) {
+				case XML_ATOM_MEDIA_TITLE:
+					if (title == NULL)
+						title = child->data;
+					break;
+				case XML_ATOM_MEDIA_DESCRIPTION:
+					if (description == NULL)
+						description = child->data;
+					break;
+				case XML_ATOM_MEDIA_CONTENT:
+					if (uri != NULL)
+						break;
+					tmp = xml_parser_get_property (child, "url");
+					if (tmp == NULL)
+						break;
 					if (totem_pl_parser_get_recurse (parser) &&
-					    !totem_pl_parser_is_videosite (prop, totem_pl_parser_is_debugging_enabled (parser))) {
-						continue;
+					    !totem_pl_parser_is_videosite (tmp, totem_pl_parser_is_debugging_enabled (parser))) {
+						break;
 					}
-					uri = prop;
-				} else if (g_ascii_strcasecmp (child->name, "media:thumbnail") == 0) {
+					uri = tmp;
+					break;
+				case XML_ATOM_MEDIA_THUMBNAIL:
 					img = xml_parser_get_property (child, "url");
+					break;
+				default:
+					break;
 				}
 			}
-		}
+			break;
 		//FIXME handle category
+		default:
+			break;
+		}
 	}
 
+	if (is_older_than (parser, pub_date, since))
+		return TOTEM_PL_PARSER_RESULT_IGNORED;
+
 	if (uri != NULL) {
-		totem_pl_parser_add_uri (parser,
-					 TOTEM_PL_PARSER_FIELD_TITLE, title,
-					 TOTEM_PL_PARSER_FIELD_AUTHOR, author,
-					 TOTEM_PL_PARSER_FIELD_URI, uri,
-					 TOTEM_PL_PARSER_FIELD_FILESIZE, filesize,
-					 TOTEM_PL_PARSER_FIELD_COPYRIGHT, copyright,
-					 TOTEM_PL_PARSER_FIELD_PUB_DATE, pub_date,
-					 TOTEM_PL_PARSER_FIELD_DESCRIPTION, description,
-					 TOTEM_PL_PARSER_FIELD_IMAGE_URI, img,
-					 NULL);
+		TotemPlParserField fields[] = {
+			{ TOTEM_PL_FIELD_ID_URI, uri },
+			{ TOTEM_PL_FIELD_ID_TITLE, title },
+			{ TOTEM_PL_FIELD_ID_AUTHOR, author },
+			{ TOTEM_PL_FIELD_ID_FILESIZE, filesize },
+			{ TOTEM_PL_FIELD_ID_COPYRIGHT, copyright },
+			{ TOTEM_PL_FIELD_ID_PUB_DATE, pub_date },
+			{ TOTEM_PL_FIELD_ID_DESCRIPTION, description },
+			{ TOTEM_PL_FIELD_ID_IMAGE_URI, img }
+		};
+
+		totem_pl_parser_add_fields (parser, NULL, NULL, FALSE, fields, G_N_ELEMENTS (fields));
+		return TOTEM_PL_PARSER_RESULT_SUCCESS;
 	}
 
-	return TOTEM_PL_PARSER_RESULT_SUCCESS;
+	return TOTEM_PL_PARSER_RESULT_UNHANDLED;
 }
 
-static TotemPlParserResult
-parse_atom_entries (TotemPlParser *parser, const char *uri, xml_node_t *parent)
+/* Sends the feed metadata from the children of @parent, the feed
+ * elements that came before the first entry */
+static void
+parse_atom_feed (TotemPlParser *parser, const char *uri, xml_node_t *parent)
 {
 	const char *title, *pub_date, *description;
 	const char *author, *img;
 	xml_node_t *node;
-	gboolean started = FALSE;
 
 	title = pub_date = description = NULL;
 	author = img = NULL;
 
 	for (node = parent->child; node != NULL; node = node->next) {
-		if (node->name == NULL)
-			continue;
-
-		if (g_ascii_strcasecmp (node->name, "title") == 0) {
+		switch (node->atom) {
+		case XML_ATOM_TITLE:
 			title = node->data;
-		} else if (g_ascii_strcasecmp (node->name, "tagline") == 0) {
-		    	description = node->data;
-		} else if (g_ascii_strcasecmp (node->name, "modified") == 0
-			   || g_ascii_strcasecmp (node->name, "updated") == 0) {
+			break;
+		case XML_ATOM_TAGLINE:
+			description = node->data;
+			break;
+		case XML_ATOM_MODIFIED:
+		case XML_ATOM_UPDATED:
 			pub_date = node->data;
-		} else if (g_ascii_strcasecmp (node->name, "author") == 0
-			 || (g_ascii_strcasecmp (node->name, "generator") == 0 && author == NULL)) {
-		    	author = node->data;
-		} else if ((g_ascii_strcasecmp (node->name, "icon") == 0 && img == NULL)
-			   || g_ascii_strcasecmp (node->name, "logo") == 0) {
+			break;
+		case XML_ATOM_AUTHOR:
+			author = node->data;
+			break;
+		case XML_ATOM_GENERATOR:
+			if (author == NULL)
+				author = node->data;
+			break;
+		case XML_ATOM_ICON:
+			if (img == NULL)
+				img = node->data;
+			break;
+		case XML_ATOM_LOGO:
 			img = node->data;
+			break;
+		default:
+			break;
 		}
+	}
 
-		if (g_ascii_strcasecmp (node->name, "entry") == 0) {
-			if (started == FALSE) {
-				/* Send the info we already have about the feed */
-				totem_pl_parser_add_uri (parser,
-							 TOTEM_PL_PARSER_FIELD_IS_PLAYLIST, TRUE,
-							 TOTEM_PL_PARSER_FIELD_URI, uri,
-							 TOTEM_PL_PARSER_FIELD_TITLE, title,
-							 TOTEM_PL_PARSER_FIELD_DESCRIPTION, description,
-							 TOTEM_PL_PARSER_FIELD_AUTHOR, author,
-							 TOTEM_PL_PARSER_FIELD_PUB_DATE, pub_date,
-							 TOTEM_PL_PARSER_FIELD_IMAGE_URI, img,
-							 TOTEM_PL_PARSER_FIELD_CONTENT_TYPE, "application/atom+xml",
-							 NULL);
-				started = TRUE;
-			}
-
-			parse_atom_entry (parser, node);
-		}
+	/* Send the info we already have about the feed */
+	{
+		TotemPlParserField fields[] = {
+			{ TOTEM_PL_FIELD_ID_URI, uri },
+			{ TOTEM_PL_FIELD_ID_TITLE, title },
+			{ TOTEM_PL_FIELD_ID_DESCRIPTION, description },
+			{ TOTEM_PL_FIELD_ID_AUTHOR, author },
+			{ TOTEM_PL_FIELD_ID_PUB_DATE, pub_date },
+			{ TOTEM_PL_FIELD_ID_IMAGE_URI, img },
+			{ TOTEM_PL_FIELD_ID_CONTENT_TYPE, "application/atom+xml" }
+		};
+
+		totem_pl_parser_add_fields (parser, NULL, NULL, TRUE, fields, G_N_ELEMENTS (fields));
 	}
+}
 
-	totem_pl_parser_playlist_end (parser, uri);
+static int
+atom_stream_open (void *user_data, const xml_node_t *node, int depth)
+{
+	FeedStream *feed = user_data;
 
-	return TOTEM_PL_PARSER_RESULT_SUCCESS;
+	if (feed_stream_open (feed, node, depth) != 0)
+		return 1;
+	/* the entries are right in the root element */
+	feed->in_items = feed->seen_items = TRUE;
+	return 0;
 }
 
+/* Sends the feed metadata when the first entry is found */
+static void
+atom_stream_start_entries (FeedStream *feed)
+{
+	if (feed->started)
+		return;
+	parse_atom_feed (feed->parser, feed->uri, &feed->header);
+	feed_stream_free_header (feed);
+	feed->started = TRUE;
+}
+
+static int
+atom_stream_start (void *user_data, const xml_node_t *node)
+{
+	FeedStream *feed = user_data;
+
+	if (!feed_stream_stops_at (feed, node))
+		return 0;
+	atom_stream_start_entries (feed);
+	return 1;
+}
+
+static int
+atom_stream_subtree (void *user_data, xml_node_t *node)
+{
+	FeedStream *feed = user_data;
+	TotemPlParserResult result;
+
+	if (!feed_stream_subtree (feed, node))
+		return 0;
+
+	atom_stream_start_entries (feed);
+	result = parse_atom_entry (feed->parser, node, feed->since);
+	xml_parser_free_tree (node);
+
+	return feed_stream_item_done (feed, result);
+}
+
+static int
+atom_stream_close (void *user_data, const char *name, int depth)
+{
+	FeedStream *feed = user_data;
+
+	/* The feed metadata is only sent along with the first entry */
+	feed_stream_free_header (feed);
+	totem_pl_parser_playlist_end (feed->parser, feed->uri);
+	feed->in_items = FALSE;
+	feed->ended = TRUE;
+
+	return 0;
+}
+
+static const xml_parser_stream_t atom_stream = {
+	atom_stream_open,
+	atom_stream_subtree,
+	atom_stream_close,
+	atom_stream_start
+};
+
 TotemPlParserResult
 totem_pl_parser_add_atom (TotemPlParser *parser,
 			  GFile *file,
@@ -796,33 +1073,26 @@ totem_pl_parser_add_atom (TotemPlParser *parser,
 			  TotemPlParseData *parse_data,
 			  gpointer data)
 {
-	xml_node_t* doc;
+	FeedStream feed;
 	char *contents, *uri;
 	gsize size;
+	gboolean parsed;
 
-	if (g_file_load_contents (file, NULL, &contents, &size, NULL, NULL) == FALSE)
-		return TOTEM_PL_PARSER_RESULT_ERROR;
-
-	doc = totem_pl_parser_parse_xml_relaxed (contents, size);
-	if (doc == NULL) {
-		g_free (contents);
+	if (totem_pl_parser_load_contents (parse_data, file, &contents, &size) == FALSE)
 		return TOTEM_PL_PARSER_RESULT_ERROR;
-	}
-
-	/* If the document has no name */
-	if (doc->name == NULL
-	    || g_ascii_strcasecmp (doc->name , "feed") != 0) {
-		g_free (contents);
-		xml_parser_free_tree (doc);
-		return TOTEM_PL_PARSER_RESULT_ERROR;
-	}
 
 	uri = g_file_get_uri (file);
-	parse_atom_entries (parser, uri, doc);
-	g_free (uri);
+	feed_stream_init (&feed, parser, uri, XML_ATOM_FEED, XML_ATOM_ENTRY);
+	parsed = totem_pl_parser_stream_xml_relaxed (contents, size, 1, &atom_stream, &feed);
 
+	if (feed.started && !feed.ended)
+		totem_pl_parser_playlist_end (parser, uri);
+	feed_stream_free_header (&feed);
+	g_free (uri);
 	g_free (contents);
-	xml_parser_free_tree (doc);
+
+	if (!feed.is_feed || (!parsed && !feed.started))
+		return TOTEM_PL_PARSER_RESULT_ERROR;
 
 	return TOTEM_PL_PARSER_RESULT_SUCCESS;
 }
@@ -976,62 +1246,74 @@ totem_pl_parser_is_itms_feed (GFile *file)
 	return FALSE;
 }
 
-static TotemPlParserResult
-parse_opml_outline (TotemPlParser *parser, xml_node_t *parent)
+static void
+parse_opml_outline (TotemPlParser *parser, xml_node_t *node)
 {
-	xml_node_t* node;
+	const char *title, *uri;
 
-	for (node = parent->child; node != NULL; node = node->next) {
-		const char *title, *uri;
+	if (node->atom != XML_ATOM_OUTLINE)
+		return;
 
-		if (node->name == NULL || g_ascii_strcasecmp (node->name, "outline") != 0)
-			continue;
+	uri = xml_parser_get_property (node, "xmlUrl");
+	title = xml_parser_get_property (node, "text");
 
-		uri = xml_parser_get_property (node, "xmlUrl");
-		title = xml_parser_get_property (node, "text");
+	if (uri == NULL)
+		return;
 
-		if (uri == NULL)
-			continue;
+	{
+		TotemPlParserField fields[] = {
+			{ TOTEM_PL_FIELD_ID_URI, uri },
+			{ TOTEM_PL_FIELD_ID_TITLE, title }
+		};
 
-		totem_pl_parser_add_uri (parser,
-					 TOTEM_PL_PARSER_FIELD_TITLE, title,
-					 TOTEM_PL_PARSER_FIELD_URI, uri,
-					 NULL);
+		totem_pl_parser_add_fields (parser, NULL, NULL, FALSE, fields, G_N_ELEMENTS (fields));
 	}
-
-	return TOTEM_PL_PARSER_RESULT_SUCCESS;
 }
 
-static TotemPlParserResult
-parse_opml_head_body (TotemPlParser *parser, const char *uri, xml_node_t *parent)
+static int
+opml_stream_open (void *user_data, const xml_node_t *node, int depth)
 {
-	xml_node_t* node;
-	gboolean started;
+	FeedStream *feed = user_data;
 
-	started = FALSE;
+	if (depth == 0)
+		return feed_stream_open (feed, node, depth);
 
-	for (node = parent->child; node != NULL; node = node->next) {
-		if (node->name == NULL)
-			continue;
-
-		if (g_ascii_strcasecmp (node->name, "body") == 0) {
-			if (started == FALSE) {
-				/* Send the info we already have about the feed */
-				totem_pl_parser_add_uri (parser,
-							 TOTEM_PL_PARSER_FIELD_IS_PLAYLIST, TRUE,
-							 TOTEM_PL_PARSER_FIELD_URI, uri,
-							 TOTEM_PL_PARSER_FIELD_CONTENT_TYPE, "text/x-opml+xml",
-							 NULL);
-				started = TRUE;
-			}
+	feed->in_items = node->atom == XML_ATOM_BODY;
+	if (feed->in_items && !feed->started) {
+		/* Send the info we already have about the feed */
+		TotemPlParserField fields[] = {
+			{ TOTEM_PL_FIELD_ID_URI, feed->uri },
+			{ TOTEM_PL_FIELD_ID_CONTENT_TYPE, "text/x-opml+xml" }
+		};
 
-			parse_opml_outline (parser, node);
-		}
+		totem_pl_parser_add_fields (feed->parser, NULL, NULL, TRUE, fields, G_N_ELEMENTS (fields));
+		feed->started = TRUE;
+
+		/* There is no metadata other than the URI */
+		if (feed->metadata_only)
+			return 1;
 	}
+	return 0;
+}
 
-	return TOTEM_PL_PARSER_RESULT_SUCCESS;
+static int
+opml_stream_subtree (void *user_data, xml_node_t *node)
+{
+	FeedStream *feed = user_data;
+
+	if (feed->in_items)
+		parse_opml_outline (feed->parser, node);
+	xml_parser_free_tree (node);
+
+	return 0;
 }
 
+static const xml_parser_stream_t opml_stream = {
+	opml_stream_open,
+	opml_stream_subtree,
+	NULL
+};
+
 TotemPlParserResult
 totem_pl_parser_add_opml (TotemPlParser *parser,
 			  GFile *file,
@@ -1039,33 +1321,22 @@ totem_pl_parser_add_opml (TotemPlParser *parser,
 			  TotemPlParseData *parse_data,
 			  gpointer data)
 {
-	xml_node_t* doc;
+	FeedStream feed;
 	char *contents, *uri;
 	gsize size;
+	gboolean parsed;
 
-	if (g_file_load_contents (file, NULL, &contents, &size, NULL, NULL) == FALSE)
-		return TOTEM_PL_PARSER_RESULT_ERROR;
-
-	doc = totem_pl_parser_parse_xml_relaxed (contents, size);
-	if (doc == NULL) {
-		g_free (contents);
+	if (totem_pl_parser_load_contents (parse_data, file, &contents, &size) == FALSE)
 		return TOTEM_PL_PARSER_RESULT_ERROR;
-	}
-
-	/* If the document has no name */
-	if (doc->name == NULL
-	    || g_ascii_strcasecmp (doc->name , "opml") != 0) {
-		g_free (contents);
-		xml_parser_free_tree (doc);
-		return TOTEM_PL_PARSER_RESULT_ERROR;
-	}
 
 	uri = g_file_get_uri (file);
-	parse_opml_head_body (parser, uri, doc);
+	feed_stream_init (&feed, parser, uri, XML_ATOM_OPML, XML_ATOM_OUTLINE);
+	parsed = totem_pl_parser_stream_xml_relaxed (contents, size, 2, &opml_stream, &feed);
 	g_free (uri);
-
 	g_free (contents);
-	xml_parser_free_tree (doc);
+
+	if (!feed.is_feed || (!parsed && !feed.started))
+		return TOTEM_PL_PARSER_RESULT_ERROR;
 
 	return TOTEM_PL_PARSER_RESULT_SUCCESS;
 }
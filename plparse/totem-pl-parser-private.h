@@ -63,6 +63,7 @@
 #include <gio/gio.h>
 #include <string.h>
 #include "xmlparser.h"
+#include "totem-pl-parser-entry.h"
 #else
 #include "totem-pl-parser-mini.h"
 #endif /* !TOTEM_PL_PARSER_MINI */
@@ -105,21 +106,37 @@
 	}							\
 }
 
+typedef struct _TotemPlParserSource TotemPlParserSource;
+typedef struct _TotemPlParserLineReader TotemPlParserLineReader;
+typedef struct _TotemPlParserIni TotemPlParserIni;
+
 typedef struct {
 	guint recurse_level;
+	/* The data read so far from the file currently being parsed,
+	 * shared between the type sniffing and the format handler */
+	TotemPlParserSource *source;
 	guint fallback : 1;
 	guint recurse : 1;
 	guint force : 1;
 	guint disable_unsafe : 1;
+#ifndef TOTEM_PL_PARSER_MINI
+	/* Where the entries go instead of ::entry-parsed,
+	 * see totem_pl_parser_parse_to_playlist() */
+	TotemPlPlaylist *playlist;
+#endif
 } TotemPlParseData;
 
 #ifndef TOTEM_PL_PARSER_MINI
-char *totem_pl_parser_read_ini_line_string	(char **lines, const char *key);
-int   totem_pl_parser_read_ini_line_int		(char **lines, const char *key);
-char *totem_pl_parser_read_ini_line_string_with_sep (char **lines, const char *key,
-						     const char *sep);
+TotemPlParserIni *totem_pl_parser_ini_new	(char *contents, char sep);
+void totem_pl_parser_ini_free			(TotemPlParserIni *ini);
+const char *totem_pl_parser_ini_get_string	(TotemPlParserIni *ini, const char *key);
+int   totem_pl_parser_ini_get_int		(TotemPlParserIni *ini, const char *key);
 gboolean totem_pl_parser_is_debugging_enabled	(TotemPlParser *parser);
 gboolean totem_pl_parser_get_recurse		(TotemPlParser *parser);
+void totem_pl_parser_get_feed_limits		(TotemPlParser *parser,
+						 guint *max_entries,
+						 guint64 *since,
+						 gboolean *metadata_only);
 char *totem_pl_parser_base_uri			(GFile *file);
 void totem_pl_parser_playlist_end		(TotemPlParser *parser,
 						 const char *playlist_title);
@@ -156,6 +173,15 @@ void totem_pl_parser_add_one_file		(TotemPlParser *parser,
 void totem_pl_parser_add_uri			(TotemPlParser *parser,
 						 const char *first_property_name,
 						 ...);
+void totem_pl_parser_add_entry			(TotemPlParser *parser,
+						 TotemPlParserEntry *entry,
+						 gboolean is_playlist);
+void totem_pl_parser_add_fields			(TotemPlParser *parser,
+						 GFile *file,
+						 GFile *base_file,
+						 gboolean is_playlist,
+						 const TotemPlParserField *fields,
+						 guint n_fields);
 void totem_pl_parser_add_hash_table		(TotemPlParser *parser,
 						 GHashTable    *metadata,
 						 const char    *uri,
@@ -164,6 +190,27 @@ gboolean totem_pl_parser_ignore			(TotemPlParser *parser,
 						 const char *uri);
 xml_node_t * totem_pl_parser_parse_xml_relaxed	(char *contents,
 						 gsize size);
+gboolean totem_pl_parser_stream_xml_relaxed	(char *contents,
+						 gsize size,
+						 int depth,
+						 const xml_parser_stream_t *stream,
+						 gpointer user_data);
+gboolean totem_pl_parser_load_contents		(TotemPlParseData *parse_data,
+						 GFile *file,
+						 char **contents,
+						 gsize *length);
+TotemPlParserLineReader * totem_pl_parser_line_reader_new (TotemPlParseData *parse_data,
+							  GFile *file,
+							  GError **error);
+void totem_pl_parser_line_reader_free		(TotemPlParserLineReader *reader);
+const char * totem_pl_parser_line_reader_peek	(TotemPlParserLineReader *reader,
+						 gsize size,
+						 GError **error);
+char * totem_pl_parser_line_reader_next		(TotemPlParserLineReader *reader,
+						 gboolean *dos_mode,
+						 GError **error);
+void totem_pl_playlist_append_entry		(TotemPlPlaylist *playlist,
+						 TotemPlParserEntry *entry);
 gboolean totem_pl_parser_fix_string		(const char  *name,
 						 const char  *value,
 						 char       **ret);
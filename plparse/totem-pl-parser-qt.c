@@ -71,42 +71,39 @@ totem_pl_parser_add_quicktime_rtsptext (TotemPlParser *parser,
 					TotemPlParseData *parse_data,
 					gpointer data)
 {
+	TotemPlParserIni *ini;
 	char *contents = NULL;
-	char *volume, *autoplay, *rtspuri;
-	gsize size;
-	char **lines;
+	const char *line;
+	char *rtspuri;
+	gsize size, len;
 
-	if (g_file_load_contents (file, NULL, &contents, &size, NULL, NULL) == FALSE)
+	if (totem_pl_parser_load_contents (parse_data, file, &contents, &size) == FALSE)
 		return TOTEM_PL_PARSER_RESULT_ERROR;
 
-	lines = g_strsplit_set (contents, "\r\n", 0);
-
-	volume = totem_pl_parser_read_ini_line_string_with_sep
-		(lines, "volume", "=");
-	autoplay = totem_pl_parser_read_ini_line_string_with_sep
-		(lines, "autoplay", "=");
-
-	rtspuri = g_strdup (lines[0] + strlen ("RTSPtext"));
-	if (rtspuri[0] == '\0') {
-		char **line;
-		g_free (rtspuri);
-
-		for (line = lines + 1; *line && *line[0] == '\0'; line++);
-		if (*line == NULL)
+	/* The URI follows the marker on the first line, or
+	 * is on the next non-empty line */
+	line = contents + strlen ("RTSPtext");
+	len = strcspn (line, "\r\n");
+	if (len == 0) {
+		line += strspn (line, "\r\n");
+		len = strcspn (line, "\r\n");
+		if (len == 0) {
+			g_free (contents);
 			return TOTEM_PL_PARSER_RESULT_ERROR;
-		rtspuri = g_strdup (*line);
+		}
 	}
+	rtspuri = g_strndup (line, len);
 	g_strstrip (rtspuri);
 
+	ini = totem_pl_parser_ini_new (contents, '=');
+
 	totem_pl_parser_add_uri (parser,
 				 TOTEM_PL_PARSER_FIELD_URI, rtspuri,
-				 TOTEM_PL_PARSER_FIELD_VOLUME, volume,
-				 TOTEM_PL_PARSER_FIELD_AUTOPLAY, autoplay,
+				 TOTEM_PL_PARSER_FIELD_VOLUME, totem_pl_parser_ini_get_string (ini, "volume"),
+				 TOTEM_PL_PARSER_FIELD_AUTOPLAY, totem_pl_parser_ini_get_string (ini, "autoplay"),
 				 NULL);
 	g_free (rtspuri);
-	g_free (volume);
-	g_free (autoplay);
-	g_strfreev (lines);
+	totem_pl_parser_ini_free (ini);
 
 	return TOTEM_PL_PARSER_RESULT_SUCCESS;
 }
@@ -131,7 +128,7 @@ totem_pl_parser_add_quicktime_metalink (TotemPlParser *parser,
 	if (g_str_has_prefix (data, "SMILtext") != FALSE) {
 		TotemPlParserResult retval;
 
-		if (g_file_load_contents (file, NULL, &contents, &size, NULL, NULL) == FALSE)
+		if (totem_pl_parser_load_contents (parse_data, file, &contents, &size) == FALSE)
 			return TOTEM_PL_PARSER_RESULT_ERROR;
 
 		retval = totem_pl_parser_add_smil_with_data (parser,
@@ -142,7 +139,7 @@ totem_pl_parser_add_quicktime_metalink (TotemPlParser *parser,
 		return retval;
 	}
 
-	if (g_file_load_contents (file, NULL, &contents, &size, NULL, NULL) == FALSE)
+	if (totem_pl_parser_load_contents (parse_data, file, &contents, &size) == FALSE)
 		return TOTEM_PL_PARSER_RESULT_ERROR;
 
 	doc = totem_pl_parser_parse_xml_relaxed (contents, size);
@@ -150,15 +147,12 @@ totem_pl_parser_add_quicktime_metalink (TotemPlParser *parser,
 		g_free (contents);
 		return TOTEM_PL_PARSER_RESULT_ERROR;
 	}
-	g_free (contents);
 
 	/* Check for quicktime type */
 	for (node = doc, found = FALSE; node != NULL; node = node->next) {
 		const char *type;
 
-		if (node->name == NULL)
-			continue;
-		if (g_ascii_strcasecmp (node->name , "?quicktime") != 0)
+		if (node->atom != XML_ATOM_PI_QUICKTIME)
 			continue;
 		type = xml_parser_get_property (node, "type");
 		if (g_ascii_strcasecmp ("application/x-quicktime-media-link", type) != 0)
@@ -168,18 +162,20 @@ totem_pl_parser_add_quicktime_metalink (TotemPlParser *parser,
 
 	if (found == FALSE) {
 		xml_parser_free_tree (doc);
+		g_free (contents);
 		return TOTEM_PL_PARSER_RESULT_ERROR;
 	}
 
-	if (!doc || !doc->name
-	    || g_ascii_strcasecmp (doc->name, "embed") != 0) {
+	if (!doc || doc->atom != XML_ATOM_EMBED) {
 		xml_parser_free_tree (doc);
+		g_free (contents);
 		return TOTEM_PL_PARSER_RESULT_ERROR;
 	}
 
 	item_uri = xml_parser_get_property (doc, "src");
 	if (!item_uri) {
 		xml_parser_free_tree (doc);
+		g_free (contents);
 		return TOTEM_PL_PARSER_RESULT_ERROR;
 	}
 
@@ -193,6 +189,7 @@ totem_pl_parser_add_quicktime_metalink (TotemPlParser *parser,
 				 TOTEM_PL_PARSER_FIELD_AUTOPLAY, autoplay,
 				 NULL);
 	xml_parser_free_tree (doc);
+	g_free (contents);
 
 	return TOTEM_PL_PARSER_RESULT_SUCCESS;
 }
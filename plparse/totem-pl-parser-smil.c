@@ -23,6 +23,7 @@
 #include "config.h"
 
 #ifndef TOTEM_PL_PARSER_MINI
+#include <string.h>
 #include <glib.h>
 
 #include <gio/gio.h>
@@ -75,6 +76,28 @@ parse_smil_entry_add (TotemPlParser *parser,
 	g_free (sub);
 }
 
+/* Properties of media nodes, looked up together */
+enum {
+	MEDIA_SRC,
+	MEDIA_TITLE,
+	MEDIA_AUTHOR,
+	MEDIA_DUR,
+	MEDIA_CLIP_BEGIN,
+	MEDIA_ABSTRACT,
+	MEDIA_COPYRIGHT,
+	NUM_MEDIA_PROPS
+};
+
+static const xml_atom_t media_props[NUM_MEDIA_PROPS] = {
+	[MEDIA_SRC] = XML_ATOM_SRC,
+	[MEDIA_TITLE] = XML_ATOM_TITLE,
+	[MEDIA_AUTHOR] = XML_ATOM_AUTHOR,
+	[MEDIA_DUR] = XML_ATOM_DUR,
+	[MEDIA_CLIP_BEGIN] = XML_ATOM_CLIP_BEGIN,
+	[MEDIA_ABSTRACT] = XML_ATOM_ABSTRACT,
+	[MEDIA_COPYRIGHT] = XML_ATOM_COPYRIGHT
+};
+
 static TotemPlParserResult
 parse_smil_entry (TotemPlParser *parser,
 		  GFile *base_file,
@@ -84,6 +107,7 @@ parse_smil_entry (TotemPlParser *parser,
 {
 	xml_node_t *node;
 	const char *title, *uri, *author, *abstract, *dur, *clip_begin, *copyright, *subtitle_uri;
+	const char *values[NUM_MEDIA_PROPS];
 	TotemPlParserResult retval = TOTEM_PL_PARSER_RESULT_ERROR;
 	gboolean added;
 
@@ -102,9 +126,10 @@ parse_smil_entry (TotemPlParser *parser,
 			continue;
 
 		/* ENTRY should only have one ref and one title nodes */
-		if (g_ascii_strcasecmp (node->name, "video") == 0
-		    || g_ascii_strcasecmp (node->name, "audio") == 0
-		    || g_ascii_strcasecmp (node->name, "media") == 0) {
+		switch (node->atom) {
+		case XML_ATOM_VIDEO:
+		case XML_ATOM_AUDIO:
+		case XML_ATOM_MEDIA:
 			/* Send the previous entry */
 			if (uri != NULL && added == FALSE) {
 				parse_smil_entry_add (parser,
@@ -121,21 +146,25 @@ parse_smil_entry (TotemPlParser *parser,
 				retval = TOTEM_PL_PARSER_RESULT_SUCCESS;
 			}
 
-			uri = xml_parser_get_property (node, "src");
-			title = xml_parser_get_property (node, "title");
-			author = xml_parser_get_property (node, "author");
-			dur = xml_parser_get_property (node, "dur");
-			clip_begin = xml_parser_get_property (node, "clip-begin");
-			abstract = xml_parser_get_property (node, "abstract");
-			copyright = xml_parser_get_property (node, "copyright");
+			xml_parser_get_properties (node, media_props, values, NUM_MEDIA_PROPS);
+			uri = values[MEDIA_SRC];
+			title = values[MEDIA_TITLE];
+			author = values[MEDIA_AUTHOR];
+			dur = values[MEDIA_DUR];
+			clip_begin = values[MEDIA_CLIP_BEGIN];
+			abstract = values[MEDIA_ABSTRACT];
+			copyright = values[MEDIA_COPYRIGHT];
 			subtitle_uri = NULL;
 			added = FALSE;
-		} else if (g_ascii_strcasecmp (node->name, "textstream") == 0) {
+			break;
+		case XML_ATOM_TEXTSTREAM:
 			subtitle_uri = xml_parser_get_property (node, "src");
-		} else {
+			break;
+		default:
 			if (parse_smil_entry (parser,
 						base_file, doc, node, parent_title) != FALSE)
 				retval = TOTEM_PL_PARSER_RESULT_SUCCESS;
+			break;
 		}
 	}
 
@@ -166,7 +195,7 @@ parse_smil_head (TotemPlParser *parser, xml_node_t *doc, xml_node_t *parent)
 	title = NULL;
 
 	for (node = parent->child; node != NULL; node = node->next) {
-		if (g_ascii_strcasecmp (node->name, "meta") == 0) {
+		if (node->atom == XML_ATOM_META) {
 			const char *prop;
 			prop = xml_parser_get_property (node, "name");
 			if (prop != NULL && g_ascii_strcasecmp (prop, "title") == 0) {
@@ -190,16 +219,13 @@ parse_smil_entries (TotemPlParser *parser, GFile *base_file, xml_node_t *doc)
 	title = NULL;
 
 	for (node = doc->child; node != NULL; node = node->next) {
-		if (node->name == NULL)
-			continue;
-
-		if (g_ascii_strcasecmp (node->name, "body") == 0) {
+		if (node->atom == XML_ATOM_BODY) {
 			if (parse_smil_entry (parser, base_file,
 					      doc, node, title) != FALSE) {
 				retval = TOTEM_PL_PARSER_RESULT_SUCCESS;
 			}
 		} else if (title == NULL) {
-			if (g_ascii_strcasecmp (node->name, "head") == 0)
+			if (node->atom == XML_ATOM_HEAD)
 				title = parse_smil_head (parser, doc, node);
 		}
 	}
@@ -214,8 +240,7 @@ totem_pl_parser_add_smil_with_doc (TotemPlParser *parser, GFile *file,
 	TotemPlParserResult retval = TOTEM_PL_PARSER_RESULT_UNHANDLED;
 
 	/* If the document has no root, or no name */
-	if(doc->name == NULL
-	   || g_ascii_strcasecmp (doc->name, "smil") != 0) {
+	if (doc->atom != XML_ATOM_SMIL) {
 		return TOTEM_PL_PARSER_RESULT_ERROR;
 	}
 
@@ -235,7 +260,7 @@ totem_pl_parser_add_smil (TotemPlParser *parser,
 	gsize size;
 	TotemPlParserResult retval;
 
-	if (g_file_load_contents (file, NULL, &contents, &size, NULL, NULL) == FALSE)
+	if (totem_pl_parser_load_contents (parse_data, file, &contents, &size) == FALSE)
 		return TOTEM_PL_PARSER_RESULT_ERROR;
 
 	retval = totem_pl_parser_add_smil_with_data (parser, file,
@@ -255,7 +280,10 @@ totem_pl_parser_add_smil_with_data (TotemPlParser *parser,
 	TotemPlParserResult retval;
 	char *contents_dup;
 
-	contents_dup = g_strndup (contents, size);
+	/* Not g_strndup(), UTF-16 text has embedded NULs */
+	contents_dup = g_malloc (size + 1);
+	memcpy (contents_dup, contents, size);
+	contents_dup[size] = '\0';
 	doc = totem_pl_parser_parse_xml_relaxed (contents_dup, size);
 	if (doc == NULL) {
 		g_free (contents_dup);
@@ -84,21 +84,23 @@ totem_pl_parser_add_asf_reference_parser (TotemPlParser *parser,
 					  TotemPlParseData *parse_data,
 					  gpointer data)
 {
-	char *contents, **lines, *ref;
+	TotemPlParserIni *ini;
+	char *contents, *ref;
+	const char *value;
 	gsize size;
 
-	if (g_file_load_contents (file, NULL, &contents, &size, NULL, NULL) == FALSE)
+	if (totem_pl_parser_load_contents (parse_data, file, &contents, &size) == FALSE)
 		return TOTEM_PL_PARSER_RESULT_ERROR;
 
-	lines = g_strsplit_set (contents, "\n\r", 0);
-	g_free (contents);
+	ini = totem_pl_parser_ini_new (contents, '=');
 
 	/* Try to get Ref1 first */
-	ref = totem_pl_parser_read_ini_line_string (lines, "Ref1");
-	if (ref == NULL) {
-		g_strfreev (lines);
+	value = totem_pl_parser_ini_get_string (ini, "Ref1");
+	if (value == NULL) {
+		totem_pl_parser_ini_free (ini);
 		return totem_pl_parser_add_asx (parser, file, base_file, parse_data, data);
 	}
+	ref = g_strdup (value);
 
 	/* change http to mmsh, thanks Microsoft */
 	if (g_str_has_prefix (ref, "http") != FALSE)
@@ -110,7 +112,7 @@ totem_pl_parser_add_asf_reference_parser (TotemPlParser *parser,
 	/* Don't try to get Ref2, as it's only ever
 	 * supposed to be a fallback */
 
-	g_strfreev (lines);
+	totem_pl_parser_ini_free (ini);
 
 	return TOTEM_PL_PARSER_RESULT_SUCCESS;
 }
@@ -134,7 +136,7 @@ totem_pl_parser_add_asf_parser (TotemPlParser *parser,
 		return totem_pl_parser_add_asf_reference_parser (parser, file, base_file, parse_data, data);
 	}
 
-	if (g_file_load_contents (file, NULL, &contents, &size, NULL, NULL) == FALSE)
+	if (totem_pl_parser_load_contents (parse_data, file, &contents, &size) == FALSE)
 		return TOTEM_PL_PARSER_RESULT_ERROR;
 
 	if (size <= 4) {
@@ -176,76 +178,57 @@ parse_asx_entry (TotemPlParser *parser, GFile *base_file, xml_node_t *parent, To
 	author = NULL;
 
 	for (node = parent->child; node != NULL; node = node->next) {
-		if (node->name == NULL)
-			continue;
-
-		/* ENTRY can only have one title node but multiple REFs */
-		if (g_ascii_strcasecmp (node->name, "ref") == 0) {
-			const char *tmp;
+		const char *tmp, *name;
 
+		switch (node->atom) {
+		case XML_ATOM_REF:
+			/* ENTRY can only have one title node but multiple REFs */
 			tmp = xml_parser_get_property (node, "href");
-			if (tmp == NULL)
-				continue;
 			/* FIXME, should we prefer mms streams, or non-mms?
 			 * See bug #352559 */
-			if (uri == NULL)
+			if (tmp != NULL && uri == NULL)
 				uri = tmp;
-
-			continue;
-		}
-
-		if (g_ascii_strcasecmp (node->name, "title") == 0)
+			break;
+		case XML_ATOM_TITLE:
 			title = node->data;
-
-		if (g_ascii_strcasecmp (node->name, "author") == 0)
+			break;
+		case XML_ATOM_AUTHOR:
 			author = node->data;
-
-		if (g_ascii_strcasecmp (node->name, "moreinfo") == 0) {
-			const char *tmp;
-
+			break;
+		case XML_ATOM_MOREINFO:
 			tmp = xml_parser_get_property (node, "href");
-			if (tmp == NULL)
-				continue;
-			moreinfo = tmp;
-		}
-
-		if (g_ascii_strcasecmp (node->name, "copyright") == 0)
+			if (tmp != NULL)
+				moreinfo = tmp;
+			break;
+		case XML_ATOM_COPYRIGHT:
 			copyright = node->data;
-
-		if (g_ascii_strcasecmp (node->name, "abstract") == 0)
+			break;
+		case XML_ATOM_ABSTRACT:
 			abstract = node->data;
-
-		if (g_ascii_strcasecmp (node->name, "duration") == 0) {
-			const char *tmp;
-
+			break;
+		case XML_ATOM_DURATION:
 			tmp = xml_parser_get_property (node, "value");
-			if (tmp == NULL)
-				continue;
-			duration = tmp;
-		}
-
-		if (g_ascii_strcasecmp (node->name, "starttime") == 0) {
-			const char *tmp;
-
+			if (tmp != NULL)
+				duration = tmp;
+			break;
+		case XML_ATOM_STARTTIME:
 			tmp = xml_parser_get_property (node, "value");
-			if (tmp == NULL)
-				continue;
-			starttime = tmp;
-		}
-
-		if (g_ascii_strcasecmp (node->name, "param") == 0) {
-			const char *name, *value;
-
+			if (tmp != NULL)
+				starttime = tmp;
+			break;
+		case XML_ATOM_PARAM:
 			name = xml_parser_get_property (node, "name");
 			if (name == NULL || g_ascii_strcasecmp (name, "showwhilebuffering") != 0)
-				continue;
-			value = xml_parser_get_property (node, "value");
-			if (value == NULL || g_ascii_strcasecmp (value, "true") != 0)
-				continue;
+				break;
+			tmp = xml_parser_get_property (node, "value");
+			if (tmp == NULL || g_ascii_strcasecmp (tmp, "true") != 0)
+				break;
 
 			/* We ignore items that are the buffering images */
 			retval = TOTEM_PL_PARSER_RESULT_IGNORED;
 			goto bail;
+		default:
+			break;
 		}
 	}
 
@@ -259,16 +242,17 @@ parse_asx_entry (TotemPlParser *parser, GFile *base_file, xml_node_t *parent, To
 	/* .asx files can contain references to other .asx files */
 	retval = totem_pl_parser_parse_internal (parser, resolved, NULL, parse_data);
 	if (retval != TOTEM_PL_PARSER_RESULT_SUCCESS) {
-		totem_pl_parser_add_uri (parser,
-					 TOTEM_PL_PARSER_FIELD_FILE, resolved,
-					 TOTEM_PL_PARSER_FIELD_TITLE, title,
-					 TOTEM_PL_PARSER_FIELD_ABSTRACT, abstract,
-					 TOTEM_PL_PARSER_FIELD_COPYRIGHT, copyright,
-					 TOTEM_PL_PARSER_FIELD_AUTHOR, author,
-					 TOTEM_PL_PARSER_FIELD_STARTTIME, starttime,
-					 TOTEM_PL_PARSER_FIELD_DURATION, duration,
-					 TOTEM_PL_PARSER_FIELD_MOREINFO, moreinfo,
-					 NULL);
+		TotemPlParserField fields[] = {
+			{ TOTEM_PL_FIELD_ID_TITLE, title },
+			{ TOTEM_PL_FIELD_ID_ABSTRACT, abstract },
+			{ TOTEM_PL_FIELD_ID_COPYRIGHT, copyright },
+			{ TOTEM_PL_FIELD_ID_AUTHOR, author },
+			{ TOTEM_PL_FIELD_ID_STARTTIME, starttime },
+			{ TOTEM_PL_FIELD_ID_DURATION, duration },
+			{ TOTEM_PL_FIELD_ID_MOREINFO, moreinfo }
+		};
+
+		totem_pl_parser_add_fields (parser, resolved, NULL, FALSE, fields, G_N_ELEMENTS (fields));
 		retval = TOTEM_PL_PARSER_RESULT_SUCCESS;
 	}
 	g_object_unref (resolved);
@@ -297,9 +281,7 @@ parse_asx_entryref (TotemPlParser *parser, GFile *base_file, xml_node_t *node, T
 	/* .asx files can contain references to other .asx files */
 	retval = totem_pl_parser_parse_internal (parser, resolved, NULL, parse_data);
 	if (retval != TOTEM_PL_PARSER_RESULT_SUCCESS) {
-		totem_pl_parser_add_uri (parser,
-					 TOTEM_PL_PARSER_FIELD_FILE, resolved,
-					 NULL);
+		totem_pl_parser_add_fields (parser, resolved, NULL, FALSE, NULL, 0);
 		retval = TOTEM_PL_PARSER_RESULT_SUCCESS;
 	}
 	g_object_unref (resolved);
@@ -319,18 +301,19 @@ parse_asx_entries (TotemPlParser *parser, const char *uri, GFile *base_file, xml
 
 	/* Loop to look for playlist information first */
 	for (node = parent->child; node != NULL; node = node->next) {
-		if (node->name == NULL)
-			continue;
-		if (g_ascii_strcasecmp (node->name, "title") == 0) {
+		if (node->atom == XML_ATOM_TITLE) {
 			g_free (title);
 			title = g_strdup (node->data);
-			totem_pl_parser_add_uri (parser,
-						 TOTEM_PL_PARSER_FIELD_IS_PLAYLIST, TRUE,
-						 TOTEM_PL_PARSER_FIELD_URI, uri,
-						 TOTEM_PL_PARSER_FIELD_TITLE, title,
-						 NULL);
+			{
+				TotemPlParserField fields[] = {
+					{ TOTEM_PL_FIELD_ID_URI, uri },
+					{ TOTEM_PL_FIELD_ID_TITLE, title }
+				};
+
+				totem_pl_parser_add_fields (parser, NULL, NULL, TRUE, fields, G_N_ELEMENTS (fields));
+			}
 		}
-		if (g_ascii_strcasecmp (node->name, "base") == 0) {
+		if (node->atom == XML_ATOM_BASE) {
 			const char *str;
 			str = xml_parser_get_property (node, "href");
 			if (str != NULL) {
@@ -343,23 +326,24 @@ parse_asx_entries (TotemPlParser *parser, const char *uri, GFile *base_file, xml
 
 	/* Restart for the entries now */
 	for (node = parent->child; node != NULL; node = node->next) {
-		if (node->name == NULL)
-			continue;
-
-		if (g_ascii_strcasecmp (node->name, "entry") == 0) {
+		switch (node->atom) {
+		case XML_ATOM_ENTRY:
 			/* Whee! found an entry here, find the REF and TITLE */
 			if (parse_asx_entry (parser, new_base ? new_base : base_file, node, parse_data) != FALSE)
 				retval = TOTEM_PL_PARSER_RESULT_SUCCESS;
-		}
-		if (g_ascii_strcasecmp (node->name, "entryref") == 0) {
+			break;
+		case XML_ATOM_ENTRYREF:
 			/* Found an entryref, extract the REF attribute */
 			if (parse_asx_entryref (parser, new_base ? new_base : base_file, node, parse_data) != FALSE)
 				retval = TOTEM_PL_PARSER_RESULT_SUCCESS;
-		}
-		if (g_ascii_strcasecmp (node->name, "repeat") == 0) {
+			break;
+		case XML_ATOM_REPEAT:
 			/* Repeat at the top-level */
 			if (parse_asx_entries (parser, uri, new_base ? new_base : base_file, node, parse_data) != FALSE)
 				retval = TOTEM_PL_PARSER_RESULT_SUCCESS;
+			break;
+		default:
+			break;
 		}
 	}
 
@@ -388,7 +372,7 @@ totem_pl_parser_add_asx (TotemPlParser *parser,
 		return totem_pl_parser_add_ram (parser, file, parse_data, data);
 	}
 
-	if (g_file_load_contents (file, NULL, &contents, &size, NULL, NULL) == FALSE)
+	if (totem_pl_parser_load_contents (parse_data, file, &contents, &size) == FALSE)
 		return TOTEM_PL_PARSER_RESULT_ERROR;
 
 	doc = totem_pl_parser_parse_xml_relaxed (contents, size);
@@ -398,8 +382,7 @@ totem_pl_parser_add_asx (TotemPlParser *parser,
 	}
 
 	/* If the document has no name */
-	if (doc->name == NULL
-	    || g_ascii_strcasecmp (doc->name , "asx") != 0) {
+	if (doc->atom != XML_ATOM_ASX) {
 		g_free (contents);
 		xml_parser_free_tree (doc);
 		return TOTEM_PL_PARSER_RESULT_ERROR;
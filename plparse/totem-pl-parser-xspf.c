@@ -28,6 +28,7 @@
 #include <glib/gi18n-lib.h>
 #include <libxml/tree.h>
 #include <libxml/parser.h>
+#include <libxml/xmlreader.h>
 
 #include "totem-pl-parser.h"
 #endif /* !TOTEM_PL_PARSER_MINI */
@@ -46,39 +47,6 @@ debug_noop (void *ctx, const char *msg, ...)
 	return;
 }
 
-static xmlDocPtr
-totem_pl_parser_parse_xml_file (GFile *file)
-{
-	xmlDocPtr doc;
-	char *contents;
-	gsize size;
-
-	if (g_file_load_contents (file, NULL, &contents, &size, NULL, NULL) == FALSE)
-		return NULL;
-
-	/* Try to remove HTML style comments */
-	{
-		char *needle;
-
-		while ((needle = strstr (contents, "<!--")) != NULL) {
-			while (strncmp (needle, "-->", 3) != 0) {
-				*needle = ' ';
-				needle++;
-				if (*needle == '\0')
-					break;
-			}
-		}
-	}
-
-	xmlSetGenericErrorFunc (NULL, (xmlGenericErrorFunc) debug_noop);
-	doc = xmlParseMemory (contents, size);
-	if (doc == NULL)
-		doc = xmlRecoverMemory (contents, size);
-	g_free (contents);
-
-	return doc;
-}
-
 static struct {
 	const char *field;
 	const char *element;
@@ -257,6 +225,7 @@ parse_xspf_track (TotemPlParser *parser, GFile *base_file, xmlDocPtr doc,
 	xmlChar *playing, *starttime;
 	GFile *resolved;
 	char *resolved_uri;
+	TotemPlParserField fields[15];
 	TotemPlParserResult retval = TOTEM_PL_PARSER_RESULT_ERROR;
 
 	title = NULL;
@@ -376,48 +345,48 @@ parse_xspf_track (TotemPlParser *parser, GFile *base_file, xmlDocPtr doc,
 		goto bail;
 	}
 
+	fields[0].id = TOTEM_PL_FIELD_ID_URI;
+	fields[0].value = (char *) uri;
+	fields[1].id = TOTEM_PL_FIELD_ID_TITLE;
+	fields[1].value = (char *) title;
+	fields[2].id = TOTEM_PL_FIELD_ID_DURATION_MS;
+	fields[2].value = (char *) duration;
+	fields[3].id = TOTEM_PL_FIELD_ID_IMAGE_URI;
+	fields[3].value = (char *) image_uri;
+	fields[4].id = TOTEM_PL_FIELD_ID_AUTHOR;
+	fields[4].value = (char *) artist;
+	fields[5].id = TOTEM_PL_FIELD_ID_ALBUM;
+	fields[5].value = (char *) album;
+	fields[6].id = TOTEM_PL_FIELD_ID_MOREINFO;
+	fields[6].value = (char *) moreinfo;
+	fields[7].id = TOTEM_PL_FIELD_ID_DOWNLOAD_URI;
+	fields[7].value = (char *) download_uri;
+	fields[8].id = TOTEM_PL_FIELD_ID_ID;
+	fields[8].value = (char *) id;
+	fields[9].id = TOTEM_PL_FIELD_ID_GENRE;
+	fields[9].value = (char *) genre;
+	fields[10].id = TOTEM_PL_FIELD_ID_FILESIZE;
+	fields[10].value = (char *) filesize;
+	fields[11].id = TOTEM_PL_FIELD_ID_SUBTITLE_URI;
+	fields[11].value = (char *) subtitle;
+	fields[12].id = TOTEM_PL_FIELD_ID_PLAYING;
+	fields[12].value = (char *) playing;
+	fields[13].id = TOTEM_PL_FIELD_ID_CONTENT_TYPE;
+	fields[13].value = (char *) mime_type;
+	fields[14].id = TOTEM_PL_FIELD_ID_STARTTIME;
+	fields[14].value = (char *) starttime;
+
 	resolved_uri = totem_pl_parser_resolve_uri (base_file, (char *) uri);
 
 	if (g_strcmp0 (resolved_uri, (char *) uri) == 0) {
 		g_free (resolved_uri);
-		totem_pl_parser_add_uri (parser,
-					 TOTEM_PL_PARSER_FIELD_URI, uri,
-					 TOTEM_PL_PARSER_FIELD_TITLE, title,
-					 TOTEM_PL_PARSER_FIELD_DURATION_MS, duration,
-					 TOTEM_PL_PARSER_FIELD_IMAGE_URI, image_uri,
-					 TOTEM_PL_PARSER_FIELD_AUTHOR, artist,
-					 TOTEM_PL_PARSER_FIELD_ALBUM, album,
-					 TOTEM_PL_PARSER_FIELD_MOREINFO, moreinfo,
-					 TOTEM_PL_PARSER_FIELD_DOWNLOAD_URI, download_uri,
-					 TOTEM_PL_PARSER_FIELD_ID, id,
-					 TOTEM_PL_PARSER_FIELD_GENRE, genre,
-					 TOTEM_PL_PARSER_FIELD_FILESIZE, filesize,
-					 TOTEM_PL_PARSER_FIELD_SUBTITLE_URI, subtitle,
-					 TOTEM_PL_PARSER_FIELD_PLAYING, playing,
-					 TOTEM_PL_PARSER_FIELD_CONTENT_TYPE, mime_type,
-					 TOTEM_PL_PARSER_FIELD_STARTTIME, starttime,
-					 NULL);
+		totem_pl_parser_add_fields (parser, NULL, NULL, FALSE, fields, G_N_ELEMENTS (fields));
 	} else {
 		resolved = g_file_new_for_uri (resolved_uri);
 		g_free (resolved_uri);
 
-		totem_pl_parser_add_uri (parser,
-					 TOTEM_PL_PARSER_FIELD_FILE, resolved,
-					 TOTEM_PL_PARSER_FIELD_TITLE, title,
-					 TOTEM_PL_PARSER_FIELD_DURATION_MS, duration,
-					 TOTEM_PL_PARSER_FIELD_IMAGE_URI, image_uri,
-					 TOTEM_PL_PARSER_FIELD_AUTHOR, artist,
-					 TOTEM_PL_PARSER_FIELD_ALBUM, album,
-					 TOTEM_PL_PARSER_FIELD_MOREINFO, moreinfo,
-					 TOTEM_PL_PARSER_FIELD_DOWNLOAD_URI, download_uri,
-					 TOTEM_PL_PARSER_FIELD_ID, id,
-					 TOTEM_PL_PARSER_FIELD_GENRE, genre,
-					 TOTEM_PL_PARSER_FIELD_FILESIZE, filesize,
-					 TOTEM_PL_PARSER_FIELD_SUBTITLE_URI, subtitle,
-					 TOTEM_PL_PARSER_FIELD_PLAYING, playing,
-					 TOTEM_PL_PARSER_FIELD_CONTENT_TYPE, mime_type,
-					 TOTEM_PL_PARSER_FIELD_STARTTIME, starttime,
-					 NULL);
+		/* Skip the URI field, the resolved file gives it */
+		totem_pl_parser_add_fields (parser, resolved, NULL, FALSE, fields + 1, G_N_ELEMENTS (fields) - 1);
 		g_object_unref (resolved);
 	}
 
@@ -438,92 +407,176 @@ bail:
 	return retval;
 }
 
+/* Whether the reader is on an element called @name */
 static gboolean
-parse_xspf_trackList (TotemPlParser *parser, GFile *base_file, xmlDocPtr doc,
-		xmlNodePtr parent)
+reader_at_element (xmlTextReaderPtr  reader,
+		   const char       *name)
 {
-	xmlNodePtr node;
-	TotemPlParserResult retval = TOTEM_PL_PARSER_RESULT_ERROR;
+	const xmlChar *local_name;
 
-	for (node = parent->children; node != NULL; node = node->next)
-	{
-		if (node->name == NULL)
-			continue;
+	if (xmlTextReaderNodeType (reader) != XML_READER_TYPE_ELEMENT)
+		return FALSE;
+	local_name = xmlTextReaderConstLocalName (reader);
+	return local_name != NULL && g_ascii_strcasecmp ((char *) local_name, name) == 0;
+}
+
+static void
+parse_xspf_started (TotemPlParser *parser,
+		    const char    *uri,
+		    const xmlChar *title)
+{
+	TotemPlParserField fields[] = {
+		{ TOTEM_PL_FIELD_ID_URI, uri },
+		{ TOTEM_PL_FIELD_ID_TITLE, (const char *) title },
+		{ TOTEM_PL_FIELD_ID_CONTENT_TYPE, "application/xspf+xml" }
+	};
+
+	totem_pl_parser_add_fields (parser, NULL, NULL, TRUE, fields, G_N_ELEMENTS (fields));
+}
+
+/* Recovers from errors, as xmlRecoverMemory() does */
+#define XSPF_READER_OPTIONS (XML_PARSE_RECOVER | XML_PARSE_NOERROR | XML_PARSE_NOWARNING)
+
+/* Returns a reader on the root element of @contents, if it is a
+ * <playlist>; comments and processing instructions may come before it */
+static xmlTextReaderPtr
+xspf_reader_new (const char *contents,
+		 gsize       size)
+{
+	xmlTextReaderPtr reader;
+	int ret;
+
+	xmlSetGenericErrorFunc (NULL, (xmlGenericErrorFunc) debug_noop);
+	reader = xmlReaderForMemory (contents, size, NULL, NULL, XSPF_READER_OPTIONS);
+	if (reader == NULL)
+		return NULL;
 
-		if (g_ascii_strcasecmp ((char *)node->name, "track") == 0)
-			if (parse_xspf_track (parser, base_file, doc, node) != FALSE)
-				retval = TOTEM_PL_PARSER_RESULT_SUCCESS;
+	while ((ret = xmlTextReaderRead (reader)) == 1 &&
+	       xmlTextReaderNodeType (reader) != XML_READER_TYPE_ELEMENT)
+		;
+	if (ret != 1 || reader_at_element (reader, "playlist") == FALSE) {
+		xmlFreeTextReader (reader);
+		return NULL;
 	}
 
-	return retval;
+	return reader;
 }
 
-static gboolean
-parse_xspf_entries (TotemPlParser *parser,
-		    GFile         *file,
-		    GFile         *base_file,
-		    xmlDocPtr      doc,
-		    xmlNodePtr     parent)
+/* Returns the text of the <title> element the reader is on */
+static xmlChar *
+xspf_reader_get_title (xmlTextReaderPtr reader)
 {
 	xmlNodePtr node;
-	TotemPlParserResult retval = TOTEM_PL_PARSER_RESULT_ERROR;
-	const xmlChar *title;
-	char *uri;
 
-	uri = g_file_get_uri (file);
-	title = NULL;
+	node = xmlTextReaderExpand (reader);
+	if (node == NULL)
+		return NULL;
+	return xmlNodeListGetString (node->doc, node->xmlChildrenNode, 1);
+}
 
-	/* We go through the list twice to avoid the playlist-started
-	 * signal being out of order */
+/* Looks for the playlist title anywhere in the header, skipping over
+ * the contents of the other elements without keeping them */
+static xmlChar *
+xspf_find_title (const char *contents,
+		 gsize       size)
+{
+	xmlTextReaderPtr reader;
+	xmlChar *title;
+	int ret;
 
-	for (node = parent->children; node != NULL; node = node->next) {
-		if (node->name == NULL)
-			continue;
+	reader = xspf_reader_new (contents, size);
+	if (reader == NULL)
+		return NULL;
 
-		if (g_ascii_strcasecmp ((char *)node->name, "title") == 0) {
-			title = xmlNodeListGetString (doc, node->xmlChildrenNode, 1);
+	title = NULL;
+	ret = xmlTextReaderRead (reader);
+	while (ret == 1 && xmlTextReaderDepth (reader) >= 1) {
+		if (reader_at_element (reader, "title")) {
+			title = xspf_reader_get_title (reader);
 			break;
 		}
+		ret = xmlTextReaderNext (reader);
 	}
 
-	totem_pl_parser_add_uri (parser,
-				 TOTEM_PL_PARSER_FIELD_IS_PLAYLIST, TRUE,
-				 TOTEM_PL_PARSER_FIELD_URI, uri,
-				 TOTEM_PL_PARSER_FIELD_TITLE, title,
-				 TOTEM_PL_PARSER_FIELD_CONTENT_TYPE, "application/xspf+xml",
-				 NULL);
+	xmlFreeTextReader (reader);
+	return title;
+}
 
-	for (node = parent->children; node != NULL; node = node->next) {
-		if (node->name == NULL)
-			continue;
+/* Each <track> is only expanded into a tree of its own, and passed on as
+ * soon as it is closed, so that the whole document is never in memory.
+ * Only the header before the first <trackList> is kept, for
+ * playlist-started, with the title, to come before the tracks. Documents
+ * with the title after the tracks are gone through a first time to find
+ * it. */
+static TotemPlParserResult
+parse_xspf_contents (TotemPlParser *parser,
+		     GFile         *file,
+		     GFile         *base_file,
+		     const char    *contents,
+		     gsize          size)
+{
+	xmlTextReaderPtr reader;
+	xmlChar *title;
+	char *uri;
+	gboolean started, in_track_list;
+	int ret;
+
+	reader = xspf_reader_new (contents, size);
+	if (reader == NULL)
+		return TOTEM_PL_PARSER_RESULT_ERROR;
+
+	uri = g_file_get_uri (file);
+	title = NULL;
+	started = FALSE;
+	in_track_list = FALSE;
+
+	ret = xmlTextReaderRead (reader);
+	while (ret == 1) {
+		int depth;
+
+		depth = xmlTextReaderDepth (reader);
+		if (depth == 1 && xmlTextReaderNodeType (reader) == XML_READER_TYPE_ELEMENT) {
+			in_track_list = FALSE;
+
+			if (reader_at_element (reader, "title")) {
+				if (title == NULL && started == FALSE)
+					title = xspf_reader_get_title (reader);
+				ret = xmlTextReaderNext (reader);
+				continue;
+			}
 
-		if (g_ascii_strcasecmp ((char *)node->name, "trackList") == 0) {
-			if (parse_xspf_trackList (parser, base_file, doc, node) != FALSE)
-				retval = TOTEM_PL_PARSER_RESULT_SUCCESS;
+			if (reader_at_element (reader, "trackList")) {
+				if (started == FALSE) {
+					if (title == NULL)
+						title = xspf_find_title (contents, size);
+					parse_xspf_started (parser, uri, title);
+					started = TRUE;
+				}
+				in_track_list = !xmlTextReaderIsEmptyElement (reader);
+			}
+		} else if (depth == 2 && in_track_list && reader_at_element (reader, "track")) {
+			xmlNodePtr node;
+
+			/* The tree goes away when the reader moves past it */
+			node = xmlTextReaderExpand (reader);
+			if (node != NULL)
+				parse_xspf_track (parser, base_file, node->doc, node);
+			ret = xmlTextReaderNext (reader);
+			continue;
 		}
-	}
 
-	if (uri != NULL) {
-		totem_pl_parser_playlist_end (parser, uri);
-		g_free (uri);
+		ret = xmlTextReaderRead (reader);
 	}
 
-	SAFE_FREE (title);
+	if (started == FALSE)
+		parse_xspf_started (parser, uri, title);
+	totem_pl_parser_playlist_end (parser, uri);
 
-	return retval;
-}
+	g_free (uri);
+	SAFE_FREE (title);
+	xmlFreeTextReader (reader);
 
-static gboolean
-is_xspf_doc (xmlDocPtr doc)
-{
-	/* If the document has no root, or no name */
-	if(!doc ||
-	   !doc->children ||
-	   !doc->children->name ||
-	   g_ascii_strcasecmp ((char *)doc->children->name, "playlist") != 0) {
-		return FALSE;
-	}
-	return TRUE;
+	return TOTEM_PL_PARSER_RESULT_SUCCESS;
 }
 
 TotemPlParserResult
@@ -533,28 +586,7 @@ totem_pl_parser_add_xspf_with_contents (TotemPlParser *parser,
 					const char *contents,
 					TotemPlParseData *parse_data)
 {
-	xmlDocPtr doc;
-	xmlNodePtr node;
-	TotemPlParserResult retval = TOTEM_PL_PARSER_RESULT_UNHANDLED;
-
-	xmlSetGenericErrorFunc (NULL, (xmlGenericErrorFunc) debug_noop);
-	doc = xmlParseMemory (contents, strlen (contents));
-	if (doc == NULL)
-		doc = xmlRecoverMemory (contents, strlen (contents));
-
-	if (is_xspf_doc (doc) == FALSE) {
-		if (doc != NULL)
-			xmlFreeDoc(doc);
-		return TOTEM_PL_PARSER_RESULT_ERROR;
-	}
-
-	for (node = doc->children; node != NULL; node = node->next) {
-		if (parse_xspf_entries (parser, file, base_file, doc, node) != FALSE)
-			retval = TOTEM_PL_PARSER_RESULT_SUCCESS;
-	}
-
-	xmlFreeDoc(doc);
-	return retval;
+	return parse_xspf_contents (parser, file, base_file, contents, strlen (contents));
 }
 
 TotemPlParserResult
@@ -564,23 +596,16 @@ totem_pl_parser_add_xspf (TotemPlParser *parser,
 			  TotemPlParseData *parse_data,
 			  gpointer data)
 {
-	xmlDocPtr doc;
-	xmlNodePtr node;
-	TotemPlParserResult retval = TOTEM_PL_PARSER_RESULT_UNHANDLED;
+	TotemPlParserResult retval;
+	char *contents;
+	gsize size;
 
-	doc = totem_pl_parser_parse_xml_file (file);
-	if (is_xspf_doc (doc) == FALSE) {
-		if (doc != NULL)
-			xmlFreeDoc(doc);
+	if (totem_pl_parser_load_contents (parse_data, file, &contents, &size) == FALSE)
 		return TOTEM_PL_PARSER_RESULT_ERROR;
-	}
 
-	for (node = doc->children; node != NULL; node = node->next) {
-		if (parse_xspf_entries (parser, file, base_file, doc, node) != FALSE)
-			retval = TOTEM_PL_PARSER_RESULT_SUCCESS;
-	}
+	retval = parse_xspf_contents (parser, file, base_file, contents, size);
+	g_free (contents);
 
-	xmlFreeDoc(doc);
 	return retval;
 }
 #endif /* !TOTEM_PL_PARSER_MINI */
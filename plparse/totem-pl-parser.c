@@ -131,7 +131,6 @@
 #include <gio/gio.h>
 
 #ifndef TOTEM_PL_PARSER_MINI
-#include <gobject/gvaluecollector.h>
 #ifdef HAVE_UCHARDET
 #include <uchardet.h>
 #endif
@@ -139,6 +138,7 @@
 #include "totem-pl-parser.h"
 #include "totemplparser-marshal.h"
 #include "totem-disc.h"
+#include "totem-pl-parser-cache.h"
 #endif /* !TOTEM_PL_PARSER_MINI */
 
 #include "totem-pl-parser-mini.h"
@@ -159,6 +159,9 @@
 
 #define READ_CHUNK_SIZE 8192
 #define RECURSE_LEVEL_MAX 4
+/* Playlists bigger than this aren't cached, so that their entries
+ * don't take too much memory */
+#define CACHE_MAX_SIZE (16 * 1024 * 1024)
 #define ILLEGAL_CONTEXT_LENGTH 20
 
 #define D(x) if (debug) x
@@ -266,10 +269,24 @@ struct TotemPlParserPrivate {
 	GMutex ignore_mutex;
 	GThread *main_thread; /* see CALL_ASYNC() in *-private.h */
 
+	GMutex batch_mutex;
+	GPtrArray *batch; /* entries not yet sent with ::entries-parsed */
+	gint64 batch_start;
+	GSource *batch_source; /* sends a partial batch after batch_timeout */
+	guint batch_size;
+	guint batch_timeout;
+
+	guint max_entries;
+	guint64 since;
+
+	TotemPlParserCache *cache; /* see TotemPlParser:cache */
+
 	guint recurse : 1;
 	guint debug : 1;
 	guint force : 1;
 	guint disable_unsafe : 1;
+	guint metadata_only : 1;
+	guint use_cache : 1;
 };
 
 enum {
@@ -277,22 +294,31 @@ enum {
 	PROP_RECURSE,
 	PROP_DEBUG,
 	PROP_FORCE,
-	PROP_DISABLE_UNSAFE
+	PROP_DISABLE_UNSAFE,
+	PROP_BATCH_SIZE,
+	PROP_BATCH_TIMEOUT,
+	PROP_MAX_ENTRIES,
+	PROP_SINCE,
+	PROP_METADATA_ONLY,
+	PROP_CACHE
 };
 
 /* Signals */
 enum {
 	ENTRY_PARSED,
+	ENTRIES_PARSED,
 	PLAYLIST_STARTED,
 	PLAYLIST_ENDED,
 	LAST_SIGNAL
 };
 
 static int totem_pl_parser_table_signals[LAST_SIGNAL];
-static GParamSpecPool *totem_pl_parser_pspec_pool = NULL;
+
+/* The parse operation running in this thread, as the format handlers
+ * don't pass it on when adding entries */
+static GPrivate current_parse_data = G_PRIVATE_INIT (NULL);
 
 static void totem_pl_parser_class_init (TotemPlParserClass *klass);
-static void totem_pl_parser_base_class_finalize	(TotemPlParserClass *klass);
 static void totem_pl_parser_init       (TotemPlParser *parser);
 static void totem_pl_parser_finalize   (GObject *object);
 
@@ -309,7 +335,7 @@ totem_pl_parser_get_type (void)
 		const GTypeInfo g_define_type_info = {
 			sizeof (TotemPlParserClass),
 			NULL,
-			(GBaseFinalizeFunc) totem_pl_parser_base_class_finalize,
+			NULL,
 			(GClassInitFunc) totem_pl_parser_class_init,
 			NULL,
 			NULL,
@@ -326,7 +352,6 @@ totem_pl_parser_get_type (void)
 static void
 totem_pl_parser_class_init (TotemPlParserClass *klass)
 {
-	GParamSpec *pspec;
 	GObjectClass *object_class = G_OBJECT_CLASS (klass);
 
 	totem_pl_parser_parent_class = g_type_class_peek_parent (klass);
@@ -393,6 +418,121 @@ totem_pl_parser_class_init (TotemPlParserClass *klass)
 							       FALSE,
 							       G_PARAM_READWRITE));
 
+	/**
+	 * TotemPlParser:batch-size:
+	 *
+	 * If non-zero, the parsed entries will be delivered in blocks of up to
+	 * this many entries through the #TotemPlParser::entries-parsed signal,
+	 * instead of one by one through #TotemPlParser::entry-parsed. This
+	 * avoids scheduling one idle callback per entry when parsing very large
+	 * playlists asynchronously.
+	 *
+	 * Since: 3.26.7
+	 **/
+	g_object_class_install_property (object_class,
+					 PROP_BATCH_SIZE,
+					 g_param_spec_uint ("batch-size",
+							    "batch-size",
+							    "Maximum number of entries to deliver at once, or 0 to deliver them one by one",
+							    0, G_MAXUINT, 0,
+							    G_PARAM_READWRITE));
+
+	/**
+	 * TotemPlParser:batch-timeout:
+	 *
+	 * When #TotemPlParser:batch-size is set, the maximum time in
+	 * milliseconds an entry will be held back waiting for the block
+	 * to fill up. Partial blocks are then sent from the default main
+	 * context, so when parsing synchronously from the main thread, they
+	 * are only sent once the next entry is added after that time. If 0,
+	 * blocks are only sent when full, or when a playlist starts or ends.
+	 *
+	 * Since: 3.26.7
+	 **/
+	g_object_class_install_property (object_class,
+					 PROP_BATCH_TIMEOUT,
+					 g_param_spec_uint ("batch-timeout",
+							    "batch-timeout",
+							    "Maximum time in milliseconds before a partial block of entries is delivered",
+							    0, G_MAXUINT, 0,
+							    G_PARAM_READWRITE));
+
+	/**
+	 * TotemPlParser:max-entries:
+	 *
+	 * If non-zero, RSS and Atom feeds stop being parsed once this many
+	 * entries were added from them. As feeds list their newest entries
+	 * first, this is useful to only refresh the latest episodes of a
+	 * podcast without going through its whole back catalogue.
+	 *
+	 * Since: 3.26.7
+	 **/
+	g_object_class_install_property (object_class,
+					 PROP_MAX_ENTRIES,
+					 g_param_spec_uint ("max-entries",
+							    "max-entries",
+							    "Maximum number of entries to add from a feed, or 0 for all of them",
+							    0, G_MAXUINT, 0,
+							    G_PARAM_READWRITE));
+
+	/**
+	 * TotemPlParser:since:
+	 *
+	 * If non-zero, a date in seconds since the UNIX Epoch: RSS and Atom
+	 * feeds stop being parsed at the first entry published before it.
+	 * Entries without a publication date, or with one that can't be
+	 * parsed, are always added.
+	 *
+	 * Since: 3.26.7
+	 **/
+	g_object_class_install_property (object_class,
+					 PROP_SINCE,
+					 g_param_spec_uint64 ("since",
+							      "since",
+							      "Date of the oldest feed entries to add, in seconds since the UNIX Epoch, or 0 for all of them",
+							      0, G_MAXUINT64, 0,
+							      G_PARAM_READWRITE));
+
+	/**
+	 * TotemPlParser:metadata-only:
+	 *
+	 * If %TRUE, RSS, Atom and OPML feeds stop being parsed as soon as
+	 * their metadata was found, before their first entry: only the
+	 * #TotemPlParser::playlist-started signal, and for RSS and Atom the
+	 * #TotemPlParser::playlist-ended signal, are emitted for them. This
+	 * is useful to list subscriptions without reading all their entries.
+	 *
+	 * Since: 3.26.7
+	 **/
+	g_object_class_install_property (object_class,
+					 PROP_METADATA_ONLY,
+					 g_param_spec_boolean ("metadata-only",
+							       "metadata-only",
+							       "Whether or not to stop parsing feeds after their metadata",
+							       FALSE,
+							       G_PARAM_READWRITE));
+
+	/**
+	 * TotemPlParser:cache:
+	 *
+	 * If %TRUE, the entries sent for each playlist parsed are kept, and
+	 * sent again without parsing the playlist when it is parsed with the
+	 * same options and hasn't changed since. Playlists are considered
+	 * unchanged when their modification time and size are, so remote
+	 * playlists are only sent from the cache when their modification
+	 * time is known. Playlists including other playlists aren't cached,
+	 * and setting this property to %FALSE empties the cache.
+	 *
+	 * Since: 3.26.7
+	 **/
+	g_object_class_install_property (object_class,
+					 PROP_CACHE,
+					 g_param_spec_boolean ("cache",
+							       "cache",
+							       "Whether or not to send the entries of unchanged playlists from a cache",
+							       FALSE,
+							       G_PARAM_READWRITE));
+
 	/**
 	 * TotemPlParser::entry-parsed:
 	 * @parser: the object which received the signal
@@ -409,6 +549,28 @@ totem_pl_parser_class_init (TotemPlParserClass *klass)
 			      NULL, NULL,
 			      _totemplparser_marshal_VOID__STRING_BOXED,
 			      G_TYPE_NONE, 2, G_TYPE_STRING, G_TYPE_HASH_TABLE);
+	/**
+	 * TotemPlParser::entries-parsed:
+	 * @parser: the object which received the signal
+	 * @uris: (element-type utf8): a #GPtrArray of the URIs of the entries parsed
+	 * @metadata: (element-type GHashTable): a #GPtrArray of #GHashTable of metadata, one for each entry in @uris
+	 *
+	 * The ::entries-parsed signal is emitted with a block of newly parsed
+	 * entries when #TotemPlParser:batch-size is non-zero, in place of the
+	 * #TotemPlParser::entry-parsed signal. All the entries of a playlist are
+	 * delivered after its #TotemPlParser::playlist-started signal, and before
+	 * its #TotemPlParser::playlist-ended signal.
+	 *
+	 * Since: 3.26.7
+	 */
+	totem_pl_parser_table_signals[ENTRIES_PARSED] =
+		g_signal_new ("entries-parsed",
+			      G_TYPE_FROM_CLASS (klass),
+			      G_SIGNAL_RUN_LAST,
+			      0,
+			      NULL, NULL,
+			      _totemplparser_marshal_VOID__BOXED_BOXED,
+			      G_TYPE_NONE, 2, G_TYPE_PTR_ARRAY, G_TYPE_PTR_ARRAY);
 	/**
 	 * TotemPlParser::playlist-started:
 	 * @parser: the object which received the signal
@@ -446,160 +608,6 @@ totem_pl_parser_class_init (TotemPlParserClass *klass)
 			      NULL, NULL,
 			      g_cclosure_marshal_VOID__STRING,
 			      G_TYPE_NONE, 1, G_TYPE_STRING);
-
-	/* param specs */
-	totem_pl_parser_pspec_pool = g_param_spec_pool_new (FALSE);
-	pspec = g_param_spec_string ("url", "url",
-				     "URI to be added", NULL,
-				     G_PARAM_READABLE & G_PARAM_WRITABLE);
-	g_param_spec_pool_insert (totem_pl_parser_pspec_pool, pspec, TOTEM_TYPE_PL_PARSER);
-	pspec = g_param_spec_string ("title", "title",
-				     "Title of the item to be added", NULL,
-				     G_PARAM_READABLE & G_PARAM_WRITABLE);
-	g_param_spec_pool_insert (totem_pl_parser_pspec_pool, pspec, TOTEM_TYPE_PL_PARSER);
-	pspec = g_param_spec_string ("author", "author",
-				     "Author of the item to be added", NULL,
-				     G_PARAM_READABLE & G_PARAM_WRITABLE);
-	g_param_spec_pool_insert (totem_pl_parser_pspec_pool, pspec, TOTEM_TYPE_PL_PARSER);
-	pspec = g_param_spec_string ("genre", "genre",
-				     "Primary genre of the item to be added", NULL,
-				     G_PARAM_READABLE & G_PARAM_WRITABLE);
-	g_param_spec_pool_insert (totem_pl_parser_pspec_pool, pspec, TOTEM_TYPE_PL_PARSER);
-	pspec = g_param_spec_string ("genres", "genres",
-				     "Full genre of the item to be added", NULL,
-				     G_PARAM_READABLE & G_PARAM_WRITABLE);
-	g_param_spec_pool_insert (totem_pl_parser_pspec_pool, pspec, TOTEM_TYPE_PL_PARSER);
-	pspec = g_param_spec_string ("album", "album",
-				     "Album of the item to be added", NULL,
-				     G_PARAM_READABLE & G_PARAM_WRITABLE);
-	g_param_spec_pool_insert (totem_pl_parser_pspec_pool, pspec, TOTEM_TYPE_PL_PARSER);
-	pspec = g_param_spec_string ("base", "base",
-				     "Base URI of the item to be added", NULL,
-				     G_PARAM_READABLE & G_PARAM_WRITABLE);
-	g_param_spec_pool_insert (totem_pl_parser_pspec_pool, pspec, TOTEM_TYPE_PL_PARSER);
-	pspec = g_param_spec_string ("volume", "volume",
-				     "Default playback volume (in percents)", NULL,
-				     G_PARAM_READABLE & G_PARAM_WRITABLE);
-	g_param_spec_pool_insert (totem_pl_parser_pspec_pool, pspec, TOTEM_TYPE_PL_PARSER);
-	pspec = g_param_spec_string ("autoplay", "autoplay",
-				     "Whether or not to autoplay the stream", NULL,
-				     G_PARAM_READABLE & G_PARAM_WRITABLE);
-	g_param_spec_pool_insert (totem_pl_parser_pspec_pool, pspec, TOTEM_TYPE_PL_PARSER);
-	pspec = g_param_spec_string ("duration", "duration",
-				     "String representing the duration of the entry", NULL,
-				     G_PARAM_READABLE & G_PARAM_WRITABLE);
-	g_param_spec_pool_insert (totem_pl_parser_pspec_pool, pspec, TOTEM_TYPE_PL_PARSER);
-	pspec = g_param_spec_string ("duration-ms", "duration-ms",
-				     "String representing the duration of the entry in milliseconds", NULL,
-				     G_PARAM_READABLE & G_PARAM_WRITABLE);
-	g_param_spec_pool_insert (totem_pl_parser_pspec_pool, pspec, TOTEM_TYPE_PL_PARSER);
-	pspec = g_param_spec_string ("starttime", "starttime",
-				     "String representing the start time of the stream (initial seek)", NULL,
-				     G_PARAM_READABLE & G_PARAM_WRITABLE);
-	g_param_spec_pool_insert (totem_pl_parser_pspec_pool, pspec, TOTEM_TYPE_PL_PARSER);
-	pspec = g_param_spec_string ("copyright", "copyright",
-				     "Copyright of the item to be added", NULL,
-				     G_PARAM_READABLE & G_PARAM_WRITABLE);
-	g_param_spec_pool_insert (totem_pl_parser_pspec_pool, pspec, TOTEM_TYPE_PL_PARSER);
-	pspec = g_param_spec_string ("abstract", "abstract",
-				     "Abstract of the item to be added", NULL,
-				     G_PARAM_READABLE & G_PARAM_WRITABLE);
-	g_param_spec_pool_insert (totem_pl_parser_pspec_pool, pspec, TOTEM_TYPE_PL_PARSER);
-	pspec = g_param_spec_string ("moreinfo", "moreinfo",
-				     "URI to get more information for item to be added", NULL,
-				     G_PARAM_READABLE & G_PARAM_WRITABLE);
-	g_param_spec_pool_insert (totem_pl_parser_pspec_pool, pspec, TOTEM_TYPE_PL_PARSER);
-	pspec = g_param_spec_string ("screensize", "screensize",
-				     "String representing the default movie size (double, full or original)", NULL,
-				     G_PARAM_READABLE & G_PARAM_WRITABLE);
-	g_param_spec_pool_insert (totem_pl_parser_pspec_pool, pspec, TOTEM_TYPE_PL_PARSER);
-	pspec = g_param_spec_string ("ui-mode", "ui-mode",
-				     "String representing the default UI mode (only compact is supported)", NULL,
-				     G_PARAM_READABLE & G_PARAM_WRITABLE);
-	g_param_spec_pool_insert (totem_pl_parser_pspec_pool, pspec, TOTEM_TYPE_PL_PARSER);
-	pspec = g_param_spec_string ("endtime", "endtime",
-				     "String representing the end time of the stream", NULL,
-				     G_PARAM_READABLE & G_PARAM_WRITABLE);
-	g_param_spec_pool_insert (totem_pl_parser_pspec_pool, pspec, TOTEM_TYPE_PL_PARSER);
-	pspec = g_param_spec_boolean ("is-playlist", "is-playlist",
-				      "Boolean saying whether the entry pushed is the top-level of a playlist", FALSE,
-				      G_PARAM_READABLE & G_PARAM_WRITABLE);
-	g_param_spec_pool_insert (totem_pl_parser_pspec_pool, pspec, TOTEM_TYPE_PL_PARSER);
-	pspec = g_param_spec_string ("description", "description",
-				     "String representing the description of the stream", NULL,
-				     G_PARAM_READABLE & G_PARAM_WRITABLE);
-	g_param_spec_pool_insert (totem_pl_parser_pspec_pool, pspec, TOTEM_TYPE_PL_PARSER);
-	pspec = g_param_spec_string ("publication-date", "publication-date",
-				     "String representing the publication date of the stream", NULL,
-				     G_PARAM_READABLE & G_PARAM_WRITABLE);
-	g_param_spec_pool_insert (totem_pl_parser_pspec_pool, pspec, TOTEM_TYPE_PL_PARSER);
-	pspec = g_param_spec_string ("filesize", "filesize",
-				     "String representing the filesize of a file", NULL,
-				     G_PARAM_READABLE & G_PARAM_WRITABLE);
-	g_param_spec_pool_insert (totem_pl_parser_pspec_pool, pspec, TOTEM_TYPE_PL_PARSER);
-	pspec = g_param_spec_string ("language", "language",
-				     "String representing the language of a stream", NULL,
-				     G_PARAM_READABLE & G_PARAM_WRITABLE);
-	g_param_spec_pool_insert (totem_pl_parser_pspec_pool, pspec, TOTEM_TYPE_PL_PARSER);
-	pspec = g_param_spec_string ("contact", "contact",
-				     "String representing the contact for a playlist", NULL,
-				     G_PARAM_READABLE & G_PARAM_WRITABLE);
-	g_param_spec_pool_insert (totem_pl_parser_pspec_pool, pspec, TOTEM_TYPE_PL_PARSER);
-	pspec = g_param_spec_string ("image-url", "image-url",
-				     "String representing the location of an image for a playlist", NULL,
-				     G_PARAM_READABLE & G_PARAM_WRITABLE);
-	g_param_spec_pool_insert (totem_pl_parser_pspec_pool, pspec, TOTEM_TYPE_PL_PARSER);
-	pspec = g_param_spec_object ("gfile-object", "gfile-object",
-				     "Object representing the GFile for an entry", G_TYPE_FILE,
-				     G_PARAM_READABLE & G_PARAM_WRITABLE);
-	g_param_spec_pool_insert (totem_pl_parser_pspec_pool, pspec, TOTEM_TYPE_PL_PARSER);
-	pspec = g_param_spec_object ("gfile-object-base", "gfile-object-base",
-				     "Object representing the GFile for base URI of an entry", G_TYPE_FILE,
-				     G_PARAM_READABLE & G_PARAM_WRITABLE);
-	g_param_spec_pool_insert (totem_pl_parser_pspec_pool, pspec, TOTEM_TYPE_PL_PARSER);
-	pspec = g_param_spec_string ("download-url", "download-url",
-				     "String representing the location of a download URI", NULL,
-				     G_PARAM_READABLE & G_PARAM_WRITABLE);
-	g_param_spec_pool_insert (totem_pl_parser_pspec_pool, pspec, TOTEM_TYPE_PL_PARSER);
-	pspec = g_param_spec_string ("id", "id",
-				     "String representing the identifier for an entry", NULL,
-				     G_PARAM_READABLE & G_PARAM_WRITABLE);
-	g_param_spec_pool_insert (totem_pl_parser_pspec_pool, pspec, TOTEM_TYPE_PL_PARSER);
-	pspec = g_param_spec_string ("subtitle-uri", "subtitle-uri",
-				     "Subtitle URI to be added", NULL,
-				     G_PARAM_READABLE & G_PARAM_WRITABLE);
-	g_param_spec_pool_insert (totem_pl_parser_pspec_pool, pspec, TOTEM_TYPE_PL_PARSER);
-	pspec = g_param_spec_string ("content-type", "content-type",
-				     "Content type for the video stream", NULL,
-				     G_PARAM_READABLE & G_PARAM_WRITABLE);
-	g_param_spec_pool_insert (totem_pl_parser_pspec_pool, pspec, TOTEM_TYPE_PL_PARSER);
-	pspec = g_param_spec_string ("playing", "playing",
-				     "Whether the track is playing", NULL,
-				     G_PARAM_READABLE & G_PARAM_WRITABLE);
-	g_param_spec_pool_insert (totem_pl_parser_pspec_pool, pspec, TOTEM_TYPE_PL_PARSER);
-	pspec = g_param_spec_string ("audio-track", "audio-track",
-				     "The default audio-track to play", NULL,
-				     G_PARAM_READABLE & G_PARAM_WRITABLE);
-	g_param_spec_pool_insert (totem_pl_parser_pspec_pool, pspec, TOTEM_TYPE_PL_PARSER);
-	pspec = g_param_spec_string ("content-rating", "content-rating",
-				     "String representing the content rating for an entry", TOTEM_PL_PARSER_CONTENT_RATING_UNRATED,
-				     G_PARAM_READABLE & G_PARAM_WRITABLE);
-	g_param_spec_pool_insert (totem_pl_parser_pspec_pool, pspec, TOTEM_TYPE_PL_PARSER);
-}
-
-static void
-totem_pl_parser_base_class_finalize (TotemPlParserClass *klass)
-{
-	GList *list, *node;
-
-	list = g_param_spec_pool_list_owned (totem_pl_parser_pspec_pool, G_OBJECT_CLASS_TYPE (klass));
-	for (node = list; node; node = node->next) {
-		GParamSpec *pspec = node->data;
-
-		g_param_spec_pool_remove (totem_pl_parser_pspec_pool, pspec);
-		g_param_spec_unref (pspec);
-	}
-	g_list_free (list);
 }
 
 static void
@@ -624,6 +632,26 @@ totem_pl_parser_set_property (GObject *object,
 	case PROP_DISABLE_UNSAFE:
 		parser->priv->disable_unsafe = g_value_get_boolean (value) != FALSE;
 		break;
+	case PROP_BATCH_SIZE:
+		parser->priv->batch_size = g_value_get_uint (value);
+		break;
+	case PROP_BATCH_TIMEOUT:
+		parser->priv->batch_timeout = g_value_get_uint (value);
+		break;
+	case PROP_MAX_ENTRIES:
+		parser->priv->max_entries = g_value_get_uint (value);
+		break;
+	case PROP_SINCE:
+		parser->priv->since = g_value_get_uint64 (value);
+		break;
+	case PROP_METADATA_ONLY:
+		parser->priv->metadata_only = g_value_get_boolean (value) != FALSE;
+		break;
+	case PROP_CACHE:
+		parser->priv->use_cache = g_value_get_boolean (value) != FALSE;
+		if (parser->priv->use_cache == FALSE)
+			totem_pl_parser_cache_clear (parser->priv->cache);
+		break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
 		break;
@@ -652,6 +680,24 @@ totem_pl_parser_get_property (GObject *object,
 	case PROP_DISABLE_UNSAFE:
 		g_value_set_boolean (value, parser->priv->disable_unsafe);
 		break;
+	case PROP_BATCH_SIZE:
+		g_value_set_uint (value, parser->priv->batch_size);
+		break;
+	case PROP_BATCH_TIMEOUT:
+		g_value_set_uint (value, parser->priv->batch_timeout);
+		break;
+	case PROP_MAX_ENTRIES:
+		g_value_set_uint (value, parser->priv->max_entries);
+		break;
+	case PROP_SINCE:
+		g_value_set_uint64 (value, parser->priv->since);
+		break;
+	case PROP_METADATA_ONLY:
+		g_value_set_boolean (value, parser->priv->metadata_only);
+		break;
+	case PROP_CACHE:
+		g_value_set_boolean (value, parser->priv->use_cache);
+		break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
 		break;
@@ -697,6 +743,141 @@ totem_pl_parser_new (void)
 	return TOTEM_PL_PARSER (g_object_new (TOTEM_TYPE_PL_PARSER, NULL));
 }
 
+typedef struct {
+	TotemPlParser *parser;
+	GPtrArray *entries;
+} EntriesParsedSignalData;
+
+static gboolean
+emit_entries_parsed_signal (EntriesParsedSignalData *data)
+{
+	GPtrArray *uris, *metadata;
+	guint i;
+
+	uris = g_ptr_array_new_full (data->entries->len, g_free);
+	metadata = g_ptr_array_new_full (data->entries->len, (GDestroyNotify) g_hash_table_unref);
+	for (i = 0; i < data->entries->len; i++) {
+		TotemPlParserEntry *entry = g_ptr_array_index (data->entries, i);
+
+		g_ptr_array_add (uris, g_strdup (totem_pl_parser_entry_get_field (entry, TOTEM_PL_FIELD_ID_URI)));
+		g_ptr_array_add (metadata, g_hash_table_ref (totem_pl_parser_entry_get_metadata (entry)));
+	}
+
+	g_signal_emit (data->parser,
+		       totem_pl_parser_table_signals[ENTRIES_PARSED],
+		       0, uris, metadata);
+
+	/* Free the data */
+	g_ptr_array_unref (uris);
+	g_ptr_array_unref (metadata);
+	g_object_unref (data->parser);
+	g_ptr_array_unref (data->entries);
+	g_free (data);
+
+	return FALSE;
+}
+
+/* Takes the entries queued for ::entries-parsed away from @parser, if
+ * any. They are only sent once the lock is released, as the signal is
+ * emitted right away in the main thread, and its handlers may well add
+ * entries themselves. */
+static EntriesParsedSignalData *
+totem_pl_parser_take_batch_locked (TotemPlParser *parser)
+{
+	EntriesParsedSignalData *data;
+
+	if (parser->priv->batch == NULL)
+		return NULL;
+
+	if (parser->priv->batch_source != NULL) {
+		g_source_destroy (parser->priv->batch_source);
+		g_clear_pointer (&parser->priv->batch_source, g_source_unref);
+	}
+
+	data = g_new (EntriesParsedSignalData, 1);
+	data->parser = g_object_ref (parser);
+	data->entries = parser->priv->batch;
+	parser->priv->batch = NULL;
+
+	return data;
+}
+
+static void
+totem_pl_parser_send_batch (TotemPlParser           *parser,
+			    EntriesParsedSignalData *data)
+{
+	if (data != NULL)
+		CALL_ASYNC (parser, emit_entries_parsed_signal, data);
+}
+
+/* Sends the entries queued for ::entries-parsed, if any. This needs
+ * to happen before the playlist-started and playlist-ended signals are
+ * scheduled, so that the entries are received in the right order. */
+static void
+totem_pl_parser_flush_batch (TotemPlParser *parser)
+{
+	EntriesParsedSignalData *data;
+
+	g_mutex_lock (&parser->priv->batch_mutex);
+	data = totem_pl_parser_take_batch_locked (parser);
+	g_mutex_unlock (&parser->priv->batch_mutex);
+
+	totem_pl_parser_send_batch (parser, data);
+}
+
+static gboolean
+totem_pl_parser_batch_timeout_cb (TotemPlParser *parser)
+{
+	EntriesParsedSignalData *data = NULL;
+
+	g_mutex_lock (&parser->priv->batch_mutex);
+	/* Unless the batch was sent while we were waiting for the lock */
+	if (g_source_is_destroyed (g_main_current_source ()) == FALSE)
+		data = totem_pl_parser_take_batch_locked (parser);
+	g_mutex_unlock (&parser->priv->batch_mutex);
+
+	totem_pl_parser_send_batch (parser, data);
+
+	return G_SOURCE_REMOVE;
+}
+
+static void
+totem_pl_parser_add_to_batch (TotemPlParser      *parser,
+			      TotemPlParserEntry *entry)
+{
+	TotemPlParserPrivate *priv = parser->priv;
+	EntriesParsedSignalData *data = NULL;
+
+	g_mutex_lock (&priv->batch_mutex);
+
+	if (priv->batch == NULL) {
+		priv->batch = g_ptr_array_new_full (priv->batch_size, (GDestroyNotify) totem_pl_parser_entry_unref);
+		priv->batch_start = g_get_monotonic_time ();
+
+		/* Send the batch from the main loop if it doesn't fill up
+		 * in time, as the next entry might take long to arrive. The
+		 * source keeps the parser alive until the batch is sent. */
+		if (priv->batch_timeout > 0) {
+			priv->batch_source = g_timeout_source_new (priv->batch_timeout);
+			g_source_set_callback (priv->batch_source,
+					       (GSourceFunc) totem_pl_parser_batch_timeout_cb,
+					       g_object_ref (parser), g_object_unref);
+			g_source_attach (priv->batch_source, NULL);
+		}
+	}
+
+	g_ptr_array_add (priv->batch, totem_pl_parser_entry_ref (entry));
+
+	if (priv->batch->len >= priv->batch_size ||
+	    (priv->batch_timeout > 0 &&
+	     g_get_monotonic_time () - priv->batch_start >= (gint64) priv->batch_timeout * 1000))
+		data = totem_pl_parser_take_batch_locked (parser);
+
+	g_mutex_unlock (&priv->batch_mutex);
+
+	totem_pl_parser_send_batch (parser, data);
+}
+
 typedef struct {
 	TotemPlParser *parser;
 	char *playlist_uri;
@@ -730,6 +911,11 @@ totem_pl_parser_playlist_end (TotemPlParser *parser, const char *playlist_uri)
 {
 	PlaylistEndedSignalData *data;
 
+	totem_pl_parser_cache_record_playlist_end (parser, playlist_uri);
+
+	/* Send the remaining entries of the playlist first */
+	totem_pl_parser_flush_batch (parser);
+
 	data = g_new (PlaylistEndedSignalData, 1);
 	data->parser = g_object_ref (parser);
 	data->playlist_uri = g_strdup (playlist_uri);
@@ -737,15 +923,416 @@ totem_pl_parser_playlist_end (TotemPlParser *parser, const char *playlist_uri)
 	CALL_ASYNC (parser, emit_playlist_ended_signal, data);
 }
 
+struct _TotemPlParserSource {
+	GFile *file;
+	GInputStream *stream;
+	GByteArray *buffer;
+	/* The checksum of the data read so far, when its entries might
+	 * get cached, see totem_pl_parser_call_handler() */
+	GChecksum *checksum;
+	gsize hashed;
+	guint eof : 1;
+	guint consumed : 1;
+};
+
+static TotemPlParserSource *
+totem_pl_parser_source_new (GFile *file)
+{
+	TotemPlParserSource *source;
+
+	source = g_slice_new0 (TotemPlParserSource);
+	source->file = g_object_ref (file);
+	source->buffer = g_byte_array_new ();
+
+	return source;
+}
+
+/* Closes the stream of @source, and frees the data read so far. Each
+ * source belongs to the recursion level it was created for. */
+static void
+totem_pl_parser_source_free (TotemPlParserSource *source)
+{
+	g_clear_pointer (&source->checksum, g_checksum_free);
+	g_clear_object (&source->stream);
+	g_object_unref (source->file);
+	g_byte_array_unref (source->buffer);
+	g_slice_free (TotemPlParserSource, source);
+}
+
+/* Adds data that was just read from the file of @source to its checksum,
+ * if it has one. Files too big to be cached don't need one any more. */
+static void
+totem_pl_parser_source_hash (TotemPlParserSource *source,
+			     const guint8 *data,
+			     gsize len)
+{
+	if (source->checksum == NULL || len == 0)
+		return;
+
+	source->hashed += len;
+	if (source->hashed > CACHE_MAX_SIZE) {
+		g_clear_pointer (&source->checksum, g_checksum_free);
+		return;
+	}
+	g_checksum_update (source->checksum, data, len);
+}
+
+/* Starts computing the checksum of the whole file of @source as it gets
+ * read, by the format handler, beginning with what was already read */
+static void
+totem_pl_parser_source_start_hashing (TotemPlParserSource *source)
+{
+	source->checksum = g_checksum_new (G_CHECKSUM_SHA256);
+	source->hashed = 0;
+	totem_pl_parser_source_hash (source, source->buffer->data, source->buffer->len);
+}
+
+/* Returns the checksum of the file of @source, if it was read whole
+ * through @source and isn't too big to be cached, or %NULL otherwise */
+static const char *
+totem_pl_parser_source_get_checksum (TotemPlParserSource *source)
+{
+	if (source->checksum == NULL || source->eof == FALSE)
+		return NULL;
+	return g_checksum_get_string (source->checksum);
+}
+
+/* Makes sure that at least @size bytes of the file are buffered, or all
+ * of it if it's shorter than that. The file is opened on first use, and
+ * closed as soon as we reach its end, so that the whole file is only
+ * ever read once, sequentially. */
+static gboolean
+totem_pl_parser_source_fill (TotemPlParserSource *source,
+			     gsize size,
+			     GError **error)
+{
+	if (source->eof != FALSE || source->buffer->len >= size)
+		return TRUE;
+
+	if (source->stream == NULL) {
+		GFileInputStream *stream;
+
+		stream = g_file_read (source->file, NULL, error);
+		if (stream == NULL)
+			return FALSE;
+		source->stream = G_INPUT_STREAM (stream);
+	}
+
+	while (source->buffer->len < size) {
+		gsize len, chunk;
+		gssize bytes_read;
+
+		/* Double the buffer on each read for the whole file,
+		 * but don't read ahead for the type sniffing */
+		len = source->buffer->len;
+		chunk = MIN (size - len, MAX (READ_CHUNK_SIZE, len));
+
+		g_byte_array_set_size (source->buffer, len + chunk);
+		bytes_read = g_input_stream_read (source->stream, source->buffer->data + len, chunk, NULL, error);
+		if (bytes_read < 0) {
+			g_byte_array_set_size (source->buffer, len);
+			return FALSE;
+		}
+		g_byte_array_set_size (source->buffer, len + bytes_read);
+		totem_pl_parser_source_hash (source, source->buffer->data + len, bytes_read);
+
+		if (bytes_read == 0) {
+			source->eof = TRUE;
+			g_clear_object (&source->stream);
+			break;
+		}
+	}
+
+	return TRUE;
+}
+
+/**
+ * totem_pl_parser_load_contents:
+ * @parse_data: (allow-none): the #TotemPlParseData for the current parse operation
+ * @file: the #GFile to load
+ * @contents: return location for the contents of @file
+ * @length: (allow-none): return location for the length of @contents
+ *
+ * Loads the contents of @file, like g_file_load_contents() does, but reuses
+ * whatever data was already read from @file while detecting its type,
+ * so that the file only gets opened and read once. That data is handed
+ * over to the caller, so loading @file again reads it again.
+ * This is a private method, not exposed by the library.
+ *
+ * Return value: %TRUE if @file could be read, %FALSE otherwise
+ **/
+gboolean
+totem_pl_parser_load_contents (TotemPlParseData *parse_data,
+			       GFile *file,
+			       char **contents,
+			       gsize *length)
+{
+	TotemPlParserSource *source;
+	gsize len;
+
+	source = parse_data ? parse_data->source : NULL;
+	if (source == NULL ||
+	    source->consumed != FALSE ||
+	    g_file_equal (source->file, file) == FALSE)
+		return g_file_load_contents (file, NULL, contents, length, NULL, NULL);
+
+	if (totem_pl_parser_source_fill (source, G_MAXSIZE, NULL) == FALSE)
+		return FALSE;
+
+	/* The format handlers take ownership of the data, and might
+	 * modify it in place, so hand it over rather than keeping it
+	 * around while child playlists get parsed */
+	len = source->buffer->len;
+	g_byte_array_append (source->buffer, (const guint8 *) "", 1);
+	*contents = (char *) g_byte_array_free (source->buffer, FALSE);
+	source->buffer = g_byte_array_new ();
+
+	/* Anyone else will have to read the file again */
+	source->consumed = TRUE;
+
+	if (length != NULL)
+		*length = len;
+
+	return TRUE;
+}
+
+struct _TotemPlParserLineReader {
+	/* The source we took the stream from, if any */
+	TotemPlParserSource *source;
+	GInputStream *stream;
+	char *buffer;
+	gsize allocated;
+	gsize start;
+	gsize end;
+	guint eof : 1;
+};
+
+/**
+ * totem_pl_parser_line_reader_new:
+ * @parse_data: (allow-none): the #TotemPlParseData for the current parse operation
+ * @file: the #GFile to read
+ * @error: return location for a #GError, or %NULL
+ *
+ * Creates a reader that returns the lines of @file one by one, reading it
+ * chunk by chunk, so that the lines can be handled as soon as they have
+ * been received, and that only about a chunk of the file is kept in memory.
+ * The data already read from @file while detecting its type is taken over,
+ * and the rest of the file is read from the same stream.
+ * This is a private method, not exposed by the library.
+ *
+ * Return value: a new #TotemPlParserLineReader, or %NULL if @file couldn't be opened
+ **/
+TotemPlParserLineReader *
+totem_pl_parser_line_reader_new (TotemPlParseData *parse_data,
+				 GFile *file,
+				 GError **error)
+{
+	TotemPlParserLineReader *reader;
+	TotemPlParserSource *source;
+
+	reader = g_slice_new0 (TotemPlParserLineReader);
+
+	source = parse_data ? parse_data->source : NULL;
+	if (source != NULL &&
+	    source->consumed == FALSE &&
+	    g_file_equal (source->file, file) != FALSE) {
+		/* Open the file if the type sniffing didn't need to */
+		if (totem_pl_parser_source_fill (source, READ_CHUNK_SIZE, error) == FALSE) {
+			g_slice_free (TotemPlParserLineReader, reader);
+			return NULL;
+		}
+
+		/* Take over the stream, and the data that was read from
+		 * it, which is handed over rather than copied */
+		reader->end = source->buffer->len;
+		g_byte_array_append (source->buffer, (const guint8 *) "", 1);
+		reader->allocated = source->buffer->len;
+		reader->buffer = (char *) g_byte_array_free (source->buffer, FALSE);
+		source->buffer = g_byte_array_new ();
+		reader->eof = source->eof;
+		reader->stream = g_steal_pointer (&source->stream);
+		reader->source = source;
+
+		/* Anyone else will have to read the file again */
+		source->consumed = TRUE;
+	} else {
+		GFileInputStream *stream;
+
+		reader->allocated = READ_CHUNK_SIZE + 1;
+		reader->buffer = g_malloc (reader->allocated);
+
+		stream = g_file_read (file, NULL, error);
+		if (stream == NULL) {
+			totem_pl_parser_line_reader_free (reader);
+			return NULL;
+		}
+		reader->stream = G_INPUT_STREAM (stream);
+	}
+
+	reader->buffer[reader->end] = '\0';
+
+	return reader;
+}
+
+/**
+ * totem_pl_parser_line_reader_free:
+ * @reader: a #TotemPlParserLineReader
+ *
+ * Closes the stream read by @reader, and frees it.
+ * This is a private method, not exposed by the library.
+ **/
+void
+totem_pl_parser_line_reader_free (TotemPlParserLineReader *reader)
+{
+	g_clear_object (&reader->stream);
+	g_free (reader->buffer);
+	g_slice_free (TotemPlParserLineReader, reader);
+}
+
+/* Reads the next chunk of the file after the data not handled yet,
+ * which is moved to the start of the buffer first. The buffer only
+ * grows when a single line doesn't fit in it. */
+static gboolean
+totem_pl_parser_line_reader_fill (TotemPlParserLineReader *reader,
+				  GError **error)
+{
+	gssize bytes_read;
+
+	if (reader->eof != FALSE)
+		return TRUE;
+
+	if (reader->start > 0) {
+		memmove (reader->buffer, reader->buffer + reader->start, reader->end - reader->start);
+		reader->end -= reader->start;
+		reader->start = 0;
+	}
+
+	if (reader->allocated - reader->end - 1 < READ_CHUNK_SIZE) {
+		reader->allocated = reader->end + READ_CHUNK_SIZE + 1;
+		reader->buffer = g_realloc (reader->buffer, reader->allocated);
+	}
+
+	bytes_read = g_input_stream_read (reader->stream,
+					  reader->buffer + reader->end,
+					  READ_CHUNK_SIZE,
+					  NULL, error);
+	if (bytes_read < 0)
+		return FALSE;
+
+	if (reader->source != NULL)
+		totem_pl_parser_source_hash (reader->source, (const guint8 *) reader->buffer + reader->end, bytes_read);
+
+	reader->end += bytes_read;
+	reader->buffer[reader->end] = '\0';
+
+	if (bytes_read == 0) {
+		reader->eof = TRUE;
+		g_clear_object (&reader->stream);
+		/* The whole file went through the source */
+		if (reader->source != NULL)
+			reader->source->eof = TRUE;
+	}
+
+	return TRUE;
+}
+
+/**
+ * totem_pl_parser_line_reader_peek:
+ * @reader: a #TotemPlParserLineReader
+ * @size: the number of bytes needed
+ * @error: return location for a #GError, or %NULL
+ *
+ * Returns the data that hasn't been returned as lines yet, making sure
+ * that at least @size bytes of it are available, unless the end of the
+ * file comes first. The data is nul-terminated, and valid until the next
+ * call on @reader.
+ * This is a private method, not exposed by the library.
+ *
+ * Return value: the data, or %NULL on error
+ **/
+const char *
+totem_pl_parser_line_reader_peek (TotemPlParserLineReader *reader,
+				  gsize size,
+				  GError **error)
+{
+	while (reader->eof == FALSE && reader->end - reader->start < size) {
+		if (totem_pl_parser_line_reader_fill (reader, error) == FALSE)
+			return NULL;
+	}
+
+	return reader->buffer + reader->start;
+}
+
+/**
+ * totem_pl_parser_line_reader_next:
+ * @reader: a #TotemPlParserLineReader
+ * @dos_mode: (out): set to %TRUE if the line ended with a carriage return
+ * @error: return location for a #GError, or %NULL
+ *
+ * Returns the next line of the file. Both "\r" and "\n" end a line, so
+ * files with DOS line endings have empty lines between their lines.
+ * The line is terminated in place, and is only valid until the next
+ * call on @reader. As with g_strsplit_set(), the data after a nul byte
+ * is ignored.
+ * This is a private method, not exposed by the library.
+ *
+ * Return value: the line, or %NULL at the end of the file, or on error
+ **/
+char *
+totem_pl_parser_line_reader_next (TotemPlParserLineReader *reader,
+				  gboolean *dos_mode,
+				  GError **error)
+{
+	gsize scanned = 0;
+
+	for (;;) {
+		char *line, *eol;
+
+		line = reader->buffer + reader->start;
+
+		/* Only scan what hasn't been scanned yet; strcspn() is
+		 * the vectorised way to look for either line ending */
+		eol = line + scanned;
+		eol += strcspn (eol, "\r\n");
+
+		if (eol < reader->buffer + reader->end) {
+			if (eol[0] == '\0') {
+				/* A nul byte ends the file */
+				reader->start = reader->end;
+				reader->eof = TRUE;
+				g_clear_object (&reader->stream);
+				return line;
+			}
+			if (eol[0] == '\r')
+				*dos_mode = TRUE;
+			eol[0] = '\0';
+			reader->start = eol + 1 - reader->buffer;
+			return line;
+		}
+
+		/* The last line doesn't need a line ending */
+		if (reader->eof != FALSE) {
+			if (line[0] == '\0')
+				return NULL;
+			reader->start = reader->end;
+			return line;
+		}
+
+		/* Read more of the file, as we don't have a whole line */
+		scanned = reader->end - reader->start;
+		if (totem_pl_parser_line_reader_fill (reader, error) == FALSE)
+			return NULL;
+	}
+}
+
 static char *
-my_g_file_info_get_mime_type_with_data (GFile *file, gpointer *data, TotemPlParser *parser)
+my_g_file_info_get_mime_type_with_data (GFile *file, gpointer *data, TotemPlParser *parser, TotemPlParseData *parse_data)
 {
 	char *buffer;
 	gsize bytes_read;
-	GFileInputStream *stream;
 	GError *error = NULL;
 
-	*data = NULL;
+	g_clear_pointer (data, g_free);
 
 #ifndef _WIN32
 	/* Stat for a block device, we're screwed as far as speed
@@ -763,38 +1350,29 @@ my_g_file_info_get_mime_type_with_data (GFile *file, gpointer *data, TotemPlPars
 	}
 #endif
 
-	/* Open the file. */
-	stream = g_file_read (file, NULL, &error);
-	if (stream == NULL) {
+	/* Read the beginning of the file, up to MIME_READ_CHUNK_SIZE,
+	 * the handler will read the rest from the same stream */
+	if (totem_pl_parser_source_fill (parse_data->source, MIME_READ_CHUNK_SIZE, &error) == FALSE) {
 		if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_IS_DIRECTORY) != FALSE) {
 			g_error_free (error);
 			return g_strdup (DIR_MIME_TYPE);
 		}
-		DEBUG(file, g_print ("URI '%s' couldn't be opened in _get_mime_type_with_data: '%s'\n", uri, error->message));
+		DEBUG(file, g_print ("URI '%s' couldn't be read in _get_mime_type_with_data: '%s'\n", uri, error->message));
 		g_error_free (error);
 		return NULL;
 	}
-	DEBUG(file, g_print ("URI '%s' was opened successfully in _get_mime_type_with_data\n", uri));
-
-	/* Read the whole thing, up to MIME_READ_CHUNK_SIZE */
-	buffer = g_malloc (MIME_READ_CHUNK_SIZE);
-	if (g_input_stream_read_all (G_INPUT_STREAM (stream), buffer, MIME_READ_CHUNK_SIZE, &bytes_read, NULL, &error) == FALSE) {
-		g_object_unref (stream);
-		DEBUG(file, g_print ("Couldn't read data from '%s'\n", uri));
-		g_free (buffer);
-		return NULL;
-	}
-	g_object_unref (G_INPUT_STREAM (stream));
+	DEBUG(file, g_print ("URI '%s' was read successfully in _get_mime_type_with_data\n", uri));
 
 	/* Empty file */
+	bytes_read = MIN (parse_data->source->buffer->len, MIME_READ_CHUNK_SIZE);
 	if (bytes_read == 0) {
-		g_free (buffer);
 		DEBUG(file, g_print ("URI '%s' is empty in _get_mime_type_with_data\n", uri));
 		return g_strdup (EMPTY_FILE_TYPE);
 	}
 
-	/* Return the file null-terminated. */
-	buffer = g_realloc (buffer, bytes_read + 1);
+	/* Return the data null-terminated. */
+	buffer = g_malloc (bytes_read + 1);
+	memcpy (buffer, parse_data->source->buffer->data, bytes_read);
 	buffer[bytes_read] = '\0';
 	*data = buffer;
 
@@ -821,6 +1399,26 @@ totem_pl_parser_get_recurse (TotemPlParser *parser)
 	return parser->priv->recurse;
 }
 
+/**
+ * totem_pl_parser_get_feed_limits:
+ * @parser: a #TotemPlParser
+ * @max_entries: (out): return location for #TotemPlParser:max-entries
+ * @since: (out): return location for #TotemPlParser:since
+ * @metadata_only: (out): return location for #TotemPlParser:metadata-only
+ *
+ * Gets the limits on what to parse from feeds. This is a private method, not exposed by the library.
+ **/
+void
+totem_pl_parser_get_feed_limits (TotemPlParser *parser,
+				 guint         *max_entries,
+				 guint64       *since,
+				 gboolean      *metadata_only)
+{
+	*max_entries = parser->priv->max_entries;
+	*since = parser->priv->since;
+	*metadata_only = parser->priv->metadata_only;
+}
+
 /**
  * totem_pl_parser_base_uri:
  * @uri: a URI
@@ -1344,107 +1942,171 @@ totem_pl_parser_save_finish (TotemPlParser   *parser,
 }
 #endif /* TOTEM_PL_PARSER_MINI */
 
+struct _TotemPlParserIni {
+	char *contents;
+	GHashTable *values;
+	GHashTable *suffixed;
+};
+
+static guint
+ini_key_hash (gconstpointer key)
+{
+	const char *p;
+	guint32 h = 5381;
+
+	for (p = key; *p != '\0'; p++)
+		h = (h << 5) + h + g_ascii_tolower (*p);
+
+	return h;
+}
+
+static gboolean
+ini_key_equal (gconstpointer a,
+	       gconstpointer b)
+{
+	return g_ascii_strcasecmp (a, b) == 0;
+}
+
 /**
- * totem_pl_parser_read_ini_line_int:
- * @lines: a NULL-terminated array of INI lines to read
- * @key: the key to match
+ * totem_pl_parser_ini_new:
+ * @contents: (transfer full): the nul-terminated INI-style document
+ * @sep: the key-value separator
  *
- * Returns the first integer value case-insensitively matching the specified
- * key as an integer. The parser ignores leading whitespace on lines.
+ * Indexes the "key<sep>value" lines of @contents once, so that any number
+ * of keys can be looked up without going through the lines again. Lines
+ * are split on "\r" and "\n", and leading whitespace is ignored. Keys
+ * are matched case-insensitively, and the first line with a given key
+ * wins. Keys with a suffix, such as the localised "Name[fr]", or KDE's
+ * "URL[$e]", are looked up without it, when the document doesn't have
+ * the plain key.
  *
- * Return value: the integer value, or -1 on error
+ * @contents is split in place, and freed along with the index.
+ * This is a private method, not exposed by the library.
+ *
+ * Return value: a new #TotemPlParserIni
  **/
-int
-totem_pl_parser_read_ini_line_int (char **lines, const char *key)
+TotemPlParserIni *
+totem_pl_parser_ini_new (char *contents,
+			 char  sep)
 {
-	int retval = -1;
-	int i;
+	TotemPlParserIni *ini;
+	char *line, *next;
+	const char seps[] = { sep, '\r', '\n', '\0' };
 
-	if (lines == NULL || key == NULL)
-		return -1;
+	ini = g_slice_new (TotemPlParserIni);
+	ini->contents = contents;
+	ini->values = g_hash_table_new (ini_key_hash, ini_key_equal);
+	ini->suffixed = NULL;
 
-	for (i = 0; (lines[i] != NULL && retval == -1); i++) {
-		char *line = lines[i];
+	for (line = contents; line[0] != '\0'; line = next) {
+		char *end, *key_end, *value;
+		GHashTable *values;
 
 		while (*line == '\t' || *line == ' ')
 			line++;
 
-		if (g_ascii_strncasecmp (line, key, strlen (key)) == 0) {
-			char **bits;
+		/* Look for the separator and the end of the line at once */
+		end = line + strcspn (line, seps);
+		if (end[0] != sep) {
+			next = end[0] != '\0' ? end + 1 : end;
+			continue;
+		}
 
-			bits = g_strsplit (line, "=", 2);
-			if (bits[0] == NULL || bits [1] == NULL) {
-				g_strfreev (bits);
-				return -1;
-			}
+		value = end + 1;
+		next = value + strcspn (value, "\r\n");
+		if (next[0] != '\0')
+			*next++ = '\0';
+
+		/* Terminate the key, without its trailing whitespace */
+		for (key_end = end; key_end > line && g_ascii_isspace (key_end[-1]); key_end--)
+			;
+		*key_end = '\0';
+		if (line[0] == '\0')
+			continue;
+
+		values = ini->values;
 
-			retval = (gint) g_strtod (bits[1], NULL);
-			g_strfreev (bits);
+		/* "Key[suffix]" is indexed as "Key", apart from the plain keys */
+		if (key_end[-1] == ']') {
+			char *bracket;
+
+			bracket = strchr (line, '[');
+			if (bracket != NULL && bracket > line) {
+				bracket[0] = '\0';
+				if (ini->suffixed == NULL)
+					ini->suffixed = g_hash_table_new (ini_key_hash, ini_key_equal);
+				values = ini->suffixed;
+			}
 		}
+
+		if (g_hash_table_contains (values, line) == FALSE)
+			g_hash_table_insert (values, line, value);
 	}
 
-	return retval;
+	return ini;
 }
 
 /**
- * totem_pl_parser_read_ini_line_string_with_sep:
- * @lines: a NULL-terminated array of INI lines to read
+ * totem_pl_parser_ini_free:
+ * @ini: a #TotemPlParserIni
+ *
+ * Frees @ini and the document it indexes.
+ * This is a private method, not exposed by the library.
+ **/
+void
+totem_pl_parser_ini_free (TotemPlParserIni *ini)
+{
+	g_hash_table_destroy (ini->values);
+	g_clear_pointer (&ini->suffixed, g_hash_table_destroy);
+	g_free (ini->contents);
+	g_slice_free (TotemPlParserIni, ini);
+}
+
+/**
+ * totem_pl_parser_ini_get_string:
+ * @ini: a #TotemPlParserIni
  * @key: the key to match
- * @sep: the key-value separator
  *
- * Returns the first string value case-insensitively matching the specified
- * key, where the two are separated by @sep. The parser ignores leading whitespace
- * on lines.
+ * Returns the value of the first line case-insensitively matching @key.
+ * This is a private method, not exposed by the library.
  *
- * Return value: a newly-allocated string value, or %NULL
+ * Return value: the value, owned by @ini, or %NULL
  **/
-char*
-totem_pl_parser_read_ini_line_string_with_sep (char **lines, const char *key,
-		const char *sep)
+const char *
+totem_pl_parser_ini_get_string (TotemPlParserIni *ini,
+				const char *key)
 {
-	char *retval = NULL;
-	int i;
-
-	if (lines == NULL || key == NULL)
-		return NULL;
-
-	for (i = 0; (lines[i] != NULL && retval == NULL); i++) {
-		char *line = lines[i];
-
-		while (*line == '\t' || *line == ' ')
-			line++;
-
-		if (g_ascii_strncasecmp (line, key, strlen (key)) == 0) {
-			char **bits;
+	const char *value;
 
-			bits = g_strsplit (line, sep, 2);
-			if (bits[0] == NULL || bits [1] == NULL) {
-				g_strfreev (bits);
-				return NULL;
-			}
-
-			retval = g_strdup (bits[1]);
-			g_strfreev (bits);
-		}
-	}
+	value = g_hash_table_lookup (ini->values, key);
+	if (value == NULL && ini->suffixed != NULL)
+		value = g_hash_table_lookup (ini->suffixed, key);
 
-	return retval;
+	return value;
 }
 
 /**
- * totem_pl_parser_read_ini_line_string:
- * @lines: a NULL-terminated array of INI lines to read
+ * totem_pl_parser_ini_get_int:
+ * @ini: a #TotemPlParserIni
  * @key: the key to match
  *
- * Returns the first string value case-insensitively matching the
- * specified key. The parser ignores leading whitespace on lines.
+ * Returns the value of the first line case-insensitively matching @key,
+ * as an integer.
+ * This is a private method, not exposed by the library.
  *
- * Return value: a newly-allocated string value, or %NULL
+ * Return value: the integer value, or -1 on error
  **/
-char*
-totem_pl_parser_read_ini_line_string (char **lines, const char *key)
+int
+totem_pl_parser_ini_get_int (TotemPlParserIni *ini,
+			     const char *key)
 {
-	return totem_pl_parser_read_ini_line_string_with_sep (lines, key, "=");
+	const char *value;
+
+	value = totem_pl_parser_ini_get_string (ini, key);
+	if (value == NULL)
+		return -1;
+
+	return (gint) g_strtod (value, NULL);
 }
 
 static void
@@ -1453,9 +2115,11 @@ totem_pl_parser_init (TotemPlParser *parser)
 	parser->priv = g_new0 (TotemPlParserPrivate, 1);
 	parser->priv->main_thread = g_thread_self ();
 	g_mutex_init (&parser->priv->ignore_mutex);
+	g_mutex_init (&parser->priv->batch_mutex);
 	parser->priv->ignore_schemes = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
 	parser->priv->ignore_mimetypes = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
 	parser->priv->ignore_globs = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	parser->priv->cache = totem_pl_parser_cache_new ();
 }
 
 static void
@@ -1468,6 +2132,9 @@ totem_pl_parser_finalize (GObject *object)
 	g_clear_pointer (&priv->ignore_mimetypes, g_hash_table_destroy);
 	g_clear_pointer (&priv->ignore_globs, g_hash_table_destroy);
 	g_mutex_clear (&priv->ignore_mutex);
+	g_clear_pointer (&priv->batch, g_ptr_array_unref);
+	g_mutex_clear (&priv->batch_mutex);
+	g_clear_pointer (&priv->cache, totem_pl_parser_cache_free);
 	g_clear_pointer (&parser->priv, g_free);
 
 	G_OBJECT_CLASS (totem_pl_parser_parent_class)->finalize (object);
@@ -1476,19 +2143,20 @@ totem_pl_parser_finalize (GObject *object)
 typedef struct {
 	TotemPlParser *parser;
 	guint signal_id;
-	char *uri;
-	GHashTable *metadata;
+	TotemPlParserEntry *entry;
 } EntryParsedSignalData;
 
 static gboolean
 emit_entry_parsed_signal (EntryParsedSignalData *data)
 {
-	g_signal_emit (data->parser, data->signal_id, 0, data->uri, data->metadata);
+	/* The metadata hash table is only built here, in the main thread */
+	g_signal_emit (data->parser, data->signal_id, 0,
+		       totem_pl_parser_entry_get_field (data->entry, TOTEM_PL_FIELD_ID_URI),
+		       totem_pl_parser_entry_get_metadata (data->entry));
 
 	/* Free the data */
 	g_object_unref (data->parser);
-	g_free (data->uri);
-	g_hash_table_unref (data->metadata);
+	totem_pl_parser_entry_unref (data->entry);
 	g_free (data);
 
 	return FALSE;
@@ -1524,20 +2192,40 @@ totem_pl_parser_fix_string (const char  *name,
 }
 
 void
-totem_pl_parser_add_hash_table (TotemPlParser *parser,
-				GHashTable    *metadata,
-				const char    *uri,
-				gboolean       is_playlist)
+totem_pl_parser_add_entry (TotemPlParser      *parser,
+			   TotemPlParserEntry *entry,
+			   gboolean            is_playlist)
 {
-	if (g_hash_table_size (metadata) > 0 || uri != NULL) {
+	if (totem_pl_parser_entry_has_metadata (entry) ||
+	    totem_pl_parser_entry_get_field (entry, TOTEM_PL_FIELD_ID_URI) != NULL) {
 		EntryParsedSignalData *data;
+		TotemPlParseData *parse_data;
+
+		totem_pl_parser_cache_record_entry (parser, entry, is_playlist);
+
+		/* Entries go straight into the playlist when parsing
+		 * with totem_pl_parser_parse_to_playlist() */
+		parse_data = g_private_get (&current_parse_data);
+		if (is_playlist == FALSE && parse_data != NULL && parse_data->playlist != NULL) {
+			totem_pl_playlist_append_entry (parse_data->playlist, entry);
+			return;
+		}
+
+		if (is_playlist == FALSE && parser->priv->batch_size > 0) {
+			totem_pl_parser_add_to_batch (parser, entry);
+			return;
+		}
+
+		/* Entries from the parent playlist need to go before
+		 * the start of this one */
+		if (is_playlist != FALSE)
+			totem_pl_parser_flush_batch (parser);
 
 		/* Make sure to emit the signals asynchronously, as we could be in the main loop
 		 * *or* a worker thread at this point. */
 		data = g_new (EntryParsedSignalData, 1);
 		data->parser = g_object_ref (parser);
-		data->uri = g_strdup (uri);
-		data->metadata = g_hash_table_ref (metadata);
+		data->entry = totem_pl_parser_entry_ref (entry);
 
 		if (is_playlist == FALSE)
 			data->signal_id = totem_pl_parser_table_signals[ENTRY_PARSED];
@@ -1548,114 +2236,130 @@ totem_pl_parser_add_hash_table (TotemPlParser *parser,
 	}
 }
 
+void
+totem_pl_parser_add_hash_table (TotemPlParser *parser,
+				GHashTable    *metadata,
+				const char    *uri,
+				gboolean       is_playlist)
+{
+	TotemPlParserEntry *entry;
+
+	entry = totem_pl_parser_entry_new_from_hash_table (metadata, uri);
+	totem_pl_parser_add_entry (parser, entry, is_playlist);
+	totem_pl_parser_entry_unref (entry);
+}
+
+/* Sets a field of @entry from a string owned by the caller, skipping
+ * empty values and fixing up the encoding of the others. The first URI
+ * given wins. */
+static void
+totem_pl_parser_entry_set_checked (TotemPlParserEntry *entry,
+				   TotemPlFieldId      id,
+				   const char         *value)
+{
+	char *fixed = NULL;
+
+	g_return_if_fail (id >= 0 && id < TOTEM_PL_NUM_FIELD_IDS);
+
+	/* Ignore empty values */
+	if (value == NULL || value[0] == '\0')
+		return;
+
+	if (id == TOTEM_PL_FIELD_ID_URI) {
+		if (totem_pl_parser_entry_get_field (entry, id) == NULL)
+			totem_pl_parser_entry_take_field (entry, id, g_strdup (value));
+		return;
+	}
+
+	if (!totem_pl_parser_fix_string (totem_pl_parser_field_id_to_name (id), value, &fixed))
+		return;
+
+	totem_pl_parser_entry_take_field (entry, id, fixed ? fixed : g_strdup (value));
+}
+
+/* The fast path for the format handlers: the fields are given as an
+ * array of (field ID, value) pairs, usually on the stack, so that no
+ * property lookups or string comparisons are needed for each entry.
+ * @file and @base_file, if not %NULL, set the URI and base of the entry. */
+void
+totem_pl_parser_add_fields (TotemPlParser            *parser,
+			    GFile                    *file,
+			    GFile                    *base_file,
+			    gboolean                  is_playlist,
+			    const TotemPlParserField *fields,
+			    guint                     n_fields)
+{
+	TotemPlParserEntry *entry;
+	guint i;
+
+	entry = totem_pl_parser_entry_new ();
+
+	if (file != NULL)
+		totem_pl_parser_entry_take_field (entry, TOTEM_PL_FIELD_ID_URI, g_file_get_uri (file));
+	if (base_file != NULL)
+		totem_pl_parser_entry_take_field (entry, TOTEM_PL_FIELD_ID_BASE, g_file_get_uri (base_file));
+
+	for (i = 0; i < n_fields; i++)
+		totem_pl_parser_entry_set_checked (entry, fields[i].id, fields[i].value);
+
+	totem_pl_parser_add_entry (parser, entry, is_playlist);
+	totem_pl_parser_entry_unref (entry);
+}
+
 static void
 totem_pl_parser_add_uri_valist (TotemPlParser *parser,
 				const gchar *first_property_name,
 				va_list      var_args)
 {
 	const char *name;
-	char *uri;
-	GHashTable *metadata;
+	TotemPlParserEntry *entry;
 	gboolean is_playlist;
 
-	uri = NULL;
 	is_playlist = FALSE;
 
 	g_object_ref (G_OBJECT (parser));
-	metadata = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
-
-	name = first_property_name;
+	entry = totem_pl_parser_entry_new ();
 
-	while (name) {
-		GValue value = { 0, };
-		GParamSpec *pspec;
-		char *error = NULL;
+	for (name = first_property_name; name != NULL; name = va_arg (var_args, char*)) {
+		TotemPlFieldId id;
 		const char *string;
 
-		pspec = g_param_spec_pool_lookup (totem_pl_parser_pspec_pool,
-						  name,
-						  G_OBJECT_TYPE (parser),
-						  FALSE);
-
-		if (!pspec) {
-			g_warning ("Unknown property '%s'", name);
-			name = va_arg (var_args, char*);
-			continue;
-		}
-
-		g_value_init (&value, G_PARAM_SPEC_VALUE_TYPE (pspec));
-		G_VALUE_COLLECT (&value, var_args, 0, &error);
-		if (error != NULL) {
-			g_warning ("Error getting the value for property '%s'", name);
-			break;
-		}
-
-		if (strcmp (name, TOTEM_PL_PARSER_FIELD_URI) == 0) {
-			if (uri == NULL)
-				uri = g_value_dup_string (&value);
-		} else if (strcmp (name, TOTEM_PL_PARSER_FIELD_FILE) == 0) {
+		if (strcmp (name, TOTEM_PL_PARSER_FIELD_FILE) == 0) {
 			GFile *file;
 
-			file = g_value_get_object (&value);
-			uri = g_file_get_uri (file);
-
-			g_value_unset (&value);
-			name = va_arg (var_args, char*);
+			file = va_arg (var_args, GFile *);
+			totem_pl_parser_entry_take_field (entry, TOTEM_PL_FIELD_ID_URI, g_file_get_uri (file));
 			continue;
 		} else if (strcmp (name, TOTEM_PL_PARSER_FIELD_BASE_FILE) == 0) {
 			GFile *file;
-			char *base_uri;
-
-			file = g_value_get_object (&value);
-			base_uri = g_file_get_uri (file);
 
-			g_hash_table_insert (metadata,
-					     g_strdup (TOTEM_PL_PARSER_FIELD_BASE),
-					     base_uri);
-
-			g_value_unset (&value);
-			name = va_arg (var_args, char*);
+			file = va_arg (var_args, GFile *);
+			totem_pl_parser_entry_take_field (entry, TOTEM_PL_FIELD_ID_BASE, g_file_get_uri (file));
 			continue;
 		} else if (strcmp (name, TOTEM_PL_PARSER_FIELD_IS_PLAYLIST) == 0) {
-			is_playlist = g_value_get_boolean (&value);
-			g_value_unset (&value);
-			name = va_arg (var_args, char*);
+			is_playlist = va_arg (var_args, gboolean);
 			continue;
 		}
 
-		/* Ignore empty values */
-		string = g_value_get_string (&value);
-		if (string != NULL && string[0] != '\0') {
-			char *fixed = NULL;
-
-			if (!totem_pl_parser_fix_string (name, string, &fixed)) {
-				g_value_unset (&value);
-				name = va_arg (var_args, char*);
-				continue;
-			}
+		/* All the other fields are strings */
+		string = va_arg (var_args, const char *);
 
-			/* Add other values to the metadata hashtable */
-			g_hash_table_insert (metadata,
-					     g_strdup (name),
-					     fixed ? fixed : g_strdup (string));
+		id = totem_pl_parser_field_id_from_name (name);
+		if (id == TOTEM_PL_FIELD_ID_UNKNOWN) {
+			g_warning ("Unknown property '%s'", name);
+			continue;
 		}
 
-		g_value_unset (&value);
-		name = va_arg (var_args, char*);
+		totem_pl_parser_entry_set_checked (entry, id, string);
 	}
 
 	if (parser->priv->disable_unsafe != FALSE) {
 		//FIXME fix this! 396710
 	}
 
-	totem_pl_parser_add_hash_table (parser,
-					metadata,
-					uri,
-					is_playlist);
-
-	g_hash_table_unref (metadata);
+	totem_pl_parser_add_entry (parser, entry, is_playlist);
+	totem_pl_parser_entry_unref (entry);
 
-	g_free (uri);
 	g_object_unref (G_OBJECT (parser));
 }
 
@@ -1691,19 +2395,22 @@ totem_pl_parser_add_uri (TotemPlParser *parser,
 void
 totem_pl_parser_add_one_uri (TotemPlParser *parser, const char *uri, const char *title)
 {
-	totem_pl_parser_add_uri (parser,
-				 TOTEM_PL_PARSER_FIELD_URI, uri,
-				 TOTEM_PL_PARSER_FIELD_TITLE, title,
-				 NULL);
+	TotemPlParserField fields[] = {
+		{ TOTEM_PL_FIELD_ID_URI, uri },
+		{ TOTEM_PL_FIELD_ID_TITLE, title }
+	};
+
+	totem_pl_parser_add_fields (parser, NULL, NULL, FALSE, fields, G_N_ELEMENTS (fields));
 }
 
 void
 totem_pl_parser_add_one_file (TotemPlParser *parser, GFile *file, const char *title)
 {
-	totem_pl_parser_add_uri (parser,
-				 TOTEM_PL_PARSER_FIELD_FILE, file,
-				 TOTEM_PL_PARSER_FIELD_TITLE, title,
-				 NULL);
+	TotemPlParserField fields[] = {
+		{ TOTEM_PL_FIELD_ID_TITLE, title }
+	};
+
+	totem_pl_parser_add_fields (parser, file, NULL, FALSE, fields, G_N_ELEMENTS (fields));
 }
 
 static PlaylistTypes ignore_types[] = {
@@ -1821,117 +2528,220 @@ totem_pl_parser_ignore (TotemPlParser *parser, const char *uri)
 			return FALSE;
 	}
 
-	for (i = 0; i < G_N_ELEMENTS (dual_types); i++) {
-		if (strcmp (dual_types[i].mimetype, mimetype) == 0)
-			return FALSE;
+	for (i = 0; i < G_N_ELEMENTS (dual_types); i++) {
+		if (strcmp (dual_types[i].mimetype, mimetype) == 0)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+#ifdef HAVE_UCHARDET
+static char *
+guess_text_encoding (const char *text,
+		     gsize       len)
+{
+	uchardet_t handle;
+	char *encoding = NULL;
+	int ret;
+
+	handle = uchardet_new ();
+	ret = uchardet_handle_data (handle, text, len);
+	if (ret == 0) {
+		uchardet_data_end (handle);
+		encoding = g_strdup (uchardet_get_charset (handle));
+	}
+
+	uchardet_delete (handle);
+	return encoding;
+}
+#else
+static char *
+guess_text_encoding (const char *text,
+		     gsize       len)
+{
+	return NULL;
+}
+#endif /* HAVE_UCHARDET */
+
+/* Returns the encoding declared in the <?xml ?> prolog of @contents, if any */
+static char *
+xml_prolog_encoding (const char *contents,
+		     gsize       size)
+{
+	const char *p, *end, *value;
+	char quote;
+
+	end = contents + size;
+	p = contents;
+	if (size >= 3 && memcmp (p, "\xEF\xBB\xBF", 3) == 0)
+		p += 3;
+	while (p < end && g_ascii_isspace (*p))
+		p++;
+	if (end - p < 5 || g_ascii_strncasecmp (p, "<?xml", 5) != 0)
+		return NULL;
+
+	p += 5;
+	end = g_strstr_len (p, end - p, "?>");
+	if (end == NULL)
+		return NULL;
+
+	for (; p < end; p++) {
+		if (g_ascii_strncasecmp (p, "encoding", strlen ("encoding")) != 0)
+			continue;
+		p += strlen ("encoding");
+		while (p < end && g_ascii_isspace (*p))
+			p++;
+		if (p == end || *p++ != '=')
+			return NULL;
+		while (p < end && g_ascii_isspace (*p))
+			p++;
+		if (p == end || (*p != '"' && *p != '\''))
+			return NULL;
+		quote = *p++;
+		value = p;
+		while (p < end && *p != quote)
+			p++;
+		if (p == end)
+			return NULL;
+		return g_strndup (value, p - value);
+	}
+
+	return NULL;
+}
+
+/* Whether the XML lexer will convert @contents from UTF-16 or UTF-32 itself */
+static gboolean
+xml_has_wide_bom (const char *contents,
+		  gsize       size)
+{
+	if (size < 2)
+		return FALSE;
+	return (memcmp (contents, "\xFF\xFE", 2) == 0 ||
+		memcmp (contents, "\xFE\xFF", 2) == 0 ||
+		(size >= 4 && memcmp (contents, "\0\0\xFE\xFF", 4) == 0));
+}
+
+/* Returns the first byte of @p that isn't ASCII, or @end */
+static const char *
+skip_ascii (const char *p,
+	    const char *end)
+{
+	guint64 word;
+
+	/* A word at a time, then byte by byte in the last word, or
+	 * the one with the first non-ASCII byte */
+	while (end - p >= (gssize) sizeof (word)) {
+		memcpy (&word, p, sizeof (word));
+		if ((word & G_GUINT64_CONSTANT (0x8080808080808080)) != 0)
+			break;
+		p += sizeof (word);
 	}
+	while (p < end && (guchar) *p < 0x80)
+		p++;
 
-	return TRUE;
+	return p;
 }
 
-/**
- * totem_pl_parser_cleanup_xml:
- * @contents: the contents of the file
- *
- * Removes HTML comments from a string representing the contents of an XML file.
- * The function modifies the string in place.
- */
-static void
-totem_pl_parser_cleanup_xml (char *contents)
+/* Like g_utf8_validate(), but only looks at each character once for runs
+ * of ASCII, and goes through the whole of @contents, nul bytes included */
+static gboolean
+xml_utf8_validate (const char *contents,
+		   gsize       size)
 {
-	char *needle;
+	const char *p, *end;
 
-	needle = contents;
-	while ((needle = strstr (needle, "<!--")) != NULL) {
-		char *end;
-
-		/* Find end of comments */
-		end = strstr (needle, "-->");
-		/* Broken file? */
-		if (end == NULL)
-			return;
-		if (g_strstr_len (needle, end - needle, "]]>") != NULL) {
-			/* Advance 3 and skip */
-			needle += 3;
-			continue;
-		}
-		/* Empty the comment */
-		memset (needle, ' ', end + 3 - needle);
+	end = contents + size;
+	p = skip_ascii (contents, end);
+	while (p < end) {
+		if ((gint32) g_utf8_get_char_validated (p, end - p) < 0)
+			return FALSE;
+		p = skip_ascii (g_utf8_next_char (p), end);
 	}
+
+	return TRUE;
 }
 
-#ifdef HAVE_UCHARDET
-static char *
-guess_text_encoding (const char *text,
-		     gsize       len)
+/* Whether @encoding is the same as ASCII for the first 128 characters, so
+ * that documents in it that only contain ASCII don't need converting */
+static gboolean
+xml_encoding_is_ascii_compatible (const char *encoding)
 {
-	uchardet_t handle;
-	char *encoding = NULL;
-	int ret;
+	const char *prefixes[] = {
+		"ASCII", "US-ASCII", "ISO-8859-", "ISO8859-", "ISO_8859-",
+		"latin", "windows-125", "cp125", "KOI8-"
+	};
+	guint i;
 
-	handle = uchardet_new ();
-	ret = uchardet_handle_data (handle, text, len);
-	if (ret == 0) {
-		uchardet_data_end (handle);
-		encoding = g_strdup (uchardet_get_charset (handle));
+	for (i = 0; i < G_N_ELEMENTS (prefixes); i++) {
+		if (g_ascii_strncasecmp (encoding, prefixes[i], strlen (prefixes[i])) == 0)
+			return TRUE;
 	}
 
-	uchardet_delete (handle);
-	return encoding;
+	return FALSE;
 }
-#else
-static char *
-guess_text_encoding (const char *text,
-		     gsize       len)
+
+typedef int (*XmlParseFunc) (xml_parser_t *xml_parser, int flags, gpointer user_data);
+
+static int
+parse_xml_with_flags (const char   *contents,
+		      gsize         size,
+		      int           flags,
+		      XmlParseFunc  func,
+		      gpointer      user_data)
 {
-	return NULL;
+	xml_parser_t *xml_parser;
+	int res;
+
+	xml_parser = xml_parser_init_r (contents, size, XML_PARSER_CASE_INSENSITIVE);
+	res = func (xml_parser, XML_PARSER_RELAXED | XML_PARSER_MULTI_TEXT | flags, user_data);
+	xml_parser_finalize_r (xml_parser);
+
+	return res;
 }
-#endif /* HAVE_UCHARDET */
 
-xml_node_t *
-totem_pl_parser_parse_xml_relaxed (char *contents,
-				   gsize size)
+/* Converts @contents to UTF-8 if needed, and runs @func over it */
+static int
+parse_xml_relaxed (char         *contents,
+		   gsize         size,
+		   XmlParseFunc  func,
+		   gpointer      user_data)
 {
-	xml_node_t* doc, *node;
 	g_autoptr(GError) error = NULL;
 	g_autofree char *encoding = NULL;
 	g_autofree char *new_contents = NULL;
 	gsize new_size, bytes_read;
-	xml_parser_t *xml_parser;
-
-	totem_pl_parser_cleanup_xml (contents);
-	xml_parser = xml_parser_init_r (contents, size, XML_PARSER_CASE_INSENSITIVE);
-	if (xml_parser_build_tree_with_options_r (xml_parser, &doc, XML_PARSER_RELAXED | XML_PARSER_MULTI_TEXT) < 0) {
-		xml_parser_finalize_r (xml_parser);
-		return NULL;
-	}
 
-	xml_parser_finalize_r (xml_parser);
+	/* The encoding is worked out before parsing, so that each document
+	 * is parsed, and converted if needed, only once. Documents that don't
+	 * need converting are parsed in place, the XML lexer takes care of the
+	 * ones with a UTF-16 or UTF-32 byte order mark */
+	if (xml_has_wide_bom (contents, size))
+		return parse_xml_with_flags (contents, size, XML_PARSER_IN_SITU, func, user_data);
 
-	encoding = NULL;
-	for (node = doc; node != NULL; node = node->next) {
-		if (node->name == NULL || g_str_equal (node->name, "?XML") == FALSE)
-			continue;
-		encoding = g_strdup (xml_parser_get_property (node, "ENCODING"));
-		break;
+	encoding = xml_prolog_encoding (contents, size);
+	if (encoding != NULL &&
+	    g_ascii_strcasecmp (encoding, "UTF-8") != 0 &&
+	    xml_encoding_is_ascii_compatible (encoding) &&
+	    skip_ascii (contents, contents + size) == contents + size) {
+		g_debug ("Document in '%s' only contains ASCII, not converting it", encoding);
+		return parse_xml_with_flags (contents, size, XML_PARSER_IN_SITU, func, user_data);
 	}
 
 	if (encoding == NULL || g_ascii_strcasecmp (encoding, "UTF-8") == 0) {
-		if (g_utf8_validate (contents, -1, NULL))
-			return doc;
+		if (xml_utf8_validate (contents, size))
+			return parse_xml_with_flags (contents, size, XML_PARSER_IN_SITU, func, user_data);
 		g_debug ("Document %s pretended to be in UTF-8 but didn't validate",
 			 encoding ? "explicitly" : "implicitly");
 		g_free (encoding);
 		encoding = guess_text_encoding (contents, size);
 		if (!encoding)
-			return NULL;
+			return -1;
 
 		g_debug ("Guessed text encoding of XML data as '%s'", encoding);
 		/* fall-through with the detected encoding */
 	}
 
-	xml_parser_free_tree (doc);
-
 	new_contents = g_convert (contents, size, "UTF-8", encoding, &bytes_read, &new_size, &error);
 	if (new_contents == NULL) {
 		g_autofree char *message = NULL;
@@ -1949,20 +2759,92 @@ totem_pl_parser_parse_xml_relaxed (char *contents,
 			g_warning ("%s", message);
 		}
 
-		return NULL;
+		return -1;
 	}
 
-	xml_parser = xml_parser_init_r (new_contents, new_size, XML_PARSER_CASE_INSENSITIVE);
-	if (xml_parser_build_tree_with_options_r (xml_parser, &doc, XML_PARSER_RELAXED | XML_PARSER_MULTI_TEXT) < 0) {
-		xml_parser_finalize_r (xml_parser);
-		return NULL;
-	}
+	/* The converted text goes away with this function, so it's copied */
+	return parse_xml_with_flags (new_contents, new_size, 0, func, user_data);
+}
 
-	xml_parser_finalize_r (xml_parser);
+static int
+build_xml_tree (xml_parser_t *xml_parser,
+		int           flags,
+		gpointer      user_data)
+{
+	return xml_parser_build_tree_with_options_r (xml_parser, user_data, flags);
+}
+
+/**
+ * totem_pl_parser_parse_xml_relaxed:
+ * @contents: the nul-terminated contents of the XML document
+ * @size: the length of @contents
+ *
+ * Parses @contents into a tree, converting it to UTF-8 first if needed.
+ * When no conversion is needed, the names, properties and text of the tree
+ * point into @contents, which is modified, so @contents must only be freed
+ * after the tree.
+ * This is a private method, not exposed by the library.
+ *
+ * Return value: the root node of the tree, or %NULL on error
+ **/
+xml_node_t *
+totem_pl_parser_parse_xml_relaxed (char *contents,
+				   gsize size)
+{
+	xml_node_t *doc;
 
+	if (parse_xml_relaxed (contents, size, build_xml_tree, &doc) < 0)
+		return NULL;
 	return doc;
 }
 
+typedef struct {
+	int depth;
+	const xml_parser_stream_t *stream;
+	gpointer user_data;
+} XmlStreamData;
+
+static int
+stream_xml_subtrees (xml_parser_t *xml_parser,
+		     int           flags,
+		     gpointer      user_data)
+{
+	XmlStreamData *data = user_data;
+
+	return xml_parser_stream_subtrees_r (xml_parser, data->depth, data->stream, data->user_data, flags);
+}
+
+/**
+ * totem_pl_parser_stream_xml_relaxed:
+ * @contents: the nul-terminated contents of the XML document
+ * @size: the length of @contents
+ * @depth: the depth of the elements to stream, the root element being 0
+ * @stream: the callbacks
+ * @user_data: user data to pass to @stream's callbacks
+ *
+ * Parses @contents as totem_pl_parser_parse_xml_relaxed() does, but without
+ * building the whole tree: @stream's open() and close() callbacks are passed
+ * the elements above @depth as they are opened and closed, and its subtree()
+ * callback each element at @depth, with its children, as soon as it is closed.
+ * The subtrees must be freed before returning from this function, and
+ * may point into @contents like the trees of totem_pl_parser_parse_xml_relaxed().
+ * This is a private method, not exposed by the library.
+ *
+ * Return value: %TRUE if the whole document was parsed, or if one of the
+ * callbacks stopped the parsing, %FALSE on error
+ **/
+gboolean
+totem_pl_parser_stream_xml_relaxed (char                      *contents,
+				    gsize                      size,
+				    int                        depth,
+				    const xml_parser_stream_t *stream,
+				    gpointer                   user_data)
+{
+	XmlStreamData data = { depth, stream, user_data };
+
+	return parse_xml_relaxed (contents, size, stream_xml_subtrees, &data) >= 0;
+}
+
 static gboolean
 totem_pl_parser_ignore_from_mimetype (TotemPlParser *parser, const char *mimetype)
 {
@@ -2011,11 +2893,123 @@ totem_pl_parser_get_function_for_mimetype (const char *mimetype)
 	return NULL;
 }
 
-TotemPlParserResult
-totem_pl_parser_parse_internal (TotemPlParser *parser,
-				GFile *file,
-				GFile *base_file,
-				TotemPlParseData *parse_data)
+/* Only the text playlist formats are worth caching, not disc images
+ * or directories, nor media files which might be playlists */
+static gboolean
+totem_pl_parser_mimetype_is_cacheable (const char *mimetype)
+{
+	guint i;
+
+	if (mimetype == NULL)
+		return FALSE;
+
+	for (i = 0; i < G_N_ELEMENTS(special_types); i++) {
+		if (strcmp (special_types[i].mimetype, mimetype) == 0)
+			return special_types[i].unsafe == FALSE;
+	}
+	return FALSE;
+}
+
+static char *
+totem_pl_parser_cache_options (TotemPlParser *parser,
+			       GFile *base_file,
+			       TotemPlParseData *parse_data)
+{
+	g_autofree char *base = NULL;
+
+	if (base_file != NULL)
+		base = g_file_get_uri (base_file);
+
+	return g_strdup_printf ("%d%d%d%d %u %" G_GUINT64_FORMAT " %d %s",
+				parse_data->fallback, parse_data->recurse,
+				parse_data->force, parse_data->disable_unsafe,
+				parser->priv->max_entries, parser->priv->since,
+				parser->priv->metadata_only, base ? base : "");
+}
+
+/* Calls @func to parse @file, unless the cache is enabled, and has the
+ * entries of @file from when it was last parsed, and @file wasn't
+ * modified since. Those are then sent again instead.
+ * Otherwise, the data read by @func is hashed as it reads it, so that
+ * the entries are sent as soon as they are parsed, and the file isn't
+ * kept in memory twice. */
+static TotemPlParserResult
+totem_pl_parser_call_handler (TotemPlParser *parser,
+			      PlaylistCallback func,
+			      gboolean cacheable,
+			      GFile *file,
+			      GFile *base_file,
+			      TotemPlParseData *parse_data,
+			      gpointer data)
+{
+	TotemPlParserSource *source = parse_data->source;
+	TotemPlParserCacheKey key = { NULL, NULL, 0, -1, NULL };
+	TotemPlParserCacheRecorder *recorder;
+	g_autoptr(GFileInfo) info = NULL;
+	g_autofree char *uri = NULL;
+	g_autofree char *options = NULL;
+	TotemPlParserResult ret;
+
+	/* The playlist being recorded, if any, includes this one */
+	totem_pl_parser_cache_record_nested (parser);
+
+	if (parser->priv->use_cache == FALSE ||
+	    cacheable == FALSE ||
+	    parse_data->recurse_level > 1)
+		return (* func) (parser, file, base_file, parse_data, data);
+
+	uri = g_file_get_uri (file);
+	options = totem_pl_parser_cache_options (parser, base_file, parse_data);
+	key.uri = uri;
+	key.options = options;
+
+	/* Files don't need to be read if they weren't modified, which
+	 * remote ones can only tell if they have a modification time */
+	info = g_file_query_info (file,
+				  G_FILE_ATTRIBUTE_TIME_MODIFIED ","
+				  G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC ","
+				  G_FILE_ATTRIBUTE_STANDARD_SIZE,
+				  G_FILE_QUERY_INFO_NONE, NULL, NULL);
+	if (info != NULL &&
+	    g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_TIME_MODIFIED)) {
+		key.mtime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED) * G_USEC_PER_SEC +
+			g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+		key.size = g_file_info_get_size (info);
+
+		if (totem_pl_parser_cache_replay (parser->priv->cache, parser, &key)) {
+			DEBUG(file, g_print ("Sending the cached entries of unmodified '%s'\n", uri));
+			return TOTEM_PL_PARSER_RESULT_SUCCESS;
+		}
+	}
+
+	/* The entries can only be sent from the cache if the modification
+	 * time is known, and cached if @func reads the file through the
+	 * source, which is what lets us hash it */
+	if (key.mtime == 0 ||
+	    source == NULL ||
+	    source->consumed != FALSE ||
+	    g_file_equal (source->file, file) == FALSE)
+		return (* func) (parser, file, base_file, parse_data, data);
+
+	totem_pl_parser_source_start_hashing (source);
+
+	recorder = totem_pl_parser_cache_record_start (parser);
+	ret = (* func) (parser, file, base_file, parse_data, data);
+
+	/* Not if @func stopped reading before the end, or read the file
+	 * by other means, or the file was too big */
+	key.checksum = totem_pl_parser_source_get_checksum (source);
+	totem_pl_parser_cache_record_end (parser->priv->cache, recorder,
+					  ret == TOTEM_PL_PARSER_RESULT_SUCCESS && key.checksum != NULL ? &key : NULL);
+
+	return ret;
+}
+
+static TotemPlParserResult
+totem_pl_parser_parse_internal_with_source (TotemPlParser *parser,
+					    GFile *file,
+					    GFile *base_file,
+					    TotemPlParseData *parse_data)
 {
 	g_autofree char *mimetype = NULL;
 	g_autofree gpointer data = NULL;
@@ -2043,15 +3037,18 @@ totem_pl_parser_parse_internal (TotemPlParser *parser,
 	    || g_file_has_uri_scheme (file, "feed") != FALSE
 	    || g_file_has_uri_scheme (file, "zcast") != FALSE) {
 		DEBUG(file, g_print ("URI '%s' is getting special cased for ITPC/FEED/ZCAST parsing\n", uri));
+		totem_pl_parser_cache_record_nested (parser);
 		return totem_pl_parser_add_itpc (parser, file, base_file, parse_data, NULL);
 	}
 	if (g_file_has_uri_scheme (file, "zune") != FALSE) {
 		DEBUG(file, g_print ("URI '%s' is getting special cased for ZUNE parsing\n", uri));
+		totem_pl_parser_cache_record_nested (parser);
 		return totem_pl_parser_add_zune (parser, file, base_file, parse_data, NULL);
 	}
 	/* Try itms Podcast references, see itunes.py in PenguinTV */
 	if (totem_pl_parser_is_itms_feed (file) != FALSE) {
 		DEBUG(file, g_print ("URI '%s' is getting special cased for ITMS parsing\n", uri));
+		totem_pl_parser_cache_record_nested (parser);
 		return totem_pl_parser_add_itms (parser, file, NULL, parse_data, NULL);
 	}
 
@@ -2065,8 +3062,10 @@ totem_pl_parser_parse_internal (TotemPlParser *parser,
 	    g_file_has_uri_scheme (file, "https")) {
 		if (uri != NULL && parse_data->recurse && totem_pl_parser_is_videosite (uri, parser->priv->debug) != FALSE) {
 			ret = totem_pl_parser_add_videosite (parser, file, base_file, parse_data, NULL);
-			if (ret == TOTEM_PL_PARSER_RESULT_SUCCESS)
+			if (ret == TOTEM_PL_PARSER_RESULT_SUCCESS) {
+				totem_pl_parser_cache_record_nested (parser);
 				return ret;
+			}
 		}
 	}
 
@@ -2077,7 +3076,7 @@ totem_pl_parser_parse_internal (TotemPlParser *parser,
 
 	/* In force mode we want to get the data */
 	if (parse_data->force != FALSE) {
-		mimetype = my_g_file_info_get_mime_type_with_data (file, &data, parser);
+		mimetype = my_g_file_info_get_mime_type_with_data (file, &data, parser, parse_data);
 	} else {
 		char *uri;
 
@@ -2114,7 +3113,7 @@ totem_pl_parser_parse_internal (TotemPlParser *parser,
 	    strcmp (UNKNOWN_TYPE, mimetype) == 0 ||
 	    g_content_type_is_a (mimetype, "text/plain") != FALSE) {
 		char *new_mimetype;
-		new_mimetype = my_g_file_info_get_mime_type_with_data (file, &data, parser);
+		new_mimetype = my_g_file_info_get_mime_type_with_data (file, &data, parser, parse_data);
 		if (new_mimetype) {
 			g_free (mimetype);
 			mimetype = new_mimetype;
@@ -2136,7 +3135,7 @@ totem_pl_parser_parse_internal (TotemPlParser *parser,
 	 * data from the playlist parser */
 	if (strcmp (mimetype, AUDIO_MPEG_TYPE) == 0 && parse_data->recurse_level == 0 && data == NULL) {
 		char *tmp;
-		tmp = my_g_file_info_get_mime_type_with_data (file, &data, parser);
+		tmp = my_g_file_info_get_mime_type_with_data (file, &data, parser, parse_data);
 		if (tmp != NULL) {
 			g_free (mimetype);
 			mimetype = tmp;
@@ -2166,7 +3165,8 @@ totem_pl_parser_parse_internal (TotemPlParser *parser,
 					base_file = g_object_ref (base_file);
 
 				DEBUG (file, g_print ("Using %s function for '%s'\n", special_types[i].mimetype, uri));
-				ret = (* special_types[i].func) (parser, file, base_file, parse_data, data);
+				ret = totem_pl_parser_call_handler (parser, special_types[i].func, !special_types[i].unsafe,
+								    file, base_file, parse_data, data);
 
 				if (base_file != NULL)
 					g_object_unref (base_file);
@@ -2183,7 +3183,7 @@ totem_pl_parser_parse_internal (TotemPlParser *parser,
 				DEBUG(file, g_print ("URI '%s' is dual type '%s'\n", uri, mimetype));
 				if (data == NULL) {
 					g_free (mimetype);
-					mimetype = my_g_file_info_get_mime_type_with_data (file, &data, parser);
+					mimetype = my_g_file_info_get_mime_type_with_data (file, &data, parser, parse_data);
 					DEBUG(file, g_print ("URI '%s' dual type has type '%s' from data\n", uri, mimetype));
 				}
 				/* If it's _still_ a text/plain, we don't want it */
@@ -2212,7 +3212,8 @@ totem_pl_parser_parse_internal (TotemPlParser *parser,
 				else
 					base_file = g_object_ref (base_file);
 
-				ret = (* func) (parser, file, base_file ? base_file : file, parse_data, data);
+				ret = totem_pl_parser_call_handler (parser, func, totem_pl_parser_mimetype_is_cacheable (mimetype),
+								    file, base_file ? base_file : file, parse_data, data);
 
 				if (base_file != NULL)
 					g_object_unref (base_file);
@@ -2239,10 +3240,33 @@ totem_pl_parser_parse_internal (TotemPlParser *parser,
 	return ret;
 }
 
+TotemPlParserResult
+totem_pl_parser_parse_internal (TotemPlParser *parser,
+				GFile *file,
+				GFile *base_file,
+				TotemPlParseData *parse_data)
+{
+	TotemPlParserSource *parent_source;
+	TotemPlParserResult ret;
+
+	/* Each recursion level gets its own source, the parent's
+	 * one is put back when we're done with this file */
+	parent_source = parse_data->source;
+	parse_data->source = totem_pl_parser_source_new (file);
+
+	ret = totem_pl_parser_parse_internal_with_source (parser, file, base_file, parse_data);
+
+	totem_pl_parser_source_free (parse_data->source);
+	parse_data->source = parent_source;
+
+	return ret;
+}
+
 typedef struct {
 	char *uri;
 	char *base;
 	gboolean fallback;
+	TotemPlPlaylist *playlist;
 } ParseAsyncData;
 
 static void
@@ -2250,6 +3274,7 @@ parse_async_data_free (ParseAsyncData *data)
 {
 	g_free (data->uri);
 	g_free (data->base);
+	g_clear_object (&data->playlist);
 	g_slice_free (ParseAsyncData, data);
 }
 
@@ -2268,7 +3293,10 @@ parse_thread (GTask *task, gpointer source_object, gpointer task_data, GCancella
 	}
 
 	/* Parse and return */
-	parse_result = totem_pl_parser_parse_with_base (parser, data->uri, data->base, data->fallback);
+	if (data->playlist != NULL)
+		parse_result = totem_pl_parser_parse_to_playlist (parser, data->uri, data->base, data->fallback, data->playlist);
+	else
+		parse_result = totem_pl_parser_parse_with_base (parser, data->uri, data->base, data->fallback);
 	g_task_return_int (task, parse_result);
 }
 
@@ -2306,6 +3334,7 @@ totem_pl_parser_parse_with_base_async (TotemPlParser *parser, const char *uri, c
 	data->uri = g_strdup (uri);
 	data->base = g_strdup (base);
 	data->fallback = fallback;
+	data->playlist = NULL;
 
 	task = g_task_new (parser, cancellable, callback, user_data);
 	g_task_set_task_data (task, data, (GDestroyNotify) parse_async_data_free);
@@ -2313,31 +3342,15 @@ totem_pl_parser_parse_with_base_async (TotemPlParser *parser, const char *uri, c
 	g_object_unref (task);
 }
 
-/**
- * totem_pl_parser_parse_with_base:
- * @parser: a #TotemPlParser
- * @uri: the URI of the playlist to parse
- * @base: (allow-none): the base path for relative filenames, or %NULL
- * @fallback: %TRUE if the parser should add the playlist URI to the
- * end of the playlist on parse failure
- *
- * Parses a playlist given by the absolute URI @uri, using
- * @base to resolve relative paths where appropriate.
- *
- * Return value: a #TotemPlParserResult
- **/
-TotemPlParserResult
-totem_pl_parser_parse_with_base (TotemPlParser *parser, const char *uri,
-				 const char *base, gboolean fallback)
+static TotemPlParserResult
+totem_pl_parser_parse_with_base_internal (TotemPlParser *parser, const char *uri,
+					  const char *base, gboolean fallback,
+					  TotemPlPlaylist *playlist)
 {
 	GFile *file, *base_file;
 	TotemPlParserResult retval;
 	TotemPlParseData data;
-
-	g_return_val_if_fail (TOTEM_PL_IS_PARSER (parser), TOTEM_PL_PARSER_RESULT_UNHANDLED);
-	g_return_val_if_fail (uri != NULL, TOTEM_PL_PARSER_RESULT_UNHANDLED);
-	g_return_val_if_fail (strstr (uri, "://") != NULL,
-			TOTEM_PL_PARSER_RESULT_ERROR);
+	gpointer parent_data;
 
 	file = g_file_new_for_uri (uri);
 	base_file = NULL;
@@ -2349,14 +3362,22 @@ totem_pl_parser_parse_with_base (TotemPlParser *parser, const char *uri,
 
 	/* Use a struct to store copies of the options as set for this parse operation */
 	data.recurse_level = 0;
+	data.source = NULL;
 	data.fallback = fallback;
 	data.recurse = parser->priv->recurse;
 	data.force = parser->priv->force;
 	data.disable_unsafe = parser->priv->disable_unsafe;
+	data.playlist = playlist;
 
 	if (base != NULL)
 		base_file = g_file_new_for_uri (base);
+
+	/* A signal handler might parse another playlist in this thread */
+	parent_data = g_private_get (&current_parse_data);
+	g_private_set (&current_parse_data, &data);
 	retval = totem_pl_parser_parse_internal (parser, file, base_file, &data);
+	g_private_set (&current_parse_data, parent_data);
+	totem_pl_parser_flush_batch (parser);
 
 	g_object_unref (file);
 	if (base_file != NULL)
@@ -2365,6 +3386,122 @@ totem_pl_parser_parse_with_base (TotemPlParser *parser, const char *uri,
 	return retval;
 }
 
+/**
+ * totem_pl_parser_parse_with_base:
+ * @parser: a #TotemPlParser
+ * @uri: the URI of the playlist to parse
+ * @base: (allow-none): the base path for relative filenames, or %NULL
+ * @fallback: %TRUE if the parser should add the playlist URI to the
+ * end of the playlist on parse failure
+ *
+ * Parses a playlist given by the absolute URI @uri, using
+ * @base to resolve relative paths where appropriate.
+ *
+ * Return value: a #TotemPlParserResult
+ **/
+TotemPlParserResult
+totem_pl_parser_parse_with_base (TotemPlParser *parser, const char *uri,
+				 const char *base, gboolean fallback)
+{
+	g_return_val_if_fail (TOTEM_PL_IS_PARSER (parser), TOTEM_PL_PARSER_RESULT_UNHANDLED);
+	g_return_val_if_fail (uri != NULL, TOTEM_PL_PARSER_RESULT_UNHANDLED);
+	g_return_val_if_fail (strstr (uri, "://") != NULL,
+			TOTEM_PL_PARSER_RESULT_ERROR);
+
+	return totem_pl_parser_parse_with_base_internal (parser, uri, base, fallback, NULL);
+}
+
+/**
+ * totem_pl_parser_parse_to_playlist:
+ * @parser: a #TotemPlParser
+ * @uri: the URI of the playlist to parse
+ * @base: (allow-none): the base path for relative filenames, or %NULL
+ * @fallback: %TRUE if the parser should add the playlist URI to the
+ * end of the playlist on parse failure
+ * @playlist: the #TotemPlPlaylist to add the entries to
+ *
+ * Parses a playlist given by the absolute URI @uri, using
+ * @base to resolve relative paths where appropriate, and appends
+ * the entries found to @playlist.
+ *
+ * This is equivalent to copying the metadata received in each
+ * #TotemPlParser::entry-parsed signal to a new item of @playlist,
+ * but the entries are added directly as they are parsed, and
+ * #TotemPlParser::entry-parsed is not emitted. The
+ * #TotemPlParser::playlist-started and #TotemPlParser::playlist-ended
+ * signals are still emitted. Other parse operations on @parser, even
+ * if they run at the same time, are not affected.
+ *
+ * Return value: a #TotemPlParserResult
+ *
+ * Since: 3.26.7
+ **/
+TotemPlParserResult
+totem_pl_parser_parse_to_playlist (TotemPlParser *parser, const char *uri,
+				   const char *base, gboolean fallback,
+				   TotemPlPlaylist *playlist)
+{
+	g_return_val_if_fail (TOTEM_PL_IS_PARSER (parser), TOTEM_PL_PARSER_RESULT_UNHANDLED);
+	g_return_val_if_fail (TOTEM_PL_IS_PLAYLIST (playlist), TOTEM_PL_PARSER_RESULT_UNHANDLED);
+	g_return_val_if_fail (uri != NULL, TOTEM_PL_PARSER_RESULT_UNHANDLED);
+	g_return_val_if_fail (strstr (uri, "://") != NULL,
+			TOTEM_PL_PARSER_RESULT_ERROR);
+
+	return totem_pl_parser_parse_with_base_internal (parser, uri, base, fallback, playlist);
+}
+
+/**
+ * totem_pl_parser_parse_to_playlist_async:
+ * @parser: a #TotemPlParser
+ * @uri: the URI of the playlist to parse
+ * @base: (allow-none): the base path for relative filenames, or %NULL
+ * @fallback: %TRUE if the parser should add the playlist URI to the
+ * end of the playlist on parse failure
+ * @playlist: the #TotemPlPlaylist to add the entries to
+ * @cancellable: (allow-none): optional #GCancellable object, or %NULL
+ * @callback: (allow-none): a #GAsyncReadyCallback to call when parsing is finished
+ * @user_data: data to pass to the @callback function
+ *
+ * Starts asynchronous parsing of a playlist given by the absolute URI @uri,
+ * appending its entries to @playlist. @parser, @uri and @playlist are all
+ * reffed/copied when this function is called, so can safely be freed after
+ * this function returns. @playlist must not be accessed until the operation
+ * is finished.
+ *
+ * For more details, see totem_pl_parser_parse_to_playlist(), which is the synchronous version of this function.
+ *
+ * When the operation is finished, @callback will be called. You can then call totem_pl_parser_parse_finish()
+ * to get the results of the operation.
+ *
+ * Since: 3.26.7
+ **/
+void
+totem_pl_parser_parse_to_playlist_async (TotemPlParser *parser, const char *uri,
+					 const char *base, gboolean fallback,
+					 TotemPlPlaylist *playlist,
+					 GCancellable *cancellable, GAsyncReadyCallback callback,
+					 gpointer user_data)
+{
+	GTask *task;
+	ParseAsyncData *data;
+
+	g_return_if_fail (TOTEM_PL_IS_PARSER (parser));
+	g_return_if_fail (TOTEM_PL_IS_PLAYLIST (playlist));
+	g_return_if_fail (uri != NULL);
+	g_return_if_fail (strstr (uri, "://") != NULL);
+
+	data = g_slice_new (ParseAsyncData);
+	data->uri = g_strdup (uri);
+	data->base = g_strdup (base);
+	data->fallback = fallback;
+	data->playlist = g_object_ref (playlist);
+
+	task = g_task_new (parser, cancellable, callback, user_data);
+	g_task_set_task_data (task, data, (GDestroyNotify) parse_async_data_free);
+	g_task_run_in_thread (task, parse_thread);
+	g_object_unref (task);
+}
+
 /**
  * totem_pl_parser_parse_async:
  * @parser: a #TotemPlParser
@@ -2396,8 +3533,8 @@ totem_pl_parser_parse_async (TotemPlParser *parser, const char *uri, gboolean fa
  * @async_result: a #GAsyncResult
  * @error: a #GError, or %NULL
  *
- * Finishes an asynchronous playlist parsing operation started with totem_pl_parser_parse_async()
- * or totem_pl_parser_parse_with_base_async().
+ * Finishes an asynchronous playlist parsing operation started with totem_pl_parser_parse_async(),
+ * totem_pl_parser_parse_with_base_async() or totem_pl_parser_parse_to_playlist_async().
  *
  * If parsing of the playlist is cancelled part-way through, %TOTEM_PL_PARSER_RESULT_CANCELLED is returned when
  * this function is called.
@@ -2474,6 +3611,9 @@ totem_pl_parser_add_ignored_scheme (TotemPlParser *parser,
 	g_hash_table_insert (parser->priv->ignore_schemes, s, GINT_TO_POINTER (1));
 
 	g_mutex_unlock (&parser->priv->ignore_mutex);
+
+	/* The cached entries might not be ignored */
+	totem_pl_parser_cache_clear (parser->priv->cache);
 }
 
 /**
@@ -2493,6 +3633,8 @@ totem_pl_parser_add_ignored_mimetype (TotemPlParser *parser,
 	g_mutex_lock (&parser->priv->ignore_mutex);
 	g_hash_table_insert (parser->priv->ignore_mimetypes, g_strdup (mimetype), GINT_TO_POINTER (1));
 	g_mutex_unlock (&parser->priv->ignore_mutex);
+
+	totem_pl_parser_cache_clear (parser->priv->cache);
 }
 
 /**
@@ -2514,6 +3656,8 @@ totem_pl_parser_add_ignored_glob (TotemPlParser *parser,
 	g_mutex_lock (&parser->priv->ignore_mutex);
 	g_hash_table_insert (parser->priv->ignore_globs, g_strdup (glob), GINT_TO_POINTER (1));
 	g_mutex_unlock (&parser->priv->ignore_mutex);
+
+	totem_pl_parser_cache_clear (parser->priv->cache);
 }
 
 /**
@@ -411,6 +411,19 @@ void totem_pl_parser_parse_with_base_async (TotemPlParser *parser,
 					    GAsyncReadyCallback callback,
                     			    gpointer user_data);
 
+TotemPlParserResult totem_pl_parser_parse_to_playlist (TotemPlParser *parser,
+						       const char *uri,
+						       const char *base,
+						       gboolean fallback,
+						       TotemPlPlaylist *playlist);
+void totem_pl_parser_parse_to_playlist_async (TotemPlParser *parser,
+					      const char *uri, const char *base,
+					      gboolean fallback,
+					      TotemPlPlaylist *playlist,
+					      GCancellable *cancellable,
+					      GAsyncReadyCallback callback,
+					      gpointer user_data);
+
 TotemPlParser *totem_pl_parser_new (void);
 
 /**
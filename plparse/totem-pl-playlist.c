@@ -44,11 +44,23 @@
  **/
 
 #include "totem-pl-playlist.h"
+#include "totem-pl-parser-private.h"
+#include "totem-pl-parser-entry.h"
 
 typedef struct TotemPlPlaylistPrivate TotemPlPlaylistPrivate;
 
+/* Items are kept in a GSequence, so that iters stay valid when
+ * other items are added, and insertions are O(log n). Each item
+ * carries the stamp of the playlist that owns it, which lets us
+ * check that an iter belongs to a playlist in constant time. */
+typedef struct {
+        guint stamp;
+        TotemPlParserEntry *entry;
+} TotemPlPlaylistItem;
+
 struct TotemPlPlaylistPrivate {
-        GList *items;
+        GSequence *items;
+        guint stamp;
 };
 
 static void totem_pl_playlist_finalize (GObject *object);
@@ -64,9 +76,23 @@ totem_pl_playlist_class_init (TotemPlPlaylistClass *klass)
         object_class->finalize = totem_pl_playlist_finalize;
 }
 
+static void
+playlist_item_free (TotemPlPlaylistItem *item)
+{
+        totem_pl_parser_entry_unref (item->entry);
+        g_slice_free (TotemPlPlaylistItem, item);
+}
+
 static void
 totem_pl_playlist_init (TotemPlPlaylist *playlist)
 {
+        static gint next_stamp = 0;
+        TotemPlPlaylistPrivate *priv;
+
+        priv = totem_pl_playlist_get_instance_private (playlist);
+
+        priv->items = g_sequence_new ((GDestroyNotify) playlist_item_free);
+        priv->stamp = (guint) g_atomic_int_add (&next_stamp, 1);
 }
 
 static void
@@ -76,8 +102,7 @@ totem_pl_playlist_finalize (GObject *object)
 
         priv = totem_pl_playlist_get_instance_private (TOTEM_PL_PLAYLIST (object));
 
-        g_list_foreach (priv->items, (GFunc) g_hash_table_destroy, NULL);
-        g_list_free (priv->items);
+        g_sequence_free (priv->items);
 
         G_OBJECT_CLASS (totem_pl_playlist_parent_class)->finalize (object);
 }
@@ -112,16 +137,38 @@ totem_pl_playlist_size (TotemPlPlaylist *playlist)
 
         priv = totem_pl_playlist_get_instance_private (playlist);
 
-        return g_list_length (priv->items);
+        return g_sequence_get_length (priv->items);
+}
+
+static TotemPlPlaylistItem *
+create_playlist_item (TotemPlPlaylist    *playlist,
+                      TotemPlParserEntry *entry)
+{
+        TotemPlPlaylistPrivate *priv;
+        TotemPlPlaylistItem *item;
+
+        priv = totem_pl_playlist_get_instance_private (playlist);
+
+        item = g_slice_new (TotemPlPlaylistItem);
+        item->stamp = priv->stamp;
+
+        if (entry != NULL) {
+                item->entry = entry;
+        } else {
+                item->entry = totem_pl_parser_entry_new ();
+        }
+
+        return item;
 }
 
-static GHashTable *
-create_playlist_item (void)
+static TotemPlParserEntry *
+get_item_entry (TotemPlPlaylistIter *iter)
 {
-        return g_hash_table_new_full (g_str_hash,
-                                      g_str_equal,
-                                      (GDestroyNotify) g_free,
-                                      (GDestroyNotify) g_free);
+        TotemPlPlaylistItem *item;
+
+        item = g_sequence_get (iter->data2);
+
+        return item->entry;
 }
 
 /**
@@ -138,18 +185,17 @@ totem_pl_playlist_prepend (TotemPlPlaylist     *playlist,
                            TotemPlPlaylistIter *iter)
 {
         TotemPlPlaylistPrivate *priv;
-        GHashTable *item;
+        TotemPlPlaylistItem *item;
 
         g_return_if_fail (TOTEM_PL_IS_PLAYLIST (playlist));
         g_return_if_fail (iter != NULL);
 
         priv = totem_pl_playlist_get_instance_private (playlist);
 
-        item = create_playlist_item ();
-        priv->items = g_list_prepend (priv->items, item);
+        item = create_playlist_item (playlist, NULL);
 
         iter->data1 = playlist;
-        iter->data2 = priv->items;
+        iter->data2 = g_sequence_prepend (priv->items, item);
 }
 
 /**
@@ -166,24 +212,34 @@ totem_pl_playlist_append (TotemPlPlaylist     *playlist,
                           TotemPlPlaylistIter *iter)
 {
         TotemPlPlaylistPrivate *priv;
-        GHashTable *item;
-        GList *list_item;
+        TotemPlPlaylistItem *item;
 
         g_return_if_fail (TOTEM_PL_IS_PLAYLIST (playlist));
         g_return_if_fail (iter != NULL);
 
         priv = totem_pl_playlist_get_instance_private (playlist);
 
-        item = create_playlist_item ();
+        item = create_playlist_item (playlist, NULL);
 
-        list_item = g_list_alloc ();
-        list_item->data = item;
+        iter->data1 = playlist;
+        iter->data2 = g_sequence_append (priv->items, item);
+}
 
-        priv->items = g_list_concat (priv->items, list_item);
+#ifndef TOTEM_PL_PARSER_MINI
+/* Appends a parsed entry to @playlist, taking a reference on @entry
+ * instead of copying it, for totem_pl_parser_parse_to_playlist() */
+void
+totem_pl_playlist_append_entry (TotemPlPlaylist    *playlist,
+                                TotemPlParserEntry *entry)
+{
+        TotemPlPlaylistPrivate *priv;
 
-        iter->data1 = playlist;
-        iter->data2 = list_item;
+        priv = totem_pl_playlist_get_instance_private (playlist);
+
+        g_sequence_append (priv->items,
+                           create_playlist_item (playlist, totem_pl_parser_entry_ref (entry)));
 }
+#endif /* !TOTEM_PL_PARSER_MINI */
 
 /**
  * totem_pl_playlist_insert:
@@ -204,18 +260,23 @@ totem_pl_playlist_insert (TotemPlPlaylist     *playlist,
                           TotemPlPlaylistIter *iter)
 {
         TotemPlPlaylistPrivate *priv;
-        GHashTable *item;
+        TotemPlPlaylistItem *item;
+        GSequenceIter *seq_iter;
 
         g_return_if_fail (TOTEM_PL_IS_PLAYLIST (playlist));
         g_return_if_fail (iter != NULL);
 
         priv = totem_pl_playlist_get_instance_private (playlist);
 
-        item = create_playlist_item ();
-        priv->items = g_list_insert (priv->items, item, position);
+        item = create_playlist_item (playlist, NULL);
+
+        if (position < 0 || position >= g_sequence_get_length (priv->items))
+                seq_iter = g_sequence_get_end_iter (priv->items);
+        else
+                seq_iter = g_sequence_get_iter_at_pos (priv->items, position);
 
         iter->data1 = playlist;
-        iter->data2 = g_list_find (priv->items, item);
+        iter->data2 = g_sequence_insert_before (seq_iter, item);
 }
 
 static gboolean
@@ -223,18 +284,25 @@ check_iter (TotemPlPlaylist     *playlist,
             TotemPlPlaylistIter *iter)
 {
         TotemPlPlaylistPrivate *priv;
+        TotemPlPlaylistItem *item;
 
         if (!iter) {
                 return FALSE;
         }
 
-        if (iter->data1 != playlist) {
+        if (iter->data1 != playlist || iter->data2 == NULL) {
                 return FALSE;
         }
 
         priv = totem_pl_playlist_get_instance_private (playlist);
 
-        if (g_list_position (priv->items, iter->data2) == -1) {
+        if (g_sequence_iter_is_end (iter->data2)) {
+                return FALSE;
+        }
+
+        item = g_sequence_get (iter->data2);
+
+        if (item->stamp != priv->stamp) {
                 return FALSE;
         }
 
@@ -261,13 +329,13 @@ totem_pl_playlist_iter_first (TotemPlPlaylist     *playlist,
 
         priv = totem_pl_playlist_get_instance_private (playlist);
 
-        if (!priv->items) {
+        if (g_sequence_is_empty (priv->items)) {
                 /* Empty playlist */
                 return FALSE;
         }
 
         iter->data1 = playlist;
-        iter->data2 = priv->items;
+        iter->data2 = g_sequence_get_begin_iter (priv->items);
 
         return TRUE;
 }
@@ -291,9 +359,14 @@ totem_pl_playlist_iter_next (TotemPlPlaylist     *playlist,
         g_return_val_if_fail (TOTEM_PL_IS_PLAYLIST (playlist), FALSE);
         g_return_val_if_fail (check_iter (playlist, iter), FALSE);
 
-        iter->data2 = ((GList *) iter->data2)->next;
+        iter->data2 = g_sequence_iter_next (iter->data2);
+
+        if (g_sequence_iter_is_end (iter->data2)) {
+                iter->data2 = NULL;
+                return FALSE;
+        }
 
-        return (iter->data2 != NULL);
+        return TRUE;
 }
 
 /**
@@ -315,9 +388,14 @@ totem_pl_playlist_iter_prev (TotemPlPlaylist     *playlist,
         g_return_val_if_fail (TOTEM_PL_IS_PLAYLIST (playlist), FALSE);
         g_return_val_if_fail (check_iter (playlist, iter), FALSE);
 
-        iter->data2 = ((GList *) iter->data2)->prev;
+        if (g_sequence_iter_is_begin (iter->data2)) {
+                iter->data2 = NULL;
+                return FALSE;
+        }
+
+        iter->data2 = g_sequence_iter_prev (iter->data2);
 
-        return (iter->data2 != NULL);
+        return TRUE;
 }
 
 /**
@@ -338,17 +416,17 @@ totem_pl_playlist_get_value (TotemPlPlaylist     *playlist,
                              const gchar         *key,
                              GValue              *value)
 {
-        GHashTable *item_data;
-        gchar *str;
+        TotemPlParserEntry *entry;
+        const gchar *str;
 
         g_return_val_if_fail (TOTEM_PL_IS_PLAYLIST (playlist), FALSE);
         g_return_val_if_fail (check_iter (playlist, iter), FALSE);
         g_return_val_if_fail (key != NULL, FALSE);
         g_return_val_if_fail (value != NULL, FALSE);
 
-        item_data = ((GList *) iter->data2)->data;
+        entry = get_item_entry (iter);
 
-        str = g_hash_table_lookup (item_data, key);
+        str = totem_pl_parser_entry_get (entry, key);
 
         if (!str) {
                 return FALSE;
@@ -373,13 +451,13 @@ totem_pl_playlist_get_valist (TotemPlPlaylist     *playlist,
                               TotemPlPlaylistIter *iter,
                               va_list              args)
 {
-        GHashTable *item_data;
+        TotemPlParserEntry *entry;
         gchar *key, **value;
 
         g_return_if_fail (TOTEM_PL_IS_PLAYLIST (playlist));
         g_return_if_fail (check_iter (playlist, iter));
 
-        item_data = ((GList *) iter->data2)->data;
+        entry = get_item_entry (iter);
 
         key = va_arg (args, gchar *);
 
@@ -387,9 +465,9 @@ totem_pl_playlist_get_valist (TotemPlPlaylist     *playlist,
                 value = va_arg (args, gchar **);
 
                 if (value) {
-                        gchar *str;
+                        const gchar *str;
 
-                        str = g_hash_table_lookup (item_data, key);
+                        str = totem_pl_parser_entry_get (entry, key);
                         *value = g_strdup (str);
                 }
 
@@ -438,7 +516,7 @@ totem_pl_playlist_set_value (TotemPlPlaylist     *playlist,
                              const gchar         *key,
                              GValue              *value)
 {
-        GHashTable *item_data;
+        TotemPlParserEntry *entry;
         gchar *str;
 
         g_return_val_if_fail (TOTEM_PL_IS_PLAYLIST (playlist), FALSE);
@@ -446,7 +524,7 @@ totem_pl_playlist_set_value (TotemPlPlaylist     *playlist,
         g_return_val_if_fail (key != NULL, FALSE);
         g_return_val_if_fail (value != NULL, FALSE);
 
-        item_data = ((GList *) iter->data2)->data;
+        entry = get_item_entry (iter);
 
         if (G_VALUE_TYPE (value) == G_TYPE_STRING) {
                 str = g_value_dup_string (value);
@@ -469,7 +547,7 @@ totem_pl_playlist_set_value (TotemPlPlaylist     *playlist,
                 return FALSE;
         }
 
-        g_hash_table_replace (item_data, g_strdup (key), str);
+        totem_pl_parser_entry_take (entry, key, str);
 
         return TRUE;
 }
@@ -487,22 +565,20 @@ totem_pl_playlist_set_valist (TotemPlPlaylist     *playlist,
                               TotemPlPlaylistIter *iter,
                               va_list              args)
 {
-        GHashTable *item_data;
+        TotemPlParserEntry *entry;
         gchar *key, *value;
 
         g_return_if_fail (TOTEM_PL_IS_PLAYLIST (playlist));
         g_return_if_fail (check_iter (playlist, iter));
 
-        item_data = ((GList *) iter->data2)->data;
+        entry = get_item_entry (iter);
 
         key = va_arg (args, gchar *);
 
         while (key) {
                 value = va_arg (args, gchar *);
 
-                g_hash_table_replace (item_data,
-                                      g_strdup (key),
-                                      g_strdup (value));
+                totem_pl_parser_entry_take (entry, key, g_strdup (value));
 
                 key = va_arg (args, gchar *);
         }
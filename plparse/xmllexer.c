@@ -25,9 +25,7 @@
 #define LOG
 */
 
-#ifdef HAVE_CONFIG_H
 #include "config.h"
-#endif
 
 #ifdef XINE_COMPILE
 #include <xine/xineutils.h>
@@ -43,58 +41,147 @@
 #endif
 #endif
 #include "xmllexer.h"
+#include "xmlentities.h"
 #include <stdio.h>
 #include <ctype.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdint.h>
 #ifdef HAVE_ICONV
 #include <iconv.h>
 #endif
 
-#include "bswap.h"
-
 /* private constants*/
 
 /* private global variables */
 struct lexer * static_lexer;
 
-enum utf { UTF32BE, UTF32LE, UTF16BE, UTF16LE };
+enum utf { UTF32BE = 1, UTF32LE, UTF16BE, UTF16LE };
 
-static void lex_convert (struct lexer * lexer, const char * buf, int size, enum utf utf)
+/* returns the next character of UTF-16 or UTF-32 text, and moves *p past
+ * it, or returns 0 at the end; surrogate pairs are combined, anything that
+ * isn't a valid character becomes U+FFFD */
+static uint32_t lex_next_utf (const unsigned char **p, const unsigned char *end, enum utf utf)
 {
-  char *utf8 = malloc (size * (utf >= UTF16BE ? 3 : 6) + 1);
-  char *bp = utf8;
-  while (size > 0)
+  const unsigned char *s = *p;
+  uint32_t c, c2;
+
+  if (utf == UTF32BE || utf == UTF32LE)
+  {
+    if (end - s < 4)
+      return 0;
+    if (utf == UTF32BE)
+      c = ((uint32_t) s[0] << 24) | ((uint32_t) s[1] << 16) | (s[2] << 8) | s[3];
+    else
+      c = ((uint32_t) s[3] << 24) | ((uint32_t) s[2] << 16) | (s[1] << 8) | s[0];
+    *p = s + 4;
+    if (c > 0x10FFFF || (c >= 0xD800 && c <= 0xDFFF))
+      c = 0xFFFD;
+    return c;
+  }
+
+  if (end - s < 2)
+    return 0;
+  c = utf == UTF16BE ? (s[0] << 8) | s[1] : (s[1] << 8) | s[0];
+  s += 2;
+  if (c >= 0xD800 && c <= 0xDFFF)
   {
-    uint32_t c = 0;
-    switch (utf)
+    c2 = 0;
+    if (c < 0xDC00 && end - s >= 2)
+      c2 = utf == UTF16BE ? (s[0] << 8) | s[1] : (s[1] << 8) | s[0];
+    if (c2 >= 0xDC00 && c2 <= 0xDFFF)
     {
-    case UTF32BE: c = _X_BE_32 (buf); buf += 4; break;
-    case UTF32LE: c = _X_LE_32 (buf); buf += 4; break;
-    case UTF16BE: c = _X_BE_16 (buf); buf += 2; break;
-    case UTF16LE: c = _X_LE_16 (buf); buf += 2; break;
-    default: /* erk! */ abort ();
+      c = 0x10000 + ((c - 0xD800) << 10) + (c2 - 0xDC00);
+      s += 2;
     }
-    if (!c)
-      break; /* embed a NUL, get a truncated string */
-    if (c < 128)
-      *bp++ = c;
     else
+      c = 0xFFFD;
+  }
+  *p = s;
+  return c;
+}
+
+static size_t lex_utf8_len (uint32_t c)
+{
+  return c < 0x80 ? 1 : c < 0x800 ? 2 : c < 0x10000 ? 3 : 4;
+}
+
+/* writes c, at most U+10FFFF, to buf as UTF-8; returns the length */
+static size_t lex_put_utf8 (char *buf, uint32_t c)
+{
+  if (c < 0x80)
+  {
+    buf[0] = c;
+    return 1;
+  }
+  if (c < 0x800)
+  {
+    buf[0] = 0xC0 | (c >> 6);
+    buf[1] = 0x80 | (c & 0x3F);
+    return 2;
+  }
+  if (c < 0x10000)
+  {
+    buf[0] = 0xE0 | (c >> 12);
+    buf[1] = 0x80 | ((c >> 6) & 0x3F);
+    buf[2] = 0x80 | (c & 0x3F);
+    return 3;
+  }
+  buf[0] = 0xF0 | (c >> 18);
+  buf[1] = 0x80 | ((c >> 12) & 0x3F);
+  buf[2] = 0x80 | ((c >> 6) & 0x3F);
+  buf[3] = 0x80 | (c & 0x3F);
+  return 4;
+}
+
+/* UTF-16 and UTF-32 text is converted to UTF-8 just before the first token
+ * gets lexed. A first pass works out the exact length of the UTF-8 text,
+ * and whether it ever gets ahead of the text it is converted from: if it
+ * doesn't, which is the case for mostly ASCII text, and the buffer is
+ * writable (in-situ mode), the text is converted in place. Otherwise it is
+ * converted to a buffer of exactly the right size, rather than one sized
+ * for the worst case. An embedded NUL ends the text.
+ */
+static void lex_convert (struct lexer * lexer)
+{
+  const unsigned char *start = (const unsigned char *) lexer->lexbuf;
+  const unsigned char *end = start + lexer->lexbuf_size;
+  const unsigned char *p;
+  enum utf utf = lexer->lex_utf;
+  int in_place = lexer->in_situ;
+  size_t len = 0;
+  uint32_t c;
+  char *utf8, *bp;
+
+  lexer->lex_utf = 0;
+
+  p = start;
+  while ((c = lex_next_utf (&p, end, utf)))
+  {
+    len += lex_utf8_len (c);
+    if (len > (size_t) (p - start))
+      in_place = 0;
+  }
+
+  if (in_place)
+    utf8 = (char *) lexer->lexbuf;
+  else
+  {
+    utf8 = lexer->lex_malloc = malloc (len + 1);
+    if (!utf8)
     {
-      int count = (c >= 0x04000000) ? 5 :
-		  (c >= 0x00200000) ? 4 :
-		  (c >= 0x00010000) ? 3 :
-		  (c >= 0x00000800) ? 2 : 1;
-      *bp = (char)(0x1F80 >> count);
-      count *= 6;
-      *bp++ |= c >> count;
-      while ((count -= 6) >= 0)
-	*bp++ = 128 | ((c >> count) & 0x3F);
+      lexer->lexbuf_size = 0;
+      return;
     }
   }
+
+  bp = utf8;
+  p = start;
+  while ((c = lex_next_utf (&p, end, utf)))
+    bp += lex_put_utf8 (bp, c);
   *bp = 0;
-  lexer->lexbuf_size = bp - utf8;
-  lexer->lexbuf = lexer->lex_malloc = realloc (utf8, lexer->lexbuf_size + 1);
+  lexer->lexbuf = utf8;
+  lexer->lexbuf_size = len;
 }
 
 /* for ABI compatibility */
@@ -114,22 +201,32 @@ struct lexer *lexer_init_r(const char * buf, int size) {
   lexer->lexbuf_size = size;
 
   if (size >= 4 && !memcmp (buf, boms + 2, 4))
-    lex_convert (lexer, buf + 4, size - 4, UTF32BE);
+    lexer->lex_utf = UTF32BE;
   else if (size >= 4 && !memcmp (buf, boms, 4))
-    lex_convert (lexer, buf + 4, size - 4, UTF32LE);
+    lexer->lex_utf = UTF32LE;
   else if (size >= 3 && !memcmp (buf, bom_utf8, 3))
   {
     lexer->lexbuf += 3;
     lexer->lexbuf_size -= 3;
   }
   else if (size >= 2 && !memcmp (buf, boms + 4, 2))
-    lex_convert (lexer, buf + 2, size - 2, UTF16BE);
+    lexer->lex_utf = UTF16BE;
   else if (size >= 2 && !memcmp (buf, boms, 2))
-    lex_convert (lexer, buf + 2, size - 2, UTF16LE);
+    lexer->lex_utf = UTF16LE;
+
+  /* skip the byte order mark; the text gets converted later on */
+  if (lexer->lex_utf)
+  {
+    int bom_size = lexer->lex_utf <= UTF32LE ? 4 : 2;
+    lexer->lexbuf += bom_size;
+    lexer->lexbuf_size -= bom_size;
+  }
 
   lexer->lexbuf_pos  = 0;
   lexer->lex_mode    = NORMAL;
   lexer->in_comment  = 0;
+  lexer->tok_start   = -1;
+  lexer->saved_pos   = -1;
 
   lprintf("buffer length %d\n", size);
   return lexer;
@@ -141,6 +238,159 @@ void lexer_finalize_r(struct lexer * lexer)
   free(lexer);
 }
 
+void lexer_set_in_situ_r(struct lexer * lexer)
+{
+  lexer->in_situ = 1;
+}
+
+char *lexer_get_token_in_situ_r(struct lexer * lexer)
+{
+  if (lexer->tok_start < 0)
+    return NULL;
+  return (char *) lexer->lexbuf + lexer->tok_start;
+}
+
+/* in-situ mode: terminates the len bytes of token text at start in the
+ * buffer; when that overwrites the next character to lex, it is saved */
+static void lex_in_situ_token(struct lexer * lexer, int start, int len)
+{
+  char *buf = (char *) lexer->lexbuf;
+  int end = start + len;
+
+  if (!lexer->in_situ)
+    return;
+
+  /* the text starts where the previous token got terminated, so it's
+   * only in the token buffer */
+  if (start == lexer->saved_pos)
+    return;
+
+  if (end >= lexer->lexbuf_pos) {
+    lexer->saved_pos = end;
+    lexer->saved_char = buf[end];
+  }
+  buf[end] = '\0';
+  lexer->tok_start = start;
+}
+
+/* text runs: data, CDATA sections and quoted strings only stop at a single
+ * character, so they are skipped with a byte search rather than going
+ * through the state machine one character at a time. The search returns
+ * the first c in [p, end), or end; the best version for the CPU is picked
+ * on first use.
+ */
+typedef const char *(*lex_scan_t) (const char *p, const char *end, char c);
+
+static const char *lex_scan_scalar (const char *p, const char *end, char c)
+{
+  while (p < end && *p != c)
+    p++;
+  return p;
+}
+
+/* portable version, a word at a time: a byte of x is zero when the top
+ * bit of (x - 0x01..) & ~x & 0x80.. is set for it */
+static const char *lex_scan_swar (const char *p, const char *end, char c)
+{
+  const uint64_t ones = 0x0101010101010101ULL;
+  const uint64_t highs = 0x8080808080808080ULL;
+  const uint64_t pattern = ones * (unsigned char) c;
+
+  while (end - p >= 8) {
+    uint64_t x;
+    memcpy (&x, p, 8);
+    x ^= pattern;
+    if ((x - ones) & ~x & highs)
+      break;
+    p += 8;
+  }
+  return lex_scan_scalar (p, end, c);
+}
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+
+static const char *lex_scan_sse2 (const char *p, const char *end, char c)
+{
+  const __m128i pattern = _mm_set1_epi8 (c);
+
+  while (end - p >= 16) {
+    __m128i v = _mm_loadu_si128 ((const __m128i *) p);
+    int mask = _mm_movemask_epi8 (_mm_cmpeq_epi8 (v, pattern));
+    if (mask)
+      return p + __builtin_ctz (mask);
+    p += 16;
+  }
+  return lex_scan_scalar (p, end, c);
+}
+#endif
+
+#ifdef HAVE_AVX2_INTRINSICS
+#include <immintrin.h>
+
+__attribute__((target("avx2")))
+static const char *lex_scan_avx2 (const char *p, const char *end, char c)
+{
+  const __m256i pattern = _mm256_set1_epi8 (c);
+
+  while (end - p >= 32) {
+    __m256i v = _mm256_loadu_si256 ((const __m256i *) p);
+    unsigned int mask = _mm256_movemask_epi8 (_mm256_cmpeq_epi8 (v, pattern));
+    if (mask)
+      return p + __builtin_ctz (mask);
+    p += 32;
+  }
+  return lex_scan_swar (p, end, c);
+}
+#endif
+
+static const char *lex_scan_init (const char *p, const char *end, char c);
+
+static lex_scan_t lex_scan_impl = lex_scan_init;
+
+static const char *lex_scan_init (const char *p, const char *end, char c)
+{
+  /* all the versions find the same thing, so racing here is harmless */
+  lex_scan_t impl = lex_scan_swar;
+
+#ifdef __SSE2__
+  impl = lex_scan_sse2;
+#endif
+#ifdef HAVE_AVX2_INTRINSICS
+  if (__builtin_cpu_supports ("avx2"))
+    impl = lex_scan_avx2;
+#endif
+  lex_scan_impl = impl;
+  return impl (p, end, c);
+}
+
+static inline const char *lex_scan (const char *p, const char *end, char c)
+{
+  /* most runs are short, and not worth a call */
+  if (end - p < 16)
+    return lex_scan_scalar (p, end, c);
+  return lex_scan_impl (p, end, c);
+}
+
+/* copies the current character c, and the text after it up to the next
+ * stop character, to the token, as far as the token buffer allows;
+ * returns the new token length */
+static int lex_copy_run (struct lexer * lexer, char *tok, int tok_pos, int tok_size,
+			 char c, char stop)
+{
+  const char *p = lexer->lexbuf + lexer->lexbuf_pos + 1;
+  const char *end = lexer->lexbuf + lexer->lexbuf_size;
+  const char *q;
+
+  tok[tok_pos++] = c;
+  if (end - p > tok_size - tok_pos)
+    end = p + (tok_size - tok_pos);
+  q = lex_scan (p, end, stop);
+  memcpy (tok + tok_pos, p, q - p);
+  lexer->lexbuf_pos += 1 + (q - p);
+  return tok_pos + (q - p);
+}
+
 typedef enum {
   STATE_UNKNOWN = -1,
   STATE_IDLE,
@@ -191,13 +441,77 @@ int lexer_get_token_d_r(struct lexer * lexer, char ** _tok, int * _tok_size, int
   int tok_size = *_tok_size;
 
   int tok_pos = 0;
+  int start = lexer->lexbuf_pos;
   lexer_state_t state = STATE_IDLE;
   char c;
 
+  lexer->tok_start = -1;
+
+  if (lexer->lex_utf) {
+    lex_convert (lexer);
+    start = lexer->lexbuf_pos;
+  }
+
+  if (tok && lexer->lex_mode == COMMENT) {
+    /* comments are skipped with a single scan for the closing "-->",
+     * whatever they contain; an unterminated one runs to the end */
+    const char *buf = lexer->lexbuf;
+    const char *p = buf + start;
+    const char *end = buf + lexer->lexbuf_size;
+
+    while ((p = lex_scan (p, end, '-')) < end &&
+           (end - p < 3 || memcmp (p, "-->", 3) != 0))
+      p++;
+    lexer->lex_mode = DATA;
+    tok[0] = '\0';
+    if (p == end) {
+      lexer->lexbuf_pos = lexer->lexbuf_size;
+      return T_EOF;
+    }
+    lexer->lexbuf_pos = p + 3 - buf;
+    return T_C_STOP;
+  }
+
+  if (tok && lexer->in_situ && lexer->lex_mode != NORMAL) {
+    /* in-situ mode: text runs are found with a single scan, and only
+     * terminated in the buffer */
+    const char *buf = lexer->lexbuf;
+    const char *p = buf + start;
+    const char *end = buf + lexer->lexbuf_size;
+
+    tok[0] = '\0';
+    if (lexer->lex_mode == DATA) {
+      p = lex_scan (p, end, '<');
+      if (p == end) {
+        lexer->lexbuf_pos = lexer->lexbuf_size;
+        return T_EOF;
+      }
+      lexer->lexbuf_pos = p - buf;
+      lexer->lex_mode = NORMAL;
+      lex_in_situ_token (lexer, start, lexer->lexbuf_pos - start);
+      return T_DATA;
+    }
+
+    while ((p = lex_scan (p, end, ']')) < end && strncmp (p, "]]>", 3) != 0)
+      p++;
+    if (p == end) {
+      lexer->lexbuf_pos = lexer->lexbuf_size;
+      return T_EOF;
+    }
+    lexer->lexbuf_pos = p + 3 - buf;
+    lexer->lex_mode = DATA;
+    lex_in_situ_token (lexer, start, p - buf - start);
+    return T_CDATA_STOP;
+  }
+
   if (tok) {
+  lex_resume:
     while ((tok_pos < tok_size) && (lexer->lexbuf_pos < lexer->lexbuf_size)) {
-      c = lexer->lexbuf[lexer->lexbuf_pos];
-      lprintf("c=%c, state=%s (%d), in_comment=%d\n", c, state_to_str(state), state, lexer->in_comment);
+      if (lexer->lexbuf_pos == lexer->saved_pos)
+        c = lexer->saved_char;
+      else
+        c = lexer->lexbuf[lexer->lexbuf_pos];
+      lprintf("c=%c, state=%s (%d)\n", c, state_to_str(state), state);
 
       switch (lexer->lex_mode) {
       case NORMAL:
@@ -232,8 +546,7 @@ int lexer_get_token_d_r(struct lexer * lexer, char ** _tok, int * _tok_size, int
 	    break;
 
 	  case '/':
-	    if (!lexer->in_comment)
-	      state = STATE_T_M_STOP_2;
+	    state = STATE_T_M_STOP_2;
 	    tok[tok_pos] = c;
 	    tok_pos++;
 	    break;
@@ -246,10 +559,12 @@ int lexer_get_token_d_r(struct lexer * lexer, char ** _tok, int * _tok_size, int
 
 	  case '\"': /* " */
 	    state = STATE_T_STRING_DOUBLE;
+	    start++;
 	    break;
 
 	  case '\'': /* " */
 	    state = STATE_T_STRING_SINGLE;
+	    start++;
 	    break;
 
 	  case '-':
@@ -259,8 +574,7 @@ int lexer_get_token_d_r(struct lexer * lexer, char ** _tok, int * _tok_size, int
 	    break;
 
 	  case '?':
-	    if (!lexer->in_comment)
-	      state = STATE_T_TI_STOP;
+	    state = STATE_T_TI_STOP;
 	    tok[tok_pos] = c;
 	    tok_pos++;
 	    break;
@@ -330,8 +644,7 @@ int lexer_get_token_d_r(struct lexer * lexer, char ** _tok, int * _tok_size, int
 	  /* T_M_STOP_1 */
 	case STATE_T_M_STOP_1:
 	  tok[tok_pos] = '\0';
-	  if (!lexer->in_comment)
-	    lexer->lex_mode = DATA;
+	  lexer->lex_mode = DATA;
 	  return T_M_STOP_1;
 	  break;
 
@@ -342,8 +655,7 @@ int lexer_get_token_d_r(struct lexer * lexer, char ** _tok, int * _tok_size, int
 	    lexer->lexbuf_pos++;
 	    tok_pos++; /* FIXME */
 	    tok[tok_pos] = '\0';
-	    if (!lexer->in_comment)
-	      lexer->lex_mode = DATA;
+	    lexer->lex_mode = DATA;
 	    return T_M_STOP_2;
 	  } else {
 	    tok[tok_pos] = '\0';
@@ -359,13 +671,13 @@ int lexer_get_token_d_r(struct lexer * lexer, char ** _tok, int * _tok_size, int
 
 	  /* T_STRING */
 	case STATE_T_STRING_DOUBLE:
-	  tok[tok_pos] = c;
-	  lexer->lexbuf_pos++;
 	  if (c == '\"') { /* " */
+	    lexer->lexbuf_pos++;
 	    tok[tok_pos] = '\0'; /* FIXME */
+	    lex_in_situ_token (lexer, start, tok_pos);
 	    return T_STRING;
 	  }
-	  tok_pos++;
+	  tok_pos = lex_copy_run (lexer, tok, tok_pos, tok_size, c, '\"');
 	  break;
 
 	  /* T_C_START or T_DOCTYPE_START or T_CDATA_START */
@@ -379,7 +691,7 @@ int lexer_get_token_d_r(struct lexer * lexer, char ** _tok, int * _tok_size, int
 		tok[tok_pos++] = '-'; /* FIXME */
 		tok[tok_pos++] = '-';
 		tok[tok_pos] = '\0';
-		lexer->in_comment = 1;
+		lexer->lex_mode = COMMENT;
 		return T_C_START;
 	      }
 	    break;
@@ -417,8 +729,7 @@ int lexer_get_token_d_r(struct lexer * lexer, char ** _tok, int * _tok_size, int
 	    lexer->lexbuf_pos++;
 	    tok_pos++; /* FIXME */
 	    tok[tok_pos] = '\0';
-	    if (!lexer->in_comment)
-	      lexer->lex_mode = DATA;
+	    lexer->lex_mode = DATA;
 	    return T_TI_STOP;
 	  } else {
 	    tok[tok_pos] = '\0';
@@ -454,9 +765,9 @@ int lexer_get_token_d_r(struct lexer * lexer, char ** _tok, int * _tok_size, int
 	    if (strlen(tok) != 3) {
 	      tok[tok_pos - 3] = '\0';
 	      lexer->lexbuf_pos -= 3;
+	      lex_in_situ_token (lexer, start, tok_pos - 3);
 	      return T_IDENT;
 	    } else {
-	      lexer->in_comment = 0;
 	      return T_C_STOP;
 	    }
 	    break;
@@ -470,13 +781,13 @@ int lexer_get_token_d_r(struct lexer * lexer, char ** _tok, int * _tok_size, int
 
 	  /* T_STRING (single quotes) */
 	case STATE_T_STRING_SINGLE:
-	  tok[tok_pos] = c;
-	  lexer->lexbuf_pos++;
 	  if (c == '\'') { /* " */
+	    lexer->lexbuf_pos++;
 	    tok[tok_pos] = '\0'; /* FIXME */
+	    lex_in_situ_token (lexer, start, tok_pos);
 	    return T_STRING;
 	  }
-	  tok_pos++;
+	  tok_pos = lex_copy_run (lexer, tok, tok_pos, tok_size, c, '\'');
 	  break;
 
 	  /* IDENT */
@@ -493,6 +804,7 @@ int lexer_get_token_d_r(struct lexer * lexer, char ** _tok, int * _tok_size, int
 	  case '=':
 	  case '/':
 	    tok[tok_pos] = '\0';
+	    lex_in_situ_token (lexer, start, tok_pos);
 	    return T_IDENT;
 	    break;
 	  case '?':
@@ -528,9 +840,7 @@ int lexer_get_token_d_r(struct lexer * lexer, char ** _tok, int * _tok_size, int
 	  lexer->lex_mode = NORMAL;
 	  return T_DATA;
 	default:
-	  tok[tok_pos] = c;
-	  tok_pos++;
-	  lexer->lexbuf_pos++;
+	  tok_pos = lex_copy_run (lexer, tok, tok_pos, tok_size, c, '<');
 	}
 	break;
 
@@ -550,9 +860,7 @@ int lexer_get_token_d_r(struct lexer * lexer, char ** _tok, int * _tok_size, int
 	  }
 	  break;
 	default:
-	  tok[tok_pos] = c;
-	  tok_pos++;
-	  lexer->lexbuf_pos++;
+	  tok_pos = lex_copy_run (lexer, tok, tok_pos, tok_size, c, ']');
 	}
 	break;
 
@@ -575,10 +883,11 @@ int lexer_get_token_d_r(struct lexer * lexer, char ** _tok, int * _tok_size, int
       lprintf("token buffer is too small (need %d)\n", tok_pos);
       lprintf("increasing buffer size to %d bytes\n", *_tok_size);
       if (tmp_tok) {
-	  *_tok = tmp_tok;
+	  *_tok = tok = tmp_tok;
 	  memset (*_tok + tok_size, 0, new_size - tok_size);
-	  *_tok_size = new_size;
-          return lexer_get_token_d_r (lexer, _tok, _tok_size, 0);
+	  *_tok_size = tok_size = new_size;
+	  /* carry on with the same token */
+	  goto lex_resume;
       } else {
           return T_ERROR;
       }
@@ -606,9 +915,11 @@ int lexer_get_token_d_r(struct lexer * lexer, char ** _tok, int * _tok_size, int
 	  break;
 	case STATE_T_STRING_SINGLE:
 	case STATE_T_STRING_DOUBLE:
+	  lex_in_situ_token (lexer, start, tok_pos);
 	  return T_STRING;
 	  break;
 	case STATE_IDENT:
+	  lex_in_situ_token (lexer, start, tok_pos);
 	  return T_DATA;
 	  break;
 	case STATE_UNKNOWN:
@@ -636,88 +947,98 @@ int lexer_get_token (char *tok, int tok_size)
   return lexer_get_token_d (&tok, &tok_size, 1);
 }
 
-static struct {
-  char code;
-  unsigned char namelen;
-  char name[6];
-} lexer_entities[] = {
-  { '"',  4, "quot" },
-  { '&',  3, "amp" },
-  { '\'', 4, "apos" },
-  { '<',  2, "lt" },
-  { '>',  2, "gt" },
-  { '\0', 0, "" }
-};
-
-char *lexer_decode_entities (const char *tok)
+/* parses the character reference after an '&' and writes its UTF-8 text
+ * to buf, which may be at or before the '&'; returns the number of bytes
+ * written and sets *end to just after the ';', or returns 0 if there is
+ * no valid reference there */
+static size_t lex_decode_entity (const char *ref, char *buf, const char **end)
 {
-  char *buf = calloc (strlen (tok) + 1, sizeof(char));
-  char *bp = buf;
-  char c;
+  const char *tp = ref;
+  uint32_t c = 0;
 
-  while ((c = *tok++))
+  if (*tp != '#')
   {
-    if (c != '&')
-      *bp++ = c;
-    else
-    {
-      /* parse the character entity (on failure, treat it as literal text) */
-      const char *tp = tok;
-      signed long i;
+    const char *value;
+    size_t len;
 
-      for (i = 0; lexer_entities[i].code; ++i)
-	if (!strncmp (lexer_entities[i].name, tok, lexer_entities[i].namelen)
-	    && tok[lexer_entities[i].namelen] == ';')
-	  break;
-      if (lexer_entities[i].code)
-      {
-        tok += lexer_entities[i].namelen + 1;
-	*bp++ = lexer_entities[i].code;
-	continue;
-      }
+    while (tp - ref <= XML_ENTITY_MAX_NAME
+	   && ((*tp >= 'a' && *tp <= 'z') || (*tp >= 'A' && *tp <= 'Z') || (*tp >= '0' && *tp <= '9')))
+      tp++;
+    if (*tp != ';' || !(value = xml_entity_lookup (ref, tp - ref, &len)))
+      return 0;
+    *end = tp + 1;
+    memcpy (buf, value, len);
+    return len;
+  }
 
-      if (*tp++ != '#')
-      {
-        /* not a recognised name and not numeric */
-	*bp++ = '&';
-	continue;
-      }
+  /* numeric; stop reading digits as soon as the value is out of range */
+  tp++;
+  if (*tp == 'x')
+  {
+    for (tp++; isxdigit ((unsigned char) *tp) && c <= 0x10FFFF; tp++)
+      c = (c << 4) | (*tp <= '9' ? *tp - '0' : (*tp | 0x20) - 'a' + 10);
+    if (tp == ref + 2)
+      return 0;
+  }
+  else
+  {
+    for (; *tp >= '0' && *tp <= '9' && c <= 0x10FFFF; tp++)
+      c = c * 10 + (*tp - '0');
+    if (tp == ref + 1)
+      return 0;
+  }
 
-      /* entity is a number
-       * (note: strtol() allows "0x" prefix for hexadecimal, but we don't)
-       */
-      if (*tp == 'x' && tp[1] && tp[2] != 'x')
-	i = strtol (tp + 1, (char **)&tp, 16);
-      else
-	i = strtol (tp, (char **)&tp, 10);
+  if (*tp != ';' || c == 0 || c > 0x10FFFF || (c >= 0xD800 && c <= 0xDFFF))
+    return 0;
+  *end = tp + 1;
+  return lex_put_utf8 (buf, c);
+}
 
-      if (*tp != ';' || i < 1)
-      {
-        /* out of range, or format error */
-	*bp++ = '&';
-	continue;
-      }
+/* decodes tok, which starts at its first '&', in place, as the decoded
+ * text is never longer; the text between references is moved down a run
+ * at a time, and references which can't be decoded are left as they are */
+static void lex_decode_entities (char *tok)
+{
+  char *bp = tok;
+  const char *tp = tok;
+  const char *amp;
 
-      tok = tp + 1;
+  for (;;)
+  {
+    size_t len = lex_decode_entity (tp + 1, bp, &amp);
 
-      if (i < 128)
-        /* ASCII - store as-is */
-	*bp++ = i;
-      else
-      {
-	/* Non-ASCII, so convert to UTF-8 */
-	int count = (i >= 0x04000000) ? 5 :
-		    (i >= 0x00200000) ? 4 :
-		    (i >= 0x00010000) ? 3 :
-		    (i >= 0x00000800) ? 2 : 1;
-	*bp = (char)(0x1F80 >> count);
-	count *= 6;
-	*bp++ |= i >> count;
-	while ((count -= 6) >= 0)
-	  *bp++ = 128 | ((i >> count) & 0x3F);
-      }
+    if (len)
+    {
+      bp += len;
+      tp = amp;
     }
+    else
+      *bp++ = *tp++;
+
+    amp = strchr (tp, '&');
+    if (!amp)
+      break;
+    memmove (bp, tp, amp - tp);
+    bp += amp - tp;
+    tp = amp;
   }
-  *bp = 0;
+  memmove (bp, tp, strlen (tp) + 1);
+}
+
+char *lexer_decode_entities (const char *tok)
+{
+  char *buf = strdup (tok);
+
+  if (buf)
+    lexer_decode_entities_in_situ (buf);
   return buf;
 }
+
+/* most text has no references at all, so only that gets looked for */
+void lexer_decode_entities_in_situ (char *tok)
+{
+  char *amp = strchr (tok, '&');
+
+  if (amp)
+    lex_decode_entities (amp);
+}
@@ -59,6 +59,7 @@ typedef enum {
   NORMAL,
   DATA,
   CDATA,
+  COMMENT,
 } LexMode;
 
 /* public structure */
@@ -68,8 +69,16 @@ struct lexer
   int lexbuf_size;
   int lexbuf_pos;
   LexMode lex_mode;
-  int in_comment;
+  int in_comment; /* unused, comments are skipped in COMMENT mode */
   char *lex_malloc;
+  /* in-situ mode: the text of the last token in lexbuf (or -1), and the
+   * character its terminating NUL replaced, not read yet */
+  int in_situ;
+  int tok_start;
+  int saved_pos;
+  char saved_char;
+  /* UTF-16 or UTF-32 text, converted before the first token */
+  int lex_utf;
 };
 
 
@@ -82,4 +91,13 @@ int lexer_get_token_d(char ** tok, int * tok_size, int fixed) XINE_DEPRECATED XI
 int lexer_get_token(char * tok, int tok_size) XINE_DEPRECATED XINE_PROTECTED;
 char *lexer_decode_entities (const char *tok) XINE_PROTECTED;
 
+/* in-situ mode: the text of T_IDENT, T_STRING, T_DATA and T_CDATA_STOP
+ * tokens is NUL-terminated in the lexer buffer itself, which must be
+ * writable up to and including buf[size]. Text runs aren't copied to
+ * the token buffer at all.
+ */
+void lexer_set_in_situ_r(struct lexer * lexer) XINE_PROTECTED;
+char *lexer_get_token_in_situ_r(struct lexer * lexer) XINE_PROTECTED;
+void lexer_decode_entities_in_situ (char *tok) XINE_PROTECTED;
+
 #endif
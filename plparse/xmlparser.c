@@ -27,6 +27,8 @@
 # include "config.h"
 #endif
 #include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
@@ -64,7 +66,29 @@
 
 #define TOKEN_SIZE  64 * 1024
 #define DATA_SIZE   64 * 1024
-#define MAX_RECURSION 26
+
+/* arena block sizes: blocks double in size, so that large documents only
+ * need a few of them */
+#define ARENA_MIN_BLOCK_SIZE  16 * 1024
+#define ARENA_MAX_BLOCK_SIZE  1024 * 1024
+
+/* All the nodes, properties and strings of a tree are carved out of the
+ * blocks of an arena, which is freed in one go with the tree. The root
+ * node returned to the caller is the first member of the tree, so that
+ * xml_parser_free_tree() can get back to the arena from it.
+ */
+typedef struct xml_arena_block_s {
+  struct xml_arena_block_s *next;
+  size_t size;
+  size_t used;
+  char data[];
+} xml_arena_block_t;
+
+typedef struct xml_tree_s {
+  xml_node_t root;
+  xml_arena_block_t *blocks;
+  char *buffer; /* in-situ text converted by the lexer */
+} xml_tree_t;
 
 /* private global variables */
 xml_parser_t * static_xml_parser;
@@ -81,43 +105,137 @@ static char * strtoupper(char * str) {
   return str;
 }
 
-static xml_node_t * new_xml_node(void) {
+static xml_tree_t *new_xml_tree(void) {
+  xml_tree_t *tree;
+
+  tree = (xml_tree_t*) calloc(1, sizeof(xml_tree_t));
+  return tree;
+}
+
+static void free_xml_tree(xml_tree_t *tree) {
+  xml_arena_block_t *block, *next;
+
+  for (block = tree->blocks; block; block = next) {
+    next = block->next;
+    free(block);
+  }
+  free(tree->buffer);
+  free(tree);
+}
+
+static void *XINE_MALLOC xml_arena_alloc(xml_tree_t *tree, size_t size, size_t align) {
+  xml_arena_block_t *block = tree->blocks;
+  size_t block_size;
+
+  if (block) {
+    uintptr_t start = (uintptr_t) (block->data + block->used);
+    size_t offset = block->used + ((align - start % align) % align);
+
+    if (offset + size <= block->size) {
+      block->used = offset + size;
+      return block->data + offset;
+    }
+  }
+
+  block_size = block ? block->size * 2 : ARENA_MIN_BLOCK_SIZE;
+  if (block_size > ARENA_MAX_BLOCK_SIZE)
+    block_size = ARENA_MAX_BLOCK_SIZE;
+
+  if (size + align > block_size / 4) {
+    /* large allocations get a block of their own, behind the current one,
+     * so that what's left of the current block can still be used */
+    xml_arena_block_t *large;
+
+    large = malloc(offsetof(xml_arena_block_t, data) + size + align);
+    if (!large)
+      return NULL;
+    large->size = size + align;
+    large->used = large->size;
+    if (block) {
+      large->next = block->next;
+      block->next = large;
+    } else {
+      large->next = NULL;
+      tree->blocks = large;
+    }
+    return large->data + ((align - (uintptr_t) large->data % align) % align);
+  }
+
+  block = malloc(offsetof(xml_arena_block_t, data) + block_size);
+  if (!block)
+    return NULL;
+  block->size = block_size;
+  block->used = 0;
+  block->next = tree->blocks;
+  tree->blocks = block;
+
+  return xml_arena_alloc(tree, size, align);
+}
+
+static char *xml_arena_strndup(xml_tree_t *tree, const char *str, size_t len) {
+  char *copy;
+
+  copy = xml_arena_alloc(tree, len + 1, 1);
+  if (copy) {
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+  }
+  return copy;
+}
+
+static char *xml_arena_strdup(xml_tree_t *tree, const char *str) {
+  return xml_arena_strndup(tree, str, strlen(str));
+}
+
+/* appends text to a string allocated in the arena; when the string is the
+ * most recent allocation of the current block, it is extended in place */
+static char *xml_arena_strcat(xml_tree_t *tree, char *str, const char *text) {
+  xml_arena_block_t *block = tree->blocks;
+  size_t len = strlen(str);
+  size_t text_len = strlen(text);
+  char *newtext;
+
+  if (block && str + len + 1 == block->data + block->used
+      && block->used + text_len <= block->size) {
+    memcpy(str + len, text, text_len + 1);
+    block->used += text_len;
+    return str;
+  }
+
+  newtext = xml_arena_alloc(tree, len + text_len + 1, 1);
+  if (!newtext)
+    return str;
+  memcpy(newtext, str, len);
+  memcpy(newtext + len, text, text_len + 1);
+  return newtext;
+}
+
+static xml_node_t * new_xml_node(xml_tree_t *tree) {
   xml_node_t * new_node;
 
-  new_node = (xml_node_t*) malloc(sizeof(xml_node_t));
+  new_node = (xml_node_t*) xml_arena_alloc(tree, sizeof(xml_node_t), sizeof(void *));
   new_node->name  = NULL;
   new_node->data  = NULL;
   new_node->props = NULL;
   new_node->child = NULL;
   new_node->next  = NULL;
+  new_node->atom  = XML_ATOM_NONE;
   return new_node;
 }
 
 static const char cdata[] = CDATA_MARKER;
 
-static void free_xml_node(xml_node_t * node) {
-  if (node->name != cdata)
-    free (node->name);
-  free (node->data);
-  free(node);
-}
-
-static xml_property_t *XINE_MALLOC new_xml_property(void) {
+static xml_property_t *XINE_MALLOC new_xml_property(xml_tree_t *tree) {
   xml_property_t * new_property;
 
-  new_property = (xml_property_t*) malloc(sizeof(xml_property_t));
+  new_property = (xml_property_t*) xml_arena_alloc(tree, sizeof(xml_property_t), sizeof(void *));
   new_property->name  = NULL;
   new_property->value = NULL;
   new_property->next  = NULL;
+  new_property->atom  = XML_ATOM_NONE;
   return new_property;
 }
 
-static void free_xml_property(xml_property_t * property) {
-  free (property->name);
-  free (property->value);
-  free(property);
-}
-
 /* for ABI compatibility */
 void xml_parser_init(const char * buf, int size, int mode) {
   if (static_xml_parser) {
@@ -138,52 +256,13 @@ void xml_parser_finalize_r(xml_parser_t *xml_parser) {
   free(xml_parser);
 }
 
-static void xml_parser_free_props(xml_property_t *current_property) {
-  if (current_property) {
-    if (!current_property->next) {
-      free_xml_property(current_property);
-    } else {
-      xml_parser_free_props(current_property->next);
-      free_xml_property(current_property);
-    }
-  }
-}
-
-static void xml_parser_free_tree_rec(xml_node_t *current_node, int free_next) {
-  lprintf("xml_parser_free_tree_rec: %s\n", current_node->name);
-
-  if (current_node) {
-    /* properties */
-    if (current_node->props) {
-      xml_parser_free_props(current_node->props);
-    }
-
-    /* child nodes */
-    if (current_node->child) {
-      lprintf("xml_parser_free_tree_rec: child\n");
-      xml_parser_free_tree_rec(current_node->child, 1);
-    }
-
-    /* next nodes */
-    if (free_next) {
-      xml_node_t *next_node = current_node->next;
-      xml_node_t *next_next_node;
-
-      while (next_node) {
-        next_next_node = next_node->next;
-        lprintf("xml_parser_free_tree_rec: next\n");
-        xml_parser_free_tree_rec(next_node, 0);
-        next_node = next_next_node;
-      }
-    }
-
-    free_xml_node(current_node);
-  }
-}
-
+/* the whole tree lives in the arena, so this is only O(blocks); the root
+ * node is the first member of its xml_tree_t */
 void xml_parser_free_tree(xml_node_t *current_node) {
   lprintf("xml_parser_free_tree\n");
-   xml_parser_free_tree_rec(current_node, 1);
+
+  if (current_node)
+    free_xml_tree((xml_tree_t *) current_node);
 }
 
 typedef enum {
@@ -234,7 +313,16 @@ static inline const char *state_to_str(parser_state_t state) {
   return states[state];
 }
 
-static xml_node_t *xml_parser_append_text (xml_node_t *node, xml_node_t *subnode, const char *text, int flags)
+/* in-situ mode: returns the text of the current token in the document
+ * itself, or a copy in the arena when the lexer couldn't leave it there */
+static char *xml_parser_token_in_situ (xml_parser_t *xml_parser, xml_tree_t *tree, const char *tok)
+{
+  char *text = lexer_get_token_in_situ_r (xml_parser->lexer);
+
+  return text ? text : xml_arena_strdup (tree, tok);
+}
+
+static xml_node_t *xml_parser_append_text (xml_tree_t *tree, xml_node_t *node, xml_node_t *subnode, char *text, int flags)
 {
   if (!text || !*text)
     return subnode; /* empty string -> nothing to do */
@@ -243,34 +331,145 @@ static xml_node_t *xml_parser_append_text (xml_node_t *node, xml_node_t *subnode
     /* we have a subtree, so we can't use node->data */
     if (subnode->name == cdata) {
       /* most recent node is CDATA - append to it */
-      char *newtext;
-      asprintf (&newtext, "%s%s", subnode->data, text);
-      free (subnode->data);
-      subnode->data = newtext;
+      subnode->data = xml_arena_strcat (tree, subnode->data, text);
     } else {
       /* most recent node is not CDATA - add a sibling */
-      subnode->next = new_xml_node ();
-      subnode->next->name = (char*) cdata; /* we never free cdata */
-      subnode->next->data = strdup (text);
+      subnode->next = new_xml_node (tree);
+      subnode->next->name = (char*) cdata;
+      subnode->next->data = (flags & XML_PARSER_IN_SITU) ? text : xml_arena_strdup (tree, text);
       subnode = subnode->next;
     }
   } else if (node->data) {
     /* "no" subtree, but we have existing text - append to it */
-    char *newtext;
-    asprintf (&newtext, "%s%s", node->data, text);
-    free (node->data);
-    node->data = newtext;
+    node->data = xml_arena_strcat (tree, node->data, text);
   } else {
     /* no text, "no" subtree - duplicate & assign */
     while (isspace (*text))
       ++text;
     if (*text)
-      node->data = strdup (text);
+      node->data = (flags & XML_PARSER_IN_SITU) ? text : xml_arena_strdup (tree, text);
   }
 
   return subnode;
 }
 
+/* A walk through the document calls the events callbacks as it goes; the
+ * tree builder and the subtree streamer below are written on top of it.
+ * The properties passed to start_element(), and the in-situ text the lexer
+ * couldn't leave in the document, are allocated from walker->arena, which
+ * the walker empties after each event when it's its scratch arena.
+ */
+typedef struct xml_walker_s {
+  xml_parser_t *xml_parser;
+  const xml_parser_events_t *events;
+  void *user_data;
+  xml_tree_t *arena;
+  xml_tree_t *scratch;
+  int flags;
+  /* names of the open elements, to match the close tags against */
+  char *names;
+  size_t names_size;
+  size_t names_used;
+  size_t *name_offsets;
+  int offsets_size;
+} xml_walker_t;
+
+/* empties an arena, keeping its most recent block for reuse */
+static void xml_arena_reset(xml_tree_t *tree) {
+  xml_arena_block_t *block = tree->blocks, *next;
+
+  if (!block)
+    return;
+  while (block->next) {
+    next = block->next->next;
+    free(block->next);
+    block->next = next;
+  }
+  block->used = 0;
+}
+
+static inline const char *xml_walker_name (const xml_walker_t *walker, int rec)
+{
+  return walker->names + walker->name_offsets[rec];
+}
+
+static int xml_walker_push_name (xml_walker_t *walker, const char *name, int rec)
+{
+  size_t len = strlen (name) + 1;
+
+  if (rec >= walker->offsets_size) {
+    int size = walker->offsets_size * 2;
+    size_t *offsets = realloc (walker->name_offsets, size * sizeof (*offsets));
+
+    if (!offsets)
+      return -1;
+    walker->name_offsets = offsets;
+    walker->offsets_size = size;
+  }
+  if (walker->names_used + len > walker->names_size) {
+    size_t size = walker->names_size * 2 + len;
+    char *names = realloc (walker->names, size);
+
+    if (!names)
+      return -1;
+    walker->names = names;
+    walker->names_size = size;
+  }
+  walker->name_offsets[rec] = walker->names_used;
+  memcpy (walker->names + walker->names_used, name, len);
+  walker->names_used += len;
+  return 0;
+}
+
+static int xml_walker_done (xml_walker_t *walker, int stop)
+{
+  if (walker->scratch && walker->arena == walker->scratch)
+    xml_arena_reset (walker->scratch);
+  return stop ? 1 : 0;
+}
+
+static int xml_walker_start (xml_walker_t *walker, char *name, xml_property_t *props, int rec)
+{
+  int stop = 0;
+
+  if (xml_walker_push_name (walker, name, rec) < 0)
+    return -1;
+  if (walker->events->start_element)
+    stop = walker->events->start_element (walker->user_data, name, props);
+  return xml_walker_done (walker, stop);
+}
+
+static int xml_walker_end (xml_walker_t *walker, int rec)
+{
+  int stop = 0;
+
+  if (walker->events->end_element)
+    stop = walker->events->end_element (walker->user_data, walker->names + walker->name_offsets[rec]);
+  walker->names_used = walker->name_offsets[rec];
+  return stop ? 1 : 0;
+}
+
+/* <foo/> and <?foo ...?>: the name is only needed until end_element() */
+static int xml_walker_leaf (xml_walker_t *walker, char *name, xml_property_t *props)
+{
+  int stop = 0;
+
+  if (walker->events->start_element)
+    stop = walker->events->start_element (walker->user_data, name, props);
+  if (!stop && walker->events->end_element)
+    stop = walker->events->end_element (walker->user_data, name);
+  return xml_walker_done (walker, stop);
+}
+
+static int xml_walker_text (xml_walker_t *walker, char *text)
+{
+  int stop = 0;
+
+  if (walker->events->text)
+    stop = walker->events->text (walker->user_data, text);
+  return xml_walker_done (walker, stop);
+}
+
 #define Q_STATE(CURRENT,NEW) (STATE_##NEW + state - STATE_##CURRENT)
 
 static int is_space(const char *str)
@@ -281,439 +480,464 @@ static int is_space(const char *str)
   return (*text == '\0');
 }
 
-static int xml_parser_get_node_internal (xml_parser_t *xml_parser,
+/* The walk is a single loop over the tokens: the open elements are kept
+ * in walker->names, rec being the depth of the innermost one, so that
+ * there's no limit on the nesting depth other than memory.
+ * returns 0 at the end of the document, 1 when a callback stopped the walk
+ * and -1 on error */
+static int xml_parser_walk_internal (xml_walker_t *walker,
 				 char ** token_buffer, int * token_buffer_size,
                                  char ** pname_buffer, int * pname_buffer_size,
-                                 char ** nname_buffer, int * nname_buffer_size,
-                                 xml_node_t *current_node, char *root_names[], int rec, int flags)
+                                 char ** nname_buffer, int * nname_buffer_size)
 {
+  xml_parser_t *xml_parser = walker->xml_parser;
+  int flags = walker->flags;
   char *tok = *token_buffer;
   char *property_name = *pname_buffer;
   char *node_name = *nname_buffer;
   parser_state_t state = STATE_IDLE;
   int res = 0;
+  int rec = 0;
   int parse_res;
   int bypass_get_token = 0;
   int retval = 0; /* used when state==4; non-0 if there are missing </...> */
-  xml_node_t *subtree = NULL;
-  xml_node_t *current_subtree = NULL;
   xml_property_t *current_property = NULL;
   xml_property_t *properties = NULL;
 
-  if (rec < MAX_RECURSION) {
+  memset (tok, 0, *token_buffer_size);
 
-    memset (tok, 0, *token_buffer_size);
+  while ((bypass_get_token) || (res = lexer_get_token_d_r(xml_parser->lexer, token_buffer, token_buffer_size, 0)) != T_ERROR) {
+    tok = *token_buffer;
+    bypass_get_token = 0;
+    lprintf("info: %d - %d : '%s'\n", state, res, tok);
 
-    while ((bypass_get_token) || (res = lexer_get_token_d_r(xml_parser->lexer, token_buffer, token_buffer_size, 0)) != T_ERROR) {
-      tok = *token_buffer;
-      bypass_get_token = 0;
-      lprintf("info: %d - %d : '%s'\n", state, res, tok);
-
-      switch (state) {
-      case STATE_IDLE:
-	switch (res) {
-	case (T_EOL):
-	case (T_SEPAR):
-	  /* do nothing */
-	  break;
-	case (T_EOF):
-	  return retval; /* normal end */
-	  break;
-	case (T_M_START_1):
-	  state = STATE_NODE;
-	  break;
-	case (T_M_START_2):
-	  state = STATE_NODE_CLOSE;
-	  break;
-	case (T_C_START):
-	  state = STATE_COMMENT;
-	  break;
-	case (T_TI_START):
-	  state = STATE_Q_NODE;
-	  break;
-	case (T_DOCTYPE_START):
-	  state = STATE_DOCTYPE;
-	  break;
-	case (T_CDATA_START):
-	  state = STATE_CDATA;
-	  break;
-	case (T_DATA):
-	  /* current data */
-	  {
-	    char *decoded = lexer_decode_entities (tok);
-	    current_subtree = xml_parser_append_text (current_node, current_subtree, decoded, flags);
-	    free (decoded);
-	  }
-	  lprintf("info: node data : %s\n", current_node->data);
-	  break;
-	default:
-	  lprintf("error: unexpected token \"%s\", state %s (%d)\n", tok, state_to_str(state), state);
-	  return -1;
-	  break;
+    switch (state) {
+    case STATE_IDLE:
+      switch (res) {
+      case (T_EOL):
+      case (T_SEPAR):
+	/* do nothing */
+	break;
+      case (T_EOF):
+	goto end_of_document;
+	break;
+      case (T_M_START_1):
+	state = STATE_NODE;
+	break;
+      case (T_M_START_2):
+	state = STATE_NODE_CLOSE;
+	break;
+      case (T_C_START):
+	state = STATE_COMMENT;
+	break;
+      case (T_TI_START):
+	state = STATE_Q_NODE;
+	break;
+      case (T_DOCTYPE_START):
+	state = STATE_DOCTYPE;
+	break;
+      case (T_CDATA_START):
+	state = STATE_CDATA;
+	break;
+      case (T_DATA):
+	/* current data */
+	if (flags & XML_PARSER_IN_SITU) {
+	  char *text = xml_parser_token_in_situ (xml_parser, walker->arena, tok);
+	  lexer_decode_entities_in_situ (text);
+	  if (xml_walker_text (walker, text))
+	    return 1;
+	} else {
+	  lexer_decode_entities_in_situ (tok);
+	  if (xml_walker_text (walker, tok))
+	    return 1;
 	}
+	lprintf("info: node data : %s\n", tok);
 	break;
-
-      case STATE_NODE:
-      case STATE_Q_NODE:
-	switch (res) {
-	case (T_IDENT):
-	  properties = NULL;
-	  current_property = NULL;
-
-	  /* save node name */
+      default:
+	lprintf("error: unexpected token \"%s\", state %s (%d)\n", tok, state_to_str(state), state);
+	return -1;
+	break;
+      }
+      break;
+
+    case STATE_NODE:
+    case STATE_Q_NODE:
+      switch (res) {
+      case (T_IDENT):
+	properties = NULL;
+	current_property = NULL;
+
+	if (flags & XML_PARSER_IN_SITU) {
+	  char *text = lexer_get_token_in_situ_r (xml_parser->lexer);
+
+	  /* in the document, "<?" comes right before the name */
+	  if (state == STATE_Q_NODE && text && text[-1] == '?')
+	    node_name = text - 1;
+	  else if (state == STATE_Q_NODE)
+	    node_name = xml_arena_strcat (walker->arena, xml_arena_strdup (walker->arena, "?"), tok);
+	  else
+	    node_name = xml_parser_token_in_situ (xml_parser, walker->arena, tok);
 	  if (xml_parser->mode == XML_PARSER_CASE_INSENSITIVE) {
-	    strtoupper(tok);
-	  }
-	  if (state == STATE_Q_NODE) {
-	    asprintf (&node_name, "?%s", tok);
-	    free (*nname_buffer);
-	    *nname_buffer = node_name;
-	    *nname_buffer_size = strlen (node_name) + 1;
-	    state = STATE_Q_ATTRIBUTE;
-	  } else {
-	    free (*nname_buffer);
-	    *nname_buffer = node_name = strdup (tok);
-	    *nname_buffer_size = strlen (node_name) + 1;
-	    state = STATE_ATTRIBUTE;
+	    strtoupper(node_name);
 	  }
+	  state = Q_STATE(NODE, ATTRIBUTE);
 	  lprintf("info: current node name \"%s\"\n", node_name);
 	  break;
-	default:
-	  lprintf("error: unexpected token \"%s\", state %s (%d)\n", tok, state_to_str(state), state);
-	  return -1;
-	  break;
 	}
+
+	/* save node name */
+	if (xml_parser->mode == XML_PARSER_CASE_INSENSITIVE) {
+	  strtoupper(tok);
+	}
+	if (state == STATE_Q_NODE) {
+	  asprintf (&node_name, "?%s", tok);
+	  free (*nname_buffer);
+	  *nname_buffer = node_name;
+	  *nname_buffer_size = strlen (node_name) + 1;
+	  state = STATE_Q_ATTRIBUTE;
+	} else {
+	  free (*nname_buffer);
+	  *nname_buffer = node_name = strdup (tok);
+	  *nname_buffer_size = strlen (node_name) + 1;
+	  state = STATE_ATTRIBUTE;
+	}
+	lprintf("info: current node name \"%s\"\n", node_name);
+	break;
+      default:
+	lprintf("error: unexpected token \"%s\", state %s (%d)\n", tok, state_to_str(state), state);
+	return -1;
 	break;
+      }
+      break;
 
-      case STATE_ATTRIBUTE:
-	switch (res) {
-	case (T_EOL):
-	case (T_SEPAR):
-	  /* nothing */
-	  break;
-	case (T_M_STOP_1):
-	  /* new subtree */
-	  subtree = new_xml_node();
-
-	  /* set node name */
-	  subtree->name = strdup(node_name);
-
-	  /* set node propertys */
-	  subtree->props = properties;
-	  lprintf("info: rec %d new subtree %s\n", rec, node_name);
-	  root_names[rec + 1] = strdup (node_name);
-	  parse_res = xml_parser_get_node_internal (xml_parser, token_buffer, token_buffer_size,
-						    pname_buffer, pname_buffer_size,
-						    nname_buffer, nname_buffer_size,
-						    subtree, root_names, rec + 1, flags);
-	  tok = *token_buffer;
-	  free (root_names[rec + 1]);
-	  if (parse_res == -1 || parse_res > 0) {
-	    return parse_res;
-	  }
-	  if (current_subtree == NULL) {
-	    current_node->child = subtree;
-	    current_subtree = subtree;
-	  } else {
-	    current_subtree->next = subtree;
-	    current_subtree = subtree;
-	  }
-	  if (parse_res < -1) {
-	    /* badly-formed XML (missing close tag) */
-	    return parse_res + 1 + (parse_res == -2);
-	  }
-	  state = STATE_IDLE;
-	  break;
-	case (T_M_STOP_2):
-	  /* new leaf */
-	  /* new subtree */
-	  new_leaf:
-	  subtree = new_xml_node();
-
-	  /* set node name */
-	  subtree->name = strdup (node_name);
-
-	  /* set node propertys */
-	  subtree->props = properties;
-
-	  lprintf("info: rec %d new subtree %s\n", rec, node_name);
-
-	  if (current_subtree == NULL) {
-	    current_node->child = subtree;
-	    current_subtree = subtree;
-	  } else {
-	    current_subtree->next = subtree;
-	    current_subtree = subtree;
-	  }
-	  state = STATE_IDLE;
-	  break;
-	case (T_IDENT):
-	  /* save property name */
-	  new_prop:
+    case STATE_ATTRIBUTE:
+      switch (res) {
+      case (T_EOL):
+      case (T_SEPAR):
+	/* nothing */
+	break;
+      case (T_M_STOP_1):
+	/* new subtree */
+	lprintf("info: rec %d new subtree %s\n", rec, node_name);
+	parse_res = xml_walker_start (walker, node_name, properties, ++rec);
+	if (parse_res)
+	  return parse_res;
+	state = STATE_IDLE;
+	break;
+      case (T_M_STOP_2):
+	/* new leaf */
+	new_leaf:
+	lprintf("info: rec %d new leaf %s\n", rec, node_name);
+	if (xml_walker_leaf (walker, node_name, properties))
+	  return 1;
+	state = STATE_IDLE;
+	break;
+      case (T_IDENT):
+	/* save property name */
+	new_prop:
+	if (flags & XML_PARSER_IN_SITU) {
+	  property_name = xml_parser_token_in_situ (xml_parser, walker->arena, tok);
 	  if (xml_parser->mode == XML_PARSER_CASE_INSENSITIVE) {
-	    strtoupper(tok);
+	    strtoupper(property_name);
 	  }
-	  /* make sure the buffer for the property name is big enough */
-	  if (*token_buffer_size > *pname_buffer_size) {
-	    char *tmp_prop;
-	    *pname_buffer_size = *token_buffer_size;
-	    tmp_prop = realloc (*pname_buffer, *pname_buffer_size);
-	    if (!tmp_prop)
-	      return -1;
-	    *pname_buffer = tmp_prop;
-	    property_name = tmp_prop;
-	  } else {
-	    property_name = *pname_buffer;
-	  }
-	  strcpy(property_name, tok);
 	  state = Q_STATE(ATTRIBUTE, ATTRIBUTE_EQUALS);
 	  lprintf("info: current property name \"%s\"\n", property_name);
 	  break;
-	default:
-	  lprintf("error: unexpected token \"%s\", state %s (%d)\n", tok, state_to_str(state), state);
-	  return -1;
-	  break;
 	}
-	break;
-
-      case STATE_Q_ATTRIBUTE:
-	switch (res) {
-	case (T_EOL):
-	case (T_SEPAR):
-	  /* nothing */
-	  break;
-	case (T_TI_STOP):
-	  goto new_leaf;
-	case (T_IDENT):
-	  goto new_prop;
-	default:
-	  lprintf("error: unexpected token \"%s\", state %s (%d)\n", tok, state_to_str(state), state);
-	  return -1;
-	  break;
+	if (xml_parser->mode == XML_PARSER_CASE_INSENSITIVE) {
+	  strtoupper(tok);
+	}
+	/* make sure the buffer for the property name is big enough */
+	if (*token_buffer_size > *pname_buffer_size) {
+	  char *tmp_prop;
+	  *pname_buffer_size = *token_buffer_size;
+	  tmp_prop = realloc (*pname_buffer, *pname_buffer_size);
+	  if (!tmp_prop)
+	    return -1;
+	  *pname_buffer = tmp_prop;
+	  property_name = tmp_prop;
+	} else {
+	  property_name = *pname_buffer;
 	}
+	strcpy(property_name, tok);
+	state = Q_STATE(ATTRIBUTE, ATTRIBUTE_EQUALS);
+	lprintf("info: current property name \"%s\"\n", property_name);
 	break;
+      default:
+	lprintf("error: unexpected token \"%s\", state %s (%d)\n", tok, state_to_str(state), state);
+	return -1;
+	break;
+      }
+      break;
 
-      case STATE_NODE_CLOSE:
-	switch (res) {
-	case (T_IDENT):
-	  /* must be equal to root_name */
-	  if (xml_parser->mode == XML_PARSER_CASE_INSENSITIVE) {
-	    strtoupper(tok);
-	  }
-	  if (strcmp(tok, root_names[rec]) == 0) {
-	    state = STATE_TAG_TERM;
-	  } else if (flags & XML_PARSER_RELAXED) {
-	    int r = rec;
-	    while (--r >= 0)
-	      if (strcmp(tok, root_names[r]) == 0) {
-		lprintf("warning: wanted %s, got %s - assuming missing close tags\n", root_names[rec], tok);
-		retval = r - rec - 1; /* -1 - (no. of implied close tags) */
-		state = STATE_TAG_TERM;
-		break;
-	      }
-	    /* relaxed parsing, ignoring extra close tag (but we don't handle out-of-order) */
-	    if (r < 0) {
-	      lprintf("warning: extra close tag %s - ignoring\n", tok);
-	      state = STATE_TAG_TERM_IGNORE;
+    case STATE_Q_ATTRIBUTE:
+      switch (res) {
+      case (T_EOL):
+      case (T_SEPAR):
+	/* nothing */
+	break;
+      case (T_TI_STOP):
+	goto new_leaf;
+      case (T_IDENT):
+	goto new_prop;
+      default:
+	lprintf("error: unexpected token \"%s\", state %s (%d)\n", tok, state_to_str(state), state);
+	return -1;
+	break;
+      }
+      break;
+
+    case STATE_NODE_CLOSE:
+      switch (res) {
+      case (T_IDENT):
+	/* must be equal to root_name */
+	if (xml_parser->mode == XML_PARSER_CASE_INSENSITIVE) {
+	  strtoupper(tok);
+	}
+	/* level 0 is the "" sentinel, not an element, so an empty close
+	 * tag name must never match it */
+	if (rec > 0 && strcmp(tok, xml_walker_name(walker, rec)) == 0) {
+	  state = STATE_TAG_TERM;
+	} else if (flags & XML_PARSER_RELAXED) {
+	  int r = rec;
+	  while (--r > 0)
+	    if (strcmp(tok, xml_walker_name(walker, r)) == 0) {
+	      lprintf("warning: wanted %s, got %s - assuming missing close tags\n", xml_walker_name(walker, rec), tok);
+	      retval = r - rec - 1; /* -1 - (no. of implied close tags) */
+	      state = STATE_TAG_TERM;
+	      break;
 	    }
+	  /* relaxed parsing, ignoring extra close tag (but we don't handle out-of-order) */
+	  if (r <= 0) {
+	    lprintf("warning: extra close tag %s - ignoring\n", tok);
+	    state = STATE_TAG_TERM_IGNORE;
 	  }
-	  else
-	  {
-	    lprintf("error: xml struct, tok=%s, waited_tok=%s\n", tok, root_names[rec]);
-	    return -1;
-	  }
-	  break;
-	default:
-	  lprintf("error: unexpected token \"%s\", state %s (%d)\n", tok, state_to_str(state), state);
+	}
+	else
+	{
+	  lprintf("error: xml struct, tok=%s, waited_tok=%s\n", tok, xml_walker_name(walker, rec));
 	  return -1;
-	  break;
 	}
 	break;
+      default:
+	lprintf("error: unexpected token \"%s\", state %s (%d)\n", tok, state_to_str(state), state);
+	return -1;
+	break;
+      }
+      break;
 
 				/* > expected */
-      case STATE_TAG_TERM:
-	switch (res) {
-	case (T_M_STOP_1):
-	  return retval;
-	  break;
-	default:
-	  if (!is_space(tok)) {
-	    lprintf("error: unexpected token \"%s\", state %s (%d)\n", tok, state_to_str(state), state);
-	    return -1;
-	  }
-	  break;
+    case STATE_TAG_TERM:
+      switch (res) {
+      case (T_M_STOP_1):
+	/* end of the element at depth rec; with retval < -1, the close
+	 * tag was for the one -1 - retval levels up, so the ones below
+	 * that are closed as well (badly-formed XML, missing close tags) */
+	do {
+	  if (xml_walker_end (walker, rec--))
+	    return 1;
+	} while (++retval < 0);
+	retval = 0;
+	state = STATE_IDLE;
+	break;
+      default:
+	if (!is_space(tok)) {
+	  lprintf("error: unexpected token \"%s\", state %s (%d)\n", tok, state_to_str(state), state);
+	  return -1;
 	}
 	break;
+      }
+      break;
 
 				/* = or > or ident or separator expected */
-      case STATE_ATTRIBUTE_EQUALS:
-	switch (res) {
-	case (T_EOL):
-	case (T_SEPAR):
-	  /* do nothing */
-	  break;
-	case (T_EQUAL):
-	  state = STATE_STRING;
-	  break;
-	case (T_IDENT):
-	  bypass_get_token = 1; /* jump to state 2 without get a new token */
-	  state = STATE_ATTRIBUTE;
-	  break;
-	case (T_M_STOP_1):
-	  /* add a new property without value */
-	  if (current_property == NULL) {
-	    properties = new_xml_property();
-	    current_property = properties;
-	  } else {
-	    current_property->next = new_xml_property();
-	    current_property = current_property->next;
-	  }
-	  current_property->name = strdup (property_name);
-	  lprintf("info: new property %s\n", current_property->name);
-	  bypass_get_token = 1; /* jump to state 2 without get a new token */
-	  state = STATE_ATTRIBUTE;
-	  break;
-	default:
-	  lprintf("error: unexpected token \"%s\", state %s (%d)\n", tok, state_to_str(state), state);
-	  return -1;
-	  break;
+    case STATE_ATTRIBUTE_EQUALS:
+      switch (res) {
+      case (T_EOL):
+      case (T_SEPAR):
+	/* do nothing */
+	break;
+      case (T_EQUAL):
+	state = STATE_STRING;
+	break;
+      case (T_IDENT):
+	bypass_get_token = 1; /* jump to state 2 without get a new token */
+	state = STATE_ATTRIBUTE;
+	break;
+      case (T_M_STOP_1):
+	/* add a new property without value */
+	if (current_property == NULL) {
+	  properties = new_xml_property(walker->arena);
+	  current_property = properties;
+	} else {
+	  current_property->next = new_xml_property(walker->arena);
+	  current_property = current_property->next;
 	}
+	current_property->name = (flags & XML_PARSER_IN_SITU) ? property_name : xml_arena_strdup (walker->arena, property_name);
+	current_property->atom = xml_atom_lookup (current_property->name);
+	lprintf("info: new property %s\n", current_property->name);
+	bypass_get_token = 1; /* jump to state 2 without get a new token */
+	state = STATE_ATTRIBUTE;
 	break;
+      default:
+	lprintf("error: unexpected token \"%s\", state %s (%d)\n", tok, state_to_str(state), state);
+	return -1;
+	break;
+      }
+      break;
 
 				/* = or ?> or ident or separator expected */
-      case STATE_Q_ATTRIBUTE_EQUALS:
-	switch (res) {
-	case (T_EOL):
-	case (T_SEPAR):
-	  /* do nothing */
-	  break;
-	case (T_EQUAL):
-	  state = STATE_Q_STRING;
-	  break;
-	case (T_IDENT):
-	  bypass_get_token = 1; /* jump to state 2 without get a new token */
-	  state = STATE_Q_ATTRIBUTE;
-	  break;
-	case (T_TI_STOP):
-	  /* add a new property without value */
-	  if (current_property == NULL) {
-	    properties = new_xml_property();
-	    current_property = properties;
-	  } else {
-	    current_property->next = new_xml_property();
-	    current_property = current_property->next;
-	  }
-	  current_property->name = strdup (property_name);
-	  lprintf("info: new property %s\n", current_property->name);
-	  bypass_get_token = 1; /* jump to state 2 without get a new token */
-	  state = STATE_Q_ATTRIBUTE;
-	  break;
-	default:
-	  lprintf("error: unexpected token \"%s\", state %s (%d)\n", tok, state_to_str(state), state);
-	  return -1;
-	  break;
+    case STATE_Q_ATTRIBUTE_EQUALS:
+      switch (res) {
+      case (T_EOL):
+      case (T_SEPAR):
+	/* do nothing */
+	break;
+      case (T_EQUAL):
+	state = STATE_Q_STRING;
+	break;
+      case (T_IDENT):
+	bypass_get_token = 1; /* jump to state 2 without get a new token */
+	state = STATE_Q_ATTRIBUTE;
+	break;
+      case (T_TI_STOP):
+	/* add a new property without value */
+	if (current_property == NULL) {
+	  properties = new_xml_property(walker->arena);
+	  current_property = properties;
+	} else {
+	  current_property->next = new_xml_property(walker->arena);
+	  current_property = current_property->next;
 	}
+	current_property->name = (flags & XML_PARSER_IN_SITU) ? property_name : xml_arena_strdup (walker->arena, property_name);
+	current_property->atom = xml_atom_lookup (current_property->name);
+	lprintf("info: new property %s\n", current_property->name);
+	bypass_get_token = 1; /* jump to state 2 without get a new token */
+	state = STATE_Q_ATTRIBUTE;
 	break;
+      default:
+	lprintf("error: unexpected token \"%s\", state %s (%d)\n", tok, state_to_str(state), state);
+	return -1;
+	break;
+      }
+      break;
 
 				/* string or ident or separator expected */
-      case STATE_STRING:
-      case STATE_Q_STRING:
-	switch (res) {
-	case (T_EOL):
-	case (T_SEPAR):
-	  /* do nothing */
-	  break;
-	case (T_STRING):
-	case (T_IDENT):
-	  /* add a new property */
-	  if (current_property == NULL) {
-	    properties = new_xml_property();
-	    current_property = properties;
-	  } else {
-	    current_property->next = new_xml_property();
-	    current_property = current_property->next;
-	  }
-	  current_property->name = strdup(property_name);
-	  current_property->value = lexer_decode_entities(tok);
-	  lprintf("info: new property %s=%s\n", current_property->name, current_property->value);
-	  state = Q_STATE(STRING, ATTRIBUTE);
-	  break;
-	default:
-	  lprintf("error: unexpected token \"%s\", state %s (%d)\n", tok, state_to_str(state), state);
-	  return -1;
-	  break;
+    case STATE_STRING:
+    case STATE_Q_STRING:
+      switch (res) {
+      case (T_EOL):
+      case (T_SEPAR):
+	/* do nothing */
+	break;
+      case (T_STRING):
+      case (T_IDENT):
+	/* add a new property */
+	if (current_property == NULL) {
+	  properties = new_xml_property(walker->arena);
+	  current_property = properties;
+	} else {
+	  current_property->next = new_xml_property(walker->arena);
+	  current_property = current_property->next;
+	}
+	if (flags & XML_PARSER_IN_SITU) {
+	  current_property->name = property_name;
+	  current_property->value = xml_parser_token_in_situ (xml_parser, walker->arena, tok);
+	  lexer_decode_entities_in_situ (current_property->value);
+	} else {
+	  lexer_decode_entities_in_situ (tok);
+	  current_property->name = xml_arena_strdup(walker->arena, property_name);
+	  current_property->value = xml_arena_strdup(walker->arena, tok);
 	}
+	current_property->atom = xml_atom_lookup (current_property->name);
+	lprintf("info: new property %s=%s\n", current_property->name, current_property->value);
+	state = Q_STATE(STRING, ATTRIBUTE);
 	break;
+      default:
+	lprintf("error: unexpected token \"%s\", state %s (%d)\n", tok, state_to_str(state), state);
+	return -1;
+	break;
+      }
+      break;
 
 				/* --> expected */
-      case STATE_COMMENT:
-	switch (res) {
-	case (T_C_STOP):
-	  state = STATE_IDLE;
-	  break;
-	default:
-	  break;
-	}
+    case STATE_COMMENT:
+      switch (res) {
+      case (T_C_STOP):
+	state = STATE_IDLE;
+	break;
+      case (T_EOF):
+	/* unterminated comment, runs to the end of the document */
+	goto end_of_document;
+	break;
+      default:
 	break;
+      }
+      break;
 
 				/* > expected */
-      case STATE_DOCTYPE:
-	switch (res) {
-	case (T_M_STOP_1):
-	  state = 0;
-	  break;
-	default:
-	  break;
-	}
+    case STATE_DOCTYPE:
+      switch (res) {
+      case (T_M_STOP_1):
+	state = 0;
+	break;
+      default:
 	break;
+      }
+      break;
 
 				/* ]]> expected */
-      case STATE_CDATA:
-	switch (res) {
-	case (T_CDATA_STOP):
-	  current_subtree = xml_parser_append_text (current_node, current_subtree, tok, flags);
-	  lprintf("info: node cdata : %s\n", tok);
-	  state = STATE_IDLE;
-	  break;
-        default:
-	  lprintf("error: unexpected token \"%s\", state %s (%d)\n", tok, state_to_str(state), state);
-	  return -1;
-	  break;
-	}
+    case STATE_CDATA:
+      switch (res) {
+      case (T_CDATA_STOP):
+	if (xml_walker_text (walker, (flags & XML_PARSER_IN_SITU) ? xml_parser_token_in_situ (xml_parser, walker->arena, tok) : tok))
+	  return 1;
+	lprintf("info: node cdata : %s\n", tok);
+	state = STATE_IDLE;
+	break;
+      default:
+	lprintf("error: unexpected token \"%s\", state %s (%d)\n", tok, state_to_str(state), state);
+	return -1;
 	break;
+      }
+      break;
 
 				/* > expected (following unmatched "</...") */
-      case STATE_TAG_TERM_IGNORE:
-	switch (res) {
-	case (T_M_STOP_1):
-	  state = STATE_IDLE;
-	  break;
-	default:
-	  lprintf("error: unexpected token \"%s\", state %s (%d)\n", tok, state_to_str(state), state);
-	  return -1;
-	  break;
-	}
+    case STATE_TAG_TERM_IGNORE:
+      switch (res) {
+      case (T_M_STOP_1):
+	state = STATE_IDLE;
 	break;
-
-
-      case STATE_Q_NODE_CLOSE:
-      case STATE_Q_TAG_TERM:
       default:
-	lprintf("error: unknown parser state, state=%d\n", state);
+	lprintf("error: unexpected token \"%s\", state %s (%d)\n", tok, state_to_str(state), state);
 	return -1;
+	break;
       }
+      break;
+
+
+    case STATE_Q_NODE_CLOSE:
+    case STATE_Q_TAG_TERM:
+    default:
+      lprintf("error: unknown parser state, state=%d\n", state);
+      return -1;
     }
-    /* lex error */
-    lprintf("error: lexer error\n");
-    return -1;
-  } else {
-    /* max recursion */
-    lprintf("error: max recursion\n");
-    return -1;
   }
+  /* lex error */
+  lprintf("error: lexer error\n");
+  return -1;
+
+ end_of_document:
+  /* the elements still open are closed, as if their close tags were
+   * missing */
+  while (rec > 0)
+    if (xml_walker_end (walker, rec--))
+      return 1;
+  return 0;
 }
 
-static int xml_parser_get_node (xml_parser_t *xml_parser, xml_node_t *current_node, int flags)
+/* returns 0 at the end of the document, 1 when a callback stopped the walk
+ * and -1 on error */
+static int xml_parser_walk (xml_walker_t *walker)
 {
   int res = 0;
   int token_buffer_size = TOKEN_SIZE;
@@ -722,19 +946,196 @@ static int xml_parser_get_node (xml_parser_t *xml_parser, xml_node_t *current_no
   char *token_buffer = calloc(1, token_buffer_size);
   char *pname_buffer = calloc(1, pname_buffer_size);
   char *nname_buffer = calloc(1, nname_buffer_size);
-  char *root_names[MAX_RECURSION + 1];
-  root_names[0] = (char*) ""; /* xml_parser_get_node_internal() only frees names which it allocates */
 
-  res = xml_parser_get_node_internal (xml_parser,
+  walker->names_size = 256;
+  walker->names = calloc(1, walker->names_size);
+  walker->names_used = 1;
+  walker->offsets_size = 32;
+  walker->name_offsets = calloc(walker->offsets_size, sizeof (*walker->name_offsets));
+  walker->name_offsets[0] = 0; /* "" */
+
+  if (walker->flags & XML_PARSER_IN_SITU)
+    lexer_set_in_situ_r(walker->xml_parser->lexer);
+
+  res = xml_parser_walk_internal (walker,
 			     &token_buffer, &token_buffer_size,
                              &pname_buffer, &pname_buffer_size,
-                             &nname_buffer, &nname_buffer_size,
-                             current_node, root_names, 0, flags);
+                             &nname_buffer, &nname_buffer_size);
 
   free (token_buffer);
   free (pname_buffer);
   free (nname_buffer);
+  free (walker->names);
+  free (walker->name_offsets);
+
+  return res;
+}
+
+int xml_parser_parse_events_r(xml_parser_t *xml_parser, const xml_parser_events_t *events,
+                              void *user_data, int flags) {
+  xml_walker_t walker = { 0 };
+  int res;
 
+  walker.xml_parser = xml_parser;
+  walker.events = events;
+  walker.user_data = user_data;
+  walker.flags = flags;
+  walker.scratch = walker.arena = new_xml_tree();
+  if (!walker.scratch)
+    return -1;
+
+  res = xml_parser_walk(&walker);
+
+  free_xml_tree(walker.scratch);
+  return res < 0 ? -1 : 0;
+}
+
+/* Builds nodes out of the walk events. nodes[] are the open elements, with
+ * nodes[0] being the one the tree hangs from, and last[] their most
+ * recent child; both grow with the depth, and are kept from one tree to
+ * the next. The builder has to be zeroed before it's first initialised,
+ * and cleared when done. */
+typedef struct xml_builder_s {
+  xml_tree_t *tree;
+  int flags;
+  int depth;
+  int size;
+  int error; /* out of memory */
+  xml_node_t **nodes;
+  xml_node_t **last;
+} xml_builder_t;
+
+static int xml_builder_grow (xml_builder_t *builder)
+{
+  int size = builder->size ? builder->size * 2 : 32;
+  xml_node_t **nodes, **last;
+
+  nodes = realloc (builder->nodes, size * sizeof (*nodes));
+  if (!nodes)
+    return -1;
+  builder->nodes = nodes;
+  last = realloc (builder->last, size * sizeof (*last));
+  if (!last)
+    return -1;
+  builder->last = last;
+  builder->size = size;
+  return 0;
+}
+
+static void xml_builder_init (xml_builder_t *builder, xml_tree_t *tree, int flags)
+{
+  builder->tree = tree;
+  builder->flags = flags;
+  builder->depth = 0;
+  if (!builder->size && xml_builder_grow (builder) < 0) {
+    builder->error = 1;
+    return;
+  }
+  builder->nodes[0] = &tree->root;
+  builder->last[0] = NULL;
+}
+
+static void xml_builder_clear (xml_builder_t *builder)
+{
+  free (builder->nodes);
+  free (builder->last);
+}
+
+/* returns -1 when out of memory */
+static int xml_builder_start (xml_builder_t *builder, char *name, xml_property_t *props)
+{
+  xml_tree_t *tree = builder->tree;
+  xml_node_t *node;
+  int depth = builder->depth;
+
+  if (builder->error || (depth + 1 >= builder->size && xml_builder_grow (builder) < 0)) {
+    builder->error = 1;
+    return -1;
+  }
+
+  node = new_xml_node (tree);
+
+  node->name = (builder->flags & XML_PARSER_IN_SITU) ? name : xml_arena_strdup (tree, name);
+  node->atom = xml_atom_lookup (name);
+  node->props = props;
+  if (builder->last[depth])
+    builder->last[depth]->next = node;
+  else
+    builder->nodes[depth]->child = node;
+  builder->last[depth] = node;
+
+  builder->nodes[++depth] = node;
+  builder->last[depth] = NULL;
+  builder->depth = depth;
+  return 0;
+}
+
+static void xml_builder_text (xml_builder_t *builder, char *text)
+{
+  int depth = builder->depth;
+
+  builder->last[depth] = xml_parser_append_text (builder->tree, builder->nodes[depth],
+                                                 builder->last[depth], text, builder->flags);
+}
+
+static int xml_tree_start_element (void *user_data, char *name, xml_property_t *props)
+{
+  /* stops the walk when out of memory */
+  return xml_builder_start (user_data, name, props) < 0;
+}
+
+static int xml_tree_end_element (void *user_data, char *name)
+{
+  ((xml_builder_t *) user_data)->depth--;
+  return 0;
+}
+
+static int xml_tree_text (void *user_data, char *text)
+{
+  xml_builder_text (user_data, text);
+  return 0;
+}
+
+static const xml_parser_events_t xml_tree_events = {
+  xml_tree_start_element,
+  xml_tree_end_element,
+  xml_tree_text
+};
+
+static int xml_parser_get_node (xml_parser_t *xml_parser, xml_tree_t *tree, int flags)
+{
+  xml_walker_t walker = { 0 };
+  xml_builder_t builder = { 0 };
+  int res;
+
+  xml_builder_init (&builder, tree, flags);
+  if (builder.error)
+    return -1;
+
+  walker.xml_parser = xml_parser;
+  walker.events = &xml_tree_events;
+  walker.user_data = &builder;
+  walker.arena = tree;
+  walker.flags = flags;
+
+  res = xml_parser_walk (&walker);
+  if (builder.error)
+    res = -1;
+
+  /* an element with an error in it is left out, as are its ancestors */
+  if (res < 0 && builder.depth > 0) {
+    xml_node_t *node = tree->root.child;
+
+    if (node == builder.nodes[1])
+      tree->root.child = NULL;
+    else {
+      while (node->next != builder.nodes[1])
+	node = node->next;
+      node->next = NULL;
+    }
+  }
+
+  xml_builder_clear (&builder);
   return res;
 }
 
@@ -744,24 +1145,33 @@ int xml_parser_build_tree_with_options(xml_node_t **root_node, int flags) {
 }
 
 int xml_parser_build_tree_with_options_r(xml_parser_t *xml_parser, xml_node_t **root_node, int flags) {
+  xml_tree_t *tree;
   xml_node_t *tmp_node, *pri_node, *q_node;
   int res;
 
-  tmp_node = new_xml_node();
-  res = xml_parser_get_node(xml_parser, tmp_node, flags);
+  tree = new_xml_tree();
+  if (!tree)
+    return -1;
+  tmp_node = &tree->root;
+  res = xml_parser_get_node(xml_parser, tree, flags);
+
+  /* the lexer converted UTF-16 or UTF-32 text to a buffer of its own */
+  if (flags & XML_PARSER_IN_SITU) {
+    tree->buffer = xml_parser->lexer->lex_malloc;
+    xml_parser->lexer->lex_malloc = NULL;
+  }
 
   /* delete any top-level [CDATA] nodes */;
   pri_node = tmp_node->child;
   q_node = NULL;
   while (pri_node) {
     if (pri_node->name == cdata) {
-      xml_node_t *old = pri_node;
+      /* left in the arena, it goes away with the tree */
       if (q_node)
         q_node->next = pri_node->next;
       else
         q_node = pri_node;
       pri_node = pri_node->next;
-      free_xml_node (old);
     } else {
       q_node = pri_node;
       pri_node = pri_node->next;
@@ -780,17 +1190,147 @@ int xml_parser_build_tree_with_options_r(xml_parser_t *xml_parser, xml_node_t **
       pri_node->next = tmp_node->child;
       q_node->next = NULL;
     }
-    *root_node = pri_node;
-    free_xml_node(tmp_node);
+    /* the root node has to be the one at the start of the tree */
+    tree->root = *pri_node;
+    *root_node = &tree->root;
     res = 0;
   } else {
     lprintf("error: xml struct\n");
-    xml_parser_free_tree(tmp_node);
+    free_xml_tree(tree);
     res = -1;
   }
   return res;
 }
 
+/* Streams the elements at a given depth as trees of their own: the
+ * elements above it are passed to open() and close() without their
+ * children, and a new tree is built from each element at the depth.
+ */
+typedef struct xml_streamer_s {
+  xml_walker_t *walker;
+  const xml_parser_stream_t *stream;
+  void *user_data;
+  int depth;
+  int target;
+  xml_builder_t builder; /* builder.tree is only set within a subtree */
+} xml_streamer_t;
+
+static xml_property_t *xml_copy_properties (xml_tree_t *tree, const xml_property_t *props)
+{
+  xml_property_t *copy = NULL, **next = &copy;
+
+  for (; props; props = props->next) {
+    *next = new_xml_property (tree);
+    (*next)->name = xml_arena_strdup (tree, props->name);
+    (*next)->atom = props->atom;
+    if (props->value)
+      (*next)->value = xml_arena_strdup (tree, props->value);
+    next = &(*next)->next;
+  }
+  return copy;
+}
+
+static int xml_stream_start_element (void *user_data, char *name, xml_property_t *props)
+{
+  xml_streamer_t *streamer = user_data;
+  int depth = streamer->depth++;
+  xml_node_t node = { 0 };
+  xml_tree_t *tree;
+
+  /* as in xml_parser_build_tree*(), <?...?> nodes aren't root elements */
+  if (depth == 0 && name[0] == '?')
+    return 0;
+
+  if (depth > streamer->target)
+    return xml_builder_start (&streamer->builder, name, props) < 0;
+
+  node.name = name;
+  node.atom = xml_atom_lookup (name);
+  node.props = props;
+
+  if (depth < streamer->target)
+    return streamer->stream->open ? streamer->stream->open (streamer->user_data, &node, depth) : 0;
+
+  if (streamer->stream->start && streamer->stream->start (streamer->user_data, &node))
+    return 1;
+
+  /* the properties are in the scratch arena */
+  tree = new_xml_tree();
+  if (!tree)
+    return 1;
+  tree->root.name = xml_arena_strdup (tree, name);
+  tree->root.atom = node.atom;
+  tree->root.props = xml_copy_properties (tree, props);
+  streamer->walker->arena = tree;
+  xml_builder_init (&streamer->builder, tree, streamer->walker->flags);
+  return streamer->builder.error;
+}
+
+static int xml_stream_end_element (void *user_data, char *name)
+{
+  xml_streamer_t *streamer = user_data;
+  int depth = --streamer->depth;
+  xml_tree_t *tree;
+
+  if (depth == 0 && name[0] == '?')
+    return 0;
+  if (depth > streamer->target) {
+    streamer->builder.depth--;
+    return 0;
+  }
+  if (depth < streamer->target)
+    return streamer->stream->close ? streamer->stream->close (streamer->user_data, name, depth) : 0;
+
+  tree = streamer->builder.tree;
+  streamer->builder.tree = NULL;
+  streamer->walker->arena = streamer->walker->scratch;
+  return streamer->stream->subtree (streamer->user_data, &tree->root);
+}
+
+static int xml_stream_text (void *user_data, char *text)
+{
+  xml_streamer_t *streamer = user_data;
+
+  if (streamer->builder.tree)
+    xml_builder_text (&streamer->builder, text);
+  return 0;
+}
+
+static const xml_parser_events_t xml_stream_events = {
+  xml_stream_start_element,
+  xml_stream_end_element,
+  xml_stream_text
+};
+
+int xml_parser_stream_subtrees_r(xml_parser_t *xml_parser, int depth, const xml_parser_stream_t *stream,
+                                 void *user_data, int flags) {
+  xml_walker_t walker = { 0 };
+  xml_streamer_t streamer = { 0 };
+  int res;
+
+  streamer.walker = &walker;
+  streamer.stream = stream;
+  streamer.user_data = user_data;
+  streamer.target = depth;
+
+  walker.xml_parser = xml_parser;
+  walker.events = &xml_stream_events;
+  walker.user_data = &streamer;
+  walker.flags = flags;
+  walker.scratch = walker.arena = new_xml_tree();
+  if (!walker.scratch)
+    return -1;
+
+  res = xml_parser_walk(&walker);
+
+  /* stopped, or broken off, in the middle of a subtree */
+  if (streamer.builder.tree)
+    free_xml_tree(streamer.builder.tree);
+  xml_builder_clear(&streamer.builder);
+  free_xml_tree(walker.scratch);
+  return res < 0 || streamer.builder.error ? -1 : 0;
+}
+
 /* for ABI compatibility */
 int xml_parser_build_tree(xml_node_t **root_node) {
   return xml_parser_build_tree_with_options_r (static_xml_parser, root_node, 0);
@@ -803,13 +1343,17 @@ int xml_parser_build_tree_r(xml_parser_t *xml_parser, xml_node_t **root_node) {
 const char *xml_parser_get_property (const xml_node_t *node, const char *name) {
 
   xml_property_t *prop;
+  int atom;
+
+  /* names the parser knows about only need comparing their atoms */
+  atom = xml_atom_lookup (name);
 
   prop = node->props;
   while (prop) {
 
     lprintf ("looking for %s in %s\n", name, prop->name);
 
-    if (!strcasecmp (prop->name, name)) {
+    if (atom != XML_ATOM_NONE ? prop->atom == atom : !strcasecmp (prop->name, name)) {
       lprintf ("found it. value=%s\n", prop->value);
       return prop->value;
     }
@@ -820,6 +1364,29 @@ const char *xml_parser_get_property (const xml_node_t *node, const char *name) {
   return NULL;
 }
 
+void xml_parser_get_properties (const xml_node_t *node, const xml_atom_t *atoms,
+				const char **values, int n_atoms) {
+
+  const xml_property_t *prop;
+  unsigned char found[XML_NUM_ATOMS];
+  int i;
+
+  for (i = 0; i < n_atoms; i++)
+    values[i] = NULL;
+
+  /* the atoms are already case-folded, so a property only needs one
+   * comparison against each requested atom */
+  memset (found, 0, sizeof (found));
+  for (prop = node->props; prop; prop = prop->next) {
+    if (prop->atom == XML_ATOM_NONE || found[prop->atom])
+      continue;
+    found[prop->atom] = 1;
+    for (i = 0; i < n_atoms; i++)
+      if (atoms[i] == prop->atom)
+        values[i] = prop->value;
+  }
+}
+
 int xml_parser_get_property_int (const xml_node_t *node, const char *name,
 				 int def_value) {
 
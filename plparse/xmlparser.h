@@ -30,6 +30,8 @@
 #define XINE_PROTECTED
 #endif
 
+#include "xmlatoms.h"
+
 /* parser modes */
 #define XML_PARSER_CASE_INSENSITIVE  0
 #define XML_PARSER_CASE_SENSITIVE    1
@@ -41,15 +43,25 @@
 /* xml_parser_build_tree_with_options flag bits */
 #define XML_PARSER_RELAXED		1
 #define XML_PARSER_MULTI_TEXT		2
+/* names, values and text point into the buffer passed to xml_parser_init_r(),
+ * which gets modified, must be writable up to and including buf[size], and
+ * must be kept around until the tree is freed
+ */
+#define XML_PARSER_IN_SITU		4
 
 /* node name for extra text chunks */
 #define CDATA_MARKER "[CDATA]"
 
 /* xml property */
+/* .atom is the XML_ATOM_* value of the name (see xmlatoms.list), or
+ * XML_ATOM_NONE for names the format parsers don't know about; the same
+ * goes for nodes.
+ */
 typedef struct xml_property_s {
 	char *name;
 	char *value;
 	struct xml_property_s *next;
+	int atom;
 } xml_property_t;
 
 /* xml node */
@@ -67,6 +79,7 @@ typedef struct xml_node_s {
 	struct xml_property_s *props;
 	struct xml_node_s *child;
 	struct xml_node_s *next;
+	int atom;
 } xml_node_t;
 
 /* xml parser */
@@ -85,6 +98,47 @@ int xml_parser_build_tree_r(xml_parser_t *xml_parser, xml_node_t **root_node) XI
 int xml_parser_build_tree_with_options(xml_node_t **root_node, int flags) XINE_DEPRECATED XINE_PROTECTED;
 int xml_parser_build_tree_with_options_r(xml_parser_t *xml_parser, xml_node_t **root_node, int flags) XINE_PROTECTED;
 
+/* event interface: the document is walked without building a tree, and
+ * the callbacks are called as elements are opened and closed, and as text
+ * (or CDATA) is found; returning non-zero from one of them stops the walk.
+ * Missing close tags are reported as the tree builder would assume them.
+ * The name, properties and text are only valid during the call.
+ * Returns 0 at the end of the document or when stopped, -1 on error.
+ */
+typedef struct xml_parser_events_s {
+	int (*start_element) (void *user_data, char *name, xml_property_t *props);
+	int (*end_element) (void *user_data, char *name);
+	int (*text) (void *user_data, char *text);
+} xml_parser_events_t;
+
+int xml_parser_parse_events_r(xml_parser_t *xml_parser, const xml_parser_events_t *events,
+			      void *user_data, int flags) XINE_PROTECTED;
+
+/* streaming: open() and close() are called for each element above the
+ * given depth (0 being the root element), the node passed to open() having
+ * no children, and only being valid during the call; subtree() is passed
+ * each element at the given depth as it is closed, as the root of a tree
+ * of its own, which is then owned by the callee. With XML_PARSER_IN_SITU,
+ * the subtrees may also point into the lexer, so must be freed before
+ * xml_parser_finalize_r(). The optional start() is passed each element at
+ * the given depth as open() would be, before its children are read, so
+ * that the walk can be stopped without reading them.
+ * Returns 0 at the end of the document or when stopped, -1 on error.
+ */
+typedef struct xml_parser_stream_s {
+	int (*open) (void *user_data, const xml_node_t *node, int depth);
+	int (*subtree) (void *user_data, xml_node_t *node);
+	int (*close) (void *user_data, const char *name, int depth);
+	int (*start) (void *user_data, const xml_node_t *node);
+} xml_parser_stream_t;
+
+int xml_parser_stream_subtrees_r(xml_parser_t *xml_parser, int depth, const xml_parser_stream_t *stream,
+				 void *user_data, int flags) XINE_PROTECTED;
+
+/* the nodes, properties and strings of a tree all come from an arena
+ * owned by the tree: they can't be freed or reallocated one by one, and
+ * only the root node returned by xml_parser_build_tree*() can be freed
+ */
 void xml_parser_free_tree(xml_node_t *root_node) XINE_PROTECTED;
 
 const char *xml_parser_get_property (const xml_node_t *node, const char *name) XINE_PROTECTED;
@@ -92,6 +146,12 @@ int   xml_parser_get_property_int (const xml_node_t *node, const char *name,
 				   int def_value) XINE_PROTECTED;
 int xml_parser_get_property_bool (const xml_node_t *node, const char *name,
 				  int def_value) XINE_PROTECTED;
+/* looks up several properties in a single pass over the node's properties:
+ * values[i] is set to the value of the first property whose atom is atoms[i],
+ * or to NULL if there is none
+ */
+void xml_parser_get_properties (const xml_node_t *node, const xml_atom_t *atoms,
+				const char **values, int n_atoms) XINE_PROTECTED;
 
 /* for output:
  * returns an escaped string (free() it when done)